@@ -10,12 +10,23 @@
 #include <vector>
 #include <time.h>
 #include <stdlib.h>
-#include <sys/resource.h>
 #include <unistd.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "palisade_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
 
 using namespace std;
 using namespace lbcrypto;
 
+namespace {
+
 void print(Plaintext v, int length){
     int print_size = 20;
     int end_size = 2;
@@ -60,28 +71,30 @@ int random_int(int min, int max){
 	return min + rand() % (max+1 - min);
 }
 
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("BFV_PALISADE_Luminousity");
+	Benchmark benchmark(profiler);
+	summary.library_threads = palisade_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
 	srand(time(NULL));
 
 	/*****Parameter Generation*****/
-	clock_t cc_clock;
-	cc_clock = clock();
+	profiler.start(Phase::ParameterGeneration);
 	
 	//Parameter Selection
-	int plaintextModulus = 2147352577;
-	double sigma = 3.2;
+	typedef PalisadeParameters<Scheme::BFV, LuminousityWorkload> Parameters;
+	int plaintextModulus = Parameters::plain_modulus;
+	double sigma = Parameters::sigma;
 	SecurityLevel securityLevel = HEStd_128_classic;
-	int numMults = 3;
-	uint32_t depth = 3;
-	usint dcrtBits = 60;
-	usint ringDim = 32768;
+	int numMults = Parameters::depth;
+	uint32_t depth = Parameters::key_depth;
+	usint dcrtBits = Parameters::dcrt_bits;
+	usint ringDim = benchmark.config().ring_dimension_or(Parameters::ring_dimension);
 
 	//Create the cryptoContext with the desired parameters
 	CryptoContext<DCRTPoly> cc = CryptoContextFactory<DCRTPoly>::genCryptoContextBFVrns(
@@ -101,11 +114,13 @@ int main(){
 	cc->Enable(ENCRYPTION);
 	cc->Enable(SHE);
 
-	cc_clock = clock() - cc_clock;
+	//Every encoding, encryption and evaluation goes through the profiled context
+	ProfiledCryptoContext<DCRTPoly> he(cc, ops);
+
+	profiler.stop();
 
 	/*****Key Generation*****/ 
-	clock_t key_clock;
-	key_clock = clock();
+	profiler.start(Phase::KeyGeneration);
 
 	//Create the container for the public key   
 	LPKeyPair<DCRTPoly> keyPair;
@@ -114,58 +129,51 @@ int main(){
 	keyPair = cc->KeyGen();
 
 	//Generate the relinearization key
-	cc->EvalMultKeyGen(keyPair.secretKey);
+	palisade_generate_keys(cc, keyPair, true, false, {}, pool);
 
-	key_clock = clock() - key_clock;
+	profiler.stop();
 
 	/*****Encoding & Encryption*****/
-	clock_t enc_clock;
-	enc_clock = clock();
-
 	//Create and encode the plaintext vectors and variables
-	int N = 8192; 
+	long N = benchmark.plan_chunks(min<long>(Parameters::batch_size, cc->GetRingDimension()));
 	vector<long> Radius;
 	vector<long> SurfaceTemperature;
 
 	for(int i = 0; i < N; i++){
-		Radius.push_back(random_int(9, 81));
-		SurfaceTemperature.push_back(random_int(2, 20));
+		Radius.push_back(random_int(LuminousityWorkload::min_radius, LuminousityWorkload::max_radius));
+		SurfaceTemperature.push_back(random_int(LuminousityWorkload::min_temperature, LuminousityWorkload::max_temperature));
 	}
 
-	Plaintext plain_radius = cc->MakePackedPlaintext(Radius);
-	Plaintext plain_temperature = cc->MakePackedPlaintext(SurfaceTemperature);
+	Plaintext plain_radius;
+	Plaintext plain_temperature;
+	Ciphertext<DCRTPoly> enc_radius;
+	Ciphertext<DCRTPoly> enc_temperature;
 
-	//Encrypt the encodings
-	auto enc_radius = cc->Encrypt(keyPair.publicKey, plain_radius);
-	auto enc_temperature = cc->Encrypt(keyPair.publicKey, plain_temperature);
+	benchmark.run(Phase::Encryption, [&](){
+		plain_radius = he.MakePackedPlaintext(Radius);
+		plain_temperature = he.MakePackedPlaintext(SurfaceTemperature);
 
-	enc_clock = clock() - enc_clock;
+		//Encrypt the encodings
+		enc_radius = he.Encrypt(keyPair.publicKey, plain_radius);
+		enc_temperature = he.Encrypt(keyPair.publicKey, plain_temperature);
+	});
 
 	/*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
-
-	vector<Ciphertext<DCRTPoly>> ciphertexts;
-	
-	ciphertexts.push_back(enc_radius);
-	ciphertexts.push_back(enc_radius);
-	ciphertexts.push_back(enc_temperature);
-	ciphertexts.push_back(enc_temperature);
-	ciphertexts.push_back(enc_temperature);
-	ciphertexts.push_back(enc_temperature);
-	
-	auto enc_Result = cc->EvalMultMany(ciphertexts);
+	PalisadeBackend<Scheme::BFV> backend(he);
+	Ciphertext<DCRTPoly> enc_radiusSquared, enc_temperatureSquared, enc_temperatureQuadruple;
+	Ciphertext<DCRTPoly> enc_Result;
 
-	eval_clock = clock() - eval_clock;
+	benchmark.run(Phase::Evaluation, [&](){
+		luminousity(backend, enc_radius, enc_temperature, enc_radiusSquared, enc_temperatureSquared,
+		            enc_temperatureQuadruple, enc_Result, pool);
+	});
 
 	/*****Decryption*****/
-	clock_t dec_clock;
-	dec_clock = clock();
-
 	Plaintext plain_Result;
-	cc->Decrypt(keyPair.secretKey, enc_Result, &plain_Result);
 
-	dec_clock = clock() - dec_clock;
+	benchmark.run(Phase::Decryption, [&](){
+		he.Decrypt(keyPair.secretKey, enc_Result, &plain_Result);
+	});
 	
 	/*
 	//Luminousity calculator
@@ -180,6 +188,7 @@ int main(){
 
 	/*****Print*****/
 	cout << "Starting the ( Luminousity/(4*pi*sigma) ) of a star caluculator with " << N << " instances. "<< endl << endl;
+	cout << "Evaluation plan: " << luminousity_plan(backend.levelled) << endl << endl;
 
 	cout << "Radius: " << endl;
 	print(plain_radius, N);
@@ -193,13 +202,60 @@ int main(){
 	//cout << "Luminousity: " << endl;
 	//printDouble(Luminousity, num_slots);
 	
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
-
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	/*****Memory*****/
+	memory.track("public key", palisade_bytes(keyPair.publicKey));
+	memory.track("secret key", palisade_bytes(keyPair.secretKey));
+	memory.track("relin keys", palisade_relin_key_bytes<DCRTPoly>());
+	for(const Plaintext* plain : {&plain_radius, &plain_temperature, &plain_Result})
+		memory.track("plaintext", palisade_bytes(*plain));
+	for(const Ciphertext<DCRTPoly>* enc : {&enc_radius, &enc_temperature, &enc_radiusSquared,
+			&enc_temperatureSquared, &enc_temperatureQuadruple, &enc_Result})
+		memory.track("ciphertext", palisade_bytes(*enc));
+
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", palisade_serialize(keyPair.publicKey));
+		footprint.add_key("secret key", palisade_serialize(keyPair.secretKey), false);
+		footprint.add_key("relin keys", palisade_relin_keys_serialized<DCRTPoly>());
+		for(const Ciphertext<DCRTPoly>* enc : {&enc_radius, &enc_temperature})
+			palisade_footprint(footprint, FootprintRole::Input, *enc, N);
+		for(const Ciphertext<DCRTPoly>* enc : {&enc_radiusSquared, &enc_temperatureSquared, &enc_temperatureQuadruple})
+			palisade_footprint(footprint, FootprintRole::Intermediate, *enc, N);
+		palisade_footprint(footprint, FootprintRole::Result, enc_Result, N);
+	}
+
+	summary.ring_dimension = cc->GetRingDimension();
+	summary.slot_count = cc->GetRingDimension();
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
+
+	//Drop the keys and contexts PALISADE caches, the driver runs several calculators in one process
+	CryptoContextImpl<DCRTPoly>::ClearEvalMultKeys();
+	CryptoContextImpl<DCRTPoly>::ClearEvalSumKeys();
+	CryptoContextImpl<DCRTPoly>::ClearEvalAutomorphismKeys();
+	CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
 	return 0;
-}
\ No newline at end of file
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(BFV, PALISADE, Luminousity, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
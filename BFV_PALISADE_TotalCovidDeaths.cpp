@@ -10,12 +10,23 @@
 #include <vector>
 #include <time.h>
 #include <stdlib.h>
-#include <sys/resource.h>
 #include <unistd.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "palisade_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
 
 using namespace std;
 using namespace lbcrypto;
 
+namespace {
+
 void print(Plaintext v, int length){
     int print_size = 20;
     int end_size = 2;
@@ -40,28 +51,30 @@ int random_int(int min, int max){
 	return min + rand() % (max+1 - min);
 }
 
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("BFV_PALISADE_TotalCovidDeaths");
+	Benchmark benchmark(profiler);
+	summary.library_threads = palisade_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
 	srand(time(NULL));
 
 	/*****Parameter Generation*****/
-	clock_t cc_clock;
-	cc_clock = clock();
+	profiler.start(Phase::ParameterGeneration);
 	
 	//Parameter Selection
-	int plaintextModulus = 65537;
-	double sigma = 3.2;
+	typedef PalisadeParameters<Scheme::BFV, TotalCovidDeathsWorkload, 0> Parameters;
+	int plaintextModulus = Parameters::plain_modulus;
+	double sigma = Parameters::sigma;
 	SecurityLevel securityLevel = HEStd_128_classic;
 	int numAdds = 15;
-	uint32_t depth = 3;
-	usint dcrtBits = 60;
-	usint ringDim = 32768;
+	uint32_t depth = Parameters::key_depth;
+	usint dcrtBits = Parameters::dcrt_bits;
+	usint ringDim = benchmark.config().ring_dimension_or(Parameters::ring_dimension);
 
 	//Create the cryptoContext with the desired parameters
 	CryptoContext<DCRTPoly> cc = CryptoContextFactory<DCRTPoly>::genCryptoContextBFVrns(
@@ -81,11 +94,13 @@ int main(){
 	cc->Enable(ENCRYPTION);
 	cc->Enable(SHE);
 
-	cc_clock = clock() - cc_clock;
+	//Every encoding, encryption and evaluation goes through the profiled context
+	ProfiledCryptoContext<DCRTPoly> he(cc, ops);
+
+	profiler.stop();
 
 	/*****Generate Keys*****/ 
-	clock_t key_clock;
-	key_clock = clock();
+	profiler.start(Phase::KeyGeneration);
 
 	//Create the container for the public key   
 	LPKeyPair<DCRTPoly> keyPair;
@@ -94,167 +109,110 @@ int main(){
 	keyPair = cc->KeyGen();
 
 	//Generate the relinearization key
-	cc->EvalMultKeyGen(keyPair.secretKey);
+	palisade_generate_keys(cc, keyPair, true, false, {}, pool);
 
-	key_clock = clock() - key_clock;
+	profiler.stop();
 
 	/*****Encoding & Encryption*****/
-	clock_t enc_clock;
-	enc_clock = clock();
-
 	//Create and encode the plaintext vectors and variables
-	int N = 8192; 
-	vector<long> BW, BY, BE, BB, HB, HH, HE, NI, 
-				 MV, NW, RP, SL, SN, ST, SH, TH;
+	long N = benchmark.plan_chunks(min<long>(Parameters::batch_size, cc->GetRingDimension()));
+	const int regions = TotalCovidDeathsWorkload::regions;
+	vector<vector<long>> deaths(regions);
 
 	for(int i = 0; i < N; i++){
-		BW.push_back(random_int(0, 50));
-		BY.push_back(random_int(0, 50));
-		BE.push_back(random_int(0, 50));
-		BB.push_back(random_int(0, 50));
-		HB.push_back(random_int(0, 50));
-		HH.push_back(random_int(0, 50));
-		HE.push_back(random_int(0, 50));
-		NI.push_back(random_int(0, 50));
-		MV.push_back(random_int(0, 50));
-		NW.push_back(random_int(0, 50));
-		RP.push_back(random_int(0, 50));
-		SL.push_back(random_int(0, 50));
-		SN.push_back(random_int(0, 50));
-		ST.push_back(random_int(0, 50));
-		SH.push_back(random_int(0, 50));
-		TH.push_back(random_int(0, 50));
+		for(int s = 0; s < regions; s++)
+			deaths[s].push_back(random_int(0, 50));
 	}
 
-	Plaintext plain_BW = cc->MakePackedPlaintext(BW);
-	Plaintext plain_BY = cc->MakePackedPlaintext(BY);
-	Plaintext plain_BE = cc->MakePackedPlaintext(BE);
-	Plaintext plain_BB = cc->MakePackedPlaintext(BB);
-	Plaintext plain_HB = cc->MakePackedPlaintext(HB);
-	Plaintext plain_HH = cc->MakePackedPlaintext(HH);
-	Plaintext plain_HE = cc->MakePackedPlaintext(HE);
-	Plaintext plain_NI = cc->MakePackedPlaintext(NI);
-	Plaintext plain_MV = cc->MakePackedPlaintext(MV);
-	Plaintext plain_NW = cc->MakePackedPlaintext(NW);
-	Plaintext plain_RP = cc->MakePackedPlaintext(RP);
-	Plaintext plain_SL = cc->MakePackedPlaintext(SL);
-	Plaintext plain_SN = cc->MakePackedPlaintext(SN);
-	Plaintext plain_ST = cc->MakePackedPlaintext(ST);
-	Plaintext plain_SH = cc->MakePackedPlaintext(SH);
-	Plaintext plain_TH = cc->MakePackedPlaintext(TH);
-
-	//Encrypt the encodings
-	auto enc_BW = cc->Encrypt(keyPair.publicKey, plain_BW);
-	auto enc_BY = cc->Encrypt(keyPair.publicKey, plain_BY);
-	auto enc_BE = cc->Encrypt(keyPair.publicKey, plain_BE);
-	auto enc_BB = cc->Encrypt(keyPair.publicKey, plain_BB);
-	auto enc_HB = cc->Encrypt(keyPair.publicKey, plain_HB);
-	auto enc_HH = cc->Encrypt(keyPair.publicKey, plain_HH);
-	auto enc_HE = cc->Encrypt(keyPair.publicKey, plain_HE);
-	auto enc_NI = cc->Encrypt(keyPair.publicKey, plain_NI);
-	auto enc_MV = cc->Encrypt(keyPair.publicKey, plain_MV);
-	auto enc_NW = cc->Encrypt(keyPair.publicKey, plain_NW);
-	auto enc_RP = cc->Encrypt(keyPair.publicKey, plain_RP);
-	auto enc_SL = cc->Encrypt(keyPair.publicKey, plain_SL);
-	auto enc_SN = cc->Encrypt(keyPair.publicKey, plain_SN);
-	auto enc_ST = cc->Encrypt(keyPair.publicKey, plain_ST);
-	auto enc_SH = cc->Encrypt(keyPair.publicKey, plain_SH);
-	auto enc_TH = cc->Encrypt(keyPair.publicKey, plain_TH);
-	
-	enc_clock = clock() - enc_clock;
+	//The states are independent, each one is encoded and encrypted on its own thread
+	vector<Plaintext> plain_deaths;
+	vector<Ciphertext<DCRTPoly>> enc_deaths;
+
+	benchmark.run(Phase::Encryption, [&](){
+		plain_deaths = he.MakePackedPlaintexts(deaths, pool);
+		enc_deaths = he.Encrypt(keyPair.publicKey, plain_deaths, pool);
+	});
 
 	/*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
-
-	auto enc_TotalDeaths = cc->EvalAdd(enc_BW, enc_BY);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_BE);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_BB);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_HB);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_HH);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_HE);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_NI);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_MV);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_NW);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_RP);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_SL);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_SN);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_ST);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_SH);
-	enc_TotalDeaths = cc->EvalAdd(enc_TotalDeaths, enc_TH);
-
-	eval_clock = clock() - eval_clock;
+	PalisadeBackend<Scheme::BFV> backend(he);
+	Ciphertext<DCRTPoly> enc_TotalDeaths;
 
-	/*****Decryption*****/
-	clock_t dec_clock;
-	dec_clock = clock();
+	benchmark.run(Phase::Evaluation, [&](){
+		add_all(backend, enc_TotalDeaths, enc_deaths, pool);
+	});
 
+	/*****Decryption*****/
 	Plaintext plain_TotalDeaths;
-	cc->Decrypt(keyPair.secretKey, enc_TotalDeaths, &plain_TotalDeaths);
 
-	dec_clock = clock() - dec_clock;
+	benchmark.run(Phase::Decryption, [&](){
+		he.Decrypt(keyPair.secretKey, enc_TotalDeaths, &plain_TotalDeaths);
+	});
 
 	/*****Print*****/
 	cout << "Starting the total Covid-19 Deaths calculator with " << N << " instances. "<< endl << endl;
+	cout << "Evaluation: " << tree_sum_shape(regions, pool.size()) << endl << endl;
 
-	cout << "Baden-Wuerttemberg: " << endl;
-	print(plain_BW, N);
-
-	cout << "Bavaria: " << endl;
-	print(plain_BY, N);
-
-	cout << "Berlin: " << endl;
-	print(plain_BE, N);
-	
-	cout << "Brandenburg: " << endl;
-	print(plain_BB, N);
-
-	cout << "Bremen: " << endl;
-	print(plain_HB, N);
-	
-	cout << "Hamburg: " << endl;
-	print(plain_HH, N);
-	
-	cout << "Hesse: " << endl;
-	print(plain_HE, N);
-	
-	cout << "Lower Saxony: " << endl;
-	print(plain_NI, N);
-	
-	cout << "Mecklenburg-Vorpommern: " << endl;
-	print(plain_MV, N);
-	
-	cout << "North Rhine-Westphalia: " << endl;
-	print(plain_NW, N);
-	
-	cout << "Rhineland-Palatinate: " << endl;
-	print(plain_RP, N);
-	
-	cout << "Saarland: " << endl;
-	print(plain_SL, N);
-
-	cout << "Saxony: " << endl;
-	print(plain_SN, N);
-	
-	cout << "Saxony-Anhalt: " << endl;
-	print(plain_ST, N);
-	
-	cout << "Schleswig-Holstein: " << endl;
-	print(plain_SH, N);
-	
-	cout << "Thuringia: " << endl;
-	print(plain_TH, N);
+	for(int s = 0; s < regions; s++){
+		cout << COVID_REGION_NAMES[s] << ": " << endl;
+		print(plain_deaths[s], N);
+	}
 	
 	cout << "Total Covid-19 Deaths: " << endl;
 	print(plain_TotalDeaths, N);
 	
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
-
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	/*****Memory*****/
+	memory.track("public key", palisade_bytes(keyPair.publicKey));
+	memory.track("secret key", palisade_bytes(keyPair.secretKey));
+	memory.track("relin keys", palisade_relin_key_bytes<DCRTPoly>());
+	for(const Plaintext& plain : plain_deaths)
+		memory.track("plaintext", palisade_bytes(plain));
+	memory.track("plaintext", palisade_bytes(plain_TotalDeaths));
+	for(const Ciphertext<DCRTPoly>& enc : enc_deaths)
+		memory.track("ciphertext", palisade_bytes(enc));
+	memory.track("ciphertext", palisade_bytes(enc_TotalDeaths));
+
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", palisade_serialize(keyPair.publicKey));
+		footprint.add_key("secret key", palisade_serialize(keyPair.secretKey), false);
+		footprint.add_key("relin keys", palisade_relin_keys_serialized<DCRTPoly>());
+		for(const Ciphertext<DCRTPoly>& enc : enc_deaths)
+			palisade_footprint(footprint, FootprintRole::Input, enc, N);
+		palisade_footprint(footprint, FootprintRole::Result, enc_TotalDeaths, N);
+	}
+
+	summary.ring_dimension = cc->GetRingDimension();
+	summary.slot_count = cc->GetRingDimension();
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
+
+	//Drop the keys and contexts PALISADE caches, the driver runs several calculators in one process
+	CryptoContextImpl<DCRTPoly>::ClearEvalMultKeys();
+	CryptoContextImpl<DCRTPoly>::ClearEvalSumKeys();
+	CryptoContextImpl<DCRTPoly>::ClearEvalAutomorphismKeys();
+	CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
 	return 0;
-}
\ No newline at end of file
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(BFV, PALISADE, TotalCovidDeaths, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
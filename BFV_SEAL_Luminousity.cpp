@@ -11,132 +11,127 @@
 #include <vector>
 #include "seal/seal.h"
 #include "examples.h"
-#include <sys/resource.h>
 #include <unistd.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "seal_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
 
 using namespace std;
 using namespace seal;
 
+namespace {
+
 unsigned long long int random_int(unsigned long long int min, unsigned long long int max){
 	return min + rand() % (max+1 - min);
 }
 
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("BFV_SEAL_Luminousity");
+	Benchmark benchmark(profiler);
+	summary.library_threads = seal_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	memory.set_pool_probe(seal_pool_bytes);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
 	
 	/*****Parameter Generation*****/
-	clock_t cc_clock;
-	cc_clock = clock();
+	profiler.start(Phase::ParameterGeneration);
 
+	typedef SealParameters<Scheme::BFV, LuminousityWorkload> Parameters;
 	EncryptionParameters parms(scheme_type::bfv);
-	size_t poly_modulus_degree = 32768;
+	size_t poly_modulus_degree = benchmark.config().ring_dimension_or(Parameters::ring_dimension);
 	parms.set_poly_modulus_degree(poly_modulus_degree);
-	parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, { 55, 46, 46, 46, 46, 60 }));
-	parms.set_plain_modulus(2147352577);
+	parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, seal_fit_bit_sizes(poly_modulus_degree, Parameters::coeff_modulus_bits)));
+	parms.set_plain_modulus(Parameters::plain_modulus);
 
 	SEALContext context(parms);
 	print_parameters(context);
+	profiler.stop();
 
 	/*****Key & Functions Generation*****/
-	clock_t key_clock;
-	key_clock = clock();
+	profiler.start(Phase::KeyGeneration);
 
 	KeyGenerator keygen(context);
     SecretKey secret_key = keygen.secret_key();
     PublicKey public_key;
-	keygen.create_public_key(public_key);
 	RelinKeys relin_keys;
-    keygen.create_relin_keys(relin_keys);
+	seal_create_keys(keygen, public_key, &relin_keys, pool);
+
+	profiler.stop();
 
-	key_clock = clock() - key_clock;
+	//Evaluator and encoder setup is counted as parameter generation
+	profiler.start(Phase::ParameterGeneration);
 
-	Encryptor encryptor(context, public_key);
-	Evaluator evaluator(context);
-	Decryptor decryptor(context, secret_key);
+	ProfiledEncryptor encryptor(context, public_key, ops);
+	ProfiledEvaluator evaluator(context, ops);
+	ProfiledDecryptor decryptor(context, secret_key, ops);
 
 	//Set up batch encoder
-	BatchEncoder batch_encoder(context);
+	ProfiledBatchEncoder batch_encoder(context, ops);
 	size_t slot_count = batch_encoder.slot_count();
 	size_t row_size = slot_count / 2;
 	
-	cc_clock = clock() - cc_clock - key_clock;
+	profiler.stop();
 	
 	/*****Encoding & Encryption*****/
-	clock_t enc_clock;
-	enc_clock = clock();
-	
 	//Generate the matrices of values 
-	int N = 8192;
+	long N = benchmark.plan_chunks(min<long>(Parameters::batch_size, slot_count));
 	vector<uint64_t> Radius(slot_count, 0ULL);    
 	vector<uint64_t> SurfaceTemperature(slot_count, 0ULL);                	
 
 	for(int r = 0; r < 2; r++){
 		for(int c = 0; c < N/2; c++) {
-			Radius[r*row_size + c] = random_int(9, 81);
-			SurfaceTemperature[r*row_size + c] = random_int(2, 20);
+			Radius[r*row_size + c] = random_int(LuminousityWorkload::min_radius, LuminousityWorkload::max_radius);
+			SurfaceTemperature[r*row_size + c] = random_int(LuminousityWorkload::min_temperature, LuminousityWorkload::max_temperature);
 		}
 	}
-	
+
 	Plaintext plain_radius;
 	Plaintext plain_temperature;
-
-	batch_encoder.encode(Radius, plain_radius);
-	batch_encoder.encode(SurfaceTemperature, plain_temperature);
-
 	Ciphertext enc_radius;
 	Ciphertext enc_temperature;
 
-	encryptor.encrypt(plain_radius, enc_radius);
-	encryptor.encrypt(plain_temperature, enc_temperature);
+	benchmark.run(Phase::Encryption, [&](){
+		batch_encoder.encode(Radius, plain_radius);
+		batch_encoder.encode(SurfaceTemperature, plain_temperature);
 
-	enc_clock = clock() - enc_clock;
+		encryptor.encrypt(plain_radius, enc_radius);
+		encryptor.encrypt(plain_temperature, enc_temperature);
+	});
 
 	/*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
-
-	Ciphertext enc_radiusSquared, enc_temperatureSquared1, enc_temperatureSquared2, enc_temperatureQuadruple;
+	SealBackend<Scheme::BFV> backend(evaluator, relin_keys);
+	Ciphertext enc_radiusSquared, enc_temperatureSquared, enc_temperatureQuadruple;
 	Ciphertext enc_Result;
-	
-	evaluator.square(enc_temperature, enc_temperatureSquared1);
-	evaluator.relinearize_inplace(enc_temperatureSquared1, relin_keys);
-	
-	evaluator.square(enc_temperature, enc_temperatureSquared2);
-	evaluator.relinearize_inplace(enc_temperatureSquared2, relin_keys);
-	
-	evaluator.square(enc_radius, enc_radiusSquared);
-	evaluator.relinearize_inplace(enc_radiusSquared, relin_keys);
-	
-	evaluator.multiply(enc_temperatureSquared1, enc_temperatureSquared2, enc_temperatureQuadruple);
-	evaluator.relinearize_inplace(enc_temperatureQuadruple, relin_keys);
-	
-	evaluator.multiply(enc_radiusSquared, enc_temperatureQuadruple, enc_Result);
-	evaluator.relinearize_inplace(enc_Result, relin_keys);
-	
-	
-	eval_clock = clock() - eval_clock;
 
-	/*****Decryption & Decoding*****/
-	clock_t dec_clock;
-	dec_clock = clock();
+	benchmark.run(Phase::Evaluation, [&](){
+		luminousity(backend, enc_radius, enc_temperature, enc_radiusSquared, enc_temperatureSquared,
+		            enc_temperatureQuadruple, enc_Result, pool);
+	});
 
+	/*****Decryption & Decoding*****/
 	Plaintext plain_Result;
-
-	decryptor.decrypt(enc_Result, plain_Result);
-	
 	vector<uint64_t> result;
-	batch_encoder.decode(plain_Result, result);
-	
-	dec_clock = clock() - dec_clock;
+
+	benchmark.run(Phase::Decryption, [&](){
+		decryptor.decrypt(enc_Result, plain_Result);
+
+		batch_encoder.decode(plain_Result, result);
+	});
 	
 	/*****Print*****/
 	cout << "Starting the ( Luminousity/(4*pi*sigma) ) of a star caluculator with " << N << " instances. "<< endl << endl;
+	cout << "Evaluation plan: " << luminousity_plan(backend.levelled) << endl << endl;
 
 	cout << "Radius: " << endl;
 	print_matrix(Radius, row_size);
@@ -147,13 +142,55 @@ int main(){
 	cout << "Result ( Luminousity/(4*pi*sigma) ): " << endl;
 	print_matrix(result, row_size);
 	
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
-
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	/*****Memory*****/
+	memory.track("public key", seal_bytes(public_key));
+	memory.track("secret key", seal_bytes(secret_key));
+	memory.track("relin keys", seal_bytes(relin_keys));
+	for(const Plaintext* plain : {&plain_radius, &plain_temperature, &plain_Result})
+		memory.track("plaintext", seal_bytes(*plain));
+	for(const Ciphertext* enc : {&enc_radius, &enc_temperature, &enc_radiusSquared, &enc_temperatureSquared,
+			&enc_temperatureQuadruple, &enc_Result})
+		memory.track("ciphertext", seal_bytes(*enc));
+
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", seal_serialize(public_key));
+		footprint.add_key("secret key", seal_serialize(secret_key), false);
+		footprint.add_key("relin keys", seal_serialize(relin_keys));
+		for(const Ciphertext* enc : {&enc_radius, &enc_temperature})
+			seal_footprint(footprint, FootprintRole::Input, *enc, N);
+		for(const Ciphertext* enc : {&enc_radiusSquared, &enc_temperatureSquared, &enc_temperatureQuadruple})
+			seal_footprint(footprint, FootprintRole::Intermediate, *enc, N);
+		seal_footprint(footprint, FootprintRole::Result, enc_Result, N);
+		seal_footprint_chain(footprint, context, evaluator.unwrapped(), enc_radius, N);
+	}
+
+	summary.ring_dimension = poly_modulus_degree;
+	summary.slot_count = slot_count;
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
 	return 0;
-}
\ No newline at end of file
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(BFV, SEAL, Luminousity, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
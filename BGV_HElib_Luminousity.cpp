@@ -10,13 +10,24 @@
 #include <time.h>
 #include <stdlib.h>
 #include <helib/helib.h>
-#include <sys/resource.h>
 #include <unistd.h>
 #include <helib/replicate.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "helib_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
 
 using namespace std;
 using namespace helib;
 
+namespace {
+
 void print(Ptxt<BGV> v, long length){
 	int print_size = 20;
     int end_size = 2;
@@ -61,30 +72,33 @@ int64_t random_int(int64_t min, int64_t max){
    return min + rand() % (max+1 - min);
 }
 
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("BGV_HElib_Luminousity");
+	Benchmark benchmark(profiler);
+	summary.library_threads = helib_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
+	HElibOps he(ops);
 	srand(time(NULL));
 	
 	/*****Set Parameters*****/
-	clock_t cc_clock;
-	cc_clock = clock();
+	profiler.start(Phase::ParameterGeneration);
 	
+	typedef HElibParameters<Scheme::BGV, LuminousityWorkload> Parameters;
 	// Plaintext prime modulus.
-	unsigned long p = 2147352577;
+	unsigned long p = Parameters::plain_modulus;
 	// Cyclotomic polynomial - defines phi(m).
-	unsigned long m = 32768;
+	unsigned long m = 2 * benchmark.config().ring_dimension_or(Parameters::ring_dimension);
 	// Hensel lifting (default = 1).
-	unsigned long r = 1;
+	unsigned long r = Parameters::hensel_lifting;
 	// Number of bits of the modulus chain.
-	unsigned long bits = 299;
+	unsigned long bits = Parameters::modulus_bits;
 	// Number of columns of Key-Switching matrix (typically 2 or 3).
-	unsigned long c = 3;
+	unsigned long c = Parameters::key_switching_columns;
  
 	// Initialize the context.
 	
@@ -98,69 +112,57 @@ int main(){
                                .build();
 							   
 	cout << "Security: " << context.securityLevel() << endl; 
-	cc_clock = clock() - cc_clock;
+	profiler.stop();
 
 	/*****Key Generation*****/
-	clock_t key_clock;
-	key_clock = clock();
+	profiler.start(Phase::KeyGeneration);
 
 	SecKey secret_key(context);
-	secret_key.GenSecKey();
-	addSome1DMatrices(secret_key);
+	helib_generate_keys(secret_key, true, pool);
 	PubKey& public_key = secret_key;
 
 	const EncryptedArray& ea = context.getEA();
 	long num_slots = ea.size();
 	cout << "Number of slots: " << num_slots << endl;
 
-	key_clock = clock() - key_clock;
+	profiler.stop();
 
 	/*****Encryption*****/
-	clock_t enc_clock;
-	enc_clock = clock();
-
 	Ptxt<BGV> Radius(context);
 	Ptxt<BGV> SurfaceTemperature(context);
 	
-	for(int i = 0; i < num_slots/2; i++){
-		Radius[i] = random_int(9, 81);
-		SurfaceTemperature[i] = random_int(2, 20);
+	long N = benchmark.plan_chunks(num_slots/2);
+	for(int i = 0; i < N; i++){
+		Radius[i] = random_int(LuminousityWorkload::min_radius, LuminousityWorkload::max_radius);
+		SurfaceTemperature[i] = random_int(LuminousityWorkload::min_temperature, LuminousityWorkload::max_temperature);
 	}
 
 	Ctxt enc_Radius(public_key);
 	Ctxt enc_SurfaceTemperature(public_key);
-	
-	public_key.Encrypt(enc_Radius, Radius);
-	public_key.Encrypt(enc_SurfaceTemperature, SurfaceTemperature);
-	
-	Ctxt enc_Result(public_key);
-	
-	enc_clock = clock() - enc_clock;
+
+	benchmark.run(Phase::Encryption, [&](){
+		he.Encrypt(public_key, enc_Radius, Radius);
+		he.Encrypt(public_key, enc_SurfaceTemperature, SurfaceTemperature);
+	});
 
 	/*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
-	
-	enc_Result *= 0l;
-	enc_Result += 1l;
-	
-	enc_Radius.multiplyBy(enc_Radius);
-	enc_SurfaceTemperature.multiplyBy(enc_SurfaceTemperature);
-	enc_SurfaceTemperature.multiplyBy(enc_SurfaceTemperature);
-	
-	enc_Result.multiplyBy(enc_Radius);
-	enc_Result.multiplyBy(enc_SurfaceTemperature);
+	HElibBackend backend(he);
+	Ctxt enc_RadiusSquared(public_key);
+	Ctxt enc_TemperatureSquared(public_key);
+	Ctxt enc_TemperatureQuadruple(public_key);
+	Ctxt enc_Result(public_key);
 
-	eval_clock = clock() - eval_clock;
+	benchmark.run(Phase::Evaluation, [&](){
+		luminousity(backend, enc_Radius, enc_SurfaceTemperature, enc_RadiusSquared, enc_TemperatureSquared,
+		            enc_TemperatureQuadruple, enc_Result, pool);
+	});
 
 	/*****Decryption*****/
-	clock_t dec_clock;
-	dec_clock = clock();
-
 	Ptxt<BGV> Result(context);
-	secret_key.Decrypt(Result, enc_Result);
 
-	dec_clock = clock() - dec_clock;
+	benchmark.run(Phase::Decryption, [&](){
+		he.Decrypt(secret_key, Result, enc_Result);
+	});
 
 	/*
 	//Luminousity calculator
@@ -174,6 +176,7 @@ int main(){
 	
 	/*****Print*****/
 	cout << "Starting the ( Luminousity/(4*pi*sigma) ) of a star caluculator with " << num_slots << " instances. "<< endl << endl;
+	cout << "Evaluation plan: " << luminousity_plan(backend.levelled) << endl << endl;
 
 	cout << "Radius: " << endl;
 	print(Radius, num_slots);
@@ -187,13 +190,52 @@ int main(){
 	//cout << "Luminousity: " << endl;
 	//printDouble(Luminousity, num_slots);
 	
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
-
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	/*****Memory*****/
+	memory.track("public key", helib_bytes(public_key));
+	memory.track("secret key", helib_bytes(secret_key));
+	for(const Ptxt<BGV>* plain : {&Radius, &SurfaceTemperature, &Result})
+		memory.track("plaintext", helib_bytes(*plain));
+	for(const Ctxt* enc : {&enc_Radius, &enc_SurfaceTemperature, &enc_RadiusSquared, &enc_TemperatureSquared,
+			&enc_TemperatureQuadruple, &enc_Result})
+		memory.track("ciphertext", helib_bytes(*enc));
+
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", helib_serialize(public_key));
+		footprint.add_key("secret key", helib_serialize(secret_key), false);
+		for(const Ctxt* enc : {&enc_Radius, &enc_SurfaceTemperature})
+			helib_footprint(footprint, FootprintRole::Input, *enc, N);
+		for(const Ctxt* enc : {&enc_RadiusSquared, &enc_TemperatureSquared, &enc_TemperatureQuadruple})
+			helib_footprint(footprint, FootprintRole::Intermediate, *enc, N);
+		helib_footprint(footprint, FootprintRole::Result, enc_Result, N);
+	}
+
+	summary.ring_dimension = m / 2;
+	summary.slot_count = num_slots;
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
 	return 0;
-}
\ No newline at end of file
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(BGV, HElib, Luminousity, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
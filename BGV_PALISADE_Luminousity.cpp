@@ -13,12 +13,23 @@
 #include <fstream>
 #include <random>
 #include <iterator>
-#include <sys/resource.h>
 #include <unistd.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "palisade_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
 
 using namespace std;
 using namespace lbcrypto;
 
+namespace {
+
 int64_t random_int(int64_t min, int64_t max){
 	return min + rand() % (max+1 - min);
 }
@@ -43,29 +54,31 @@ void print(Plaintext v, int length){
     cout << endl;
 }
 
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("BGV_PALISADE_Luminousity");
+	Benchmark benchmark(profiler);
+	summary.library_threads = palisade_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
 	
 	/*****Parameter Generation*****/
-	clock_t cc_clock;
-	cc_clock = clock();
+	profiler.start(Phase::ParameterGeneration);
 	
 	 // Set the main parameters
-	uint32_t depth = 3;
-	int plaintextModulus = 2147352577;
-	double sigma = 3.2;
+	typedef PalisadeParameters<Scheme::BGV, LuminousityWorkload> Parameters;
+	uint32_t depth = Parameters::depth;
+	int plaintextModulus = Parameters::plain_modulus;
+	double sigma = Parameters::sigma;
 	SecurityLevel securityLevel = HEStd_128_classic;
-	usint ringDim = 32768;
-	uint32_t numLargeDigits = 6;
-	usint firstModSize = 55;
-	usint dcrtBits = 60;
-	int batchSize = 8192;
+	usint ringDim = benchmark.config().ring_dimension_or(Parameters::ring_dimension);
+	uint32_t numLargeDigits = Parameters::large_digits;
+	usint firstModSize = Parameters::first_modulus_bits;
+	usint dcrtBits = Parameters::dcrt_bits;
+	int batchSize = min<int>(Parameters::batch_size, ringDim / 2);
 	
 
 	// Instantiate the crypto context
@@ -92,66 +105,59 @@ int main(){
 	cc->Enable(SHE);
 	cc->Enable(LEVELEDSHE);
 
-	cc_clock = clock() - cc_clock;
+	//Every encoding, encryption and evaluation goes through the profiled context
+	ProfiledCryptoContext<DCRTPoly> he(cc, ops);
+
+	profiler.stop();
 
 	/*****Key Generation*****/
-	clock_t key_clock;
-	key_clock = clock();
+	profiler.start(Phase::KeyGeneration);
 
 	LPKeyPair<DCRTPoly> kp = cc->KeyGen();
-	cc->EvalSumKeyGen(kp.secretKey);
-	cc->EvalMultKeyGen(kp.secretKey);
-	long N = 8192;
+	palisade_generate_keys(cc, kp, true, true, {}, pool);
+	long N = benchmark.plan_chunks(batchSize);
 
-	key_clock = clock() - key_clock;
+	profiler.stop();
 
 	/*****Encoding and Encryption*****/
-	clock_t enc_clock;
-	enc_clock = clock();
-	
 	vector<int64_t> Radius;
 	vector<int64_t> SurfaceTemperature;
 	
 	for(int i = 0; i < N; i++){
-		Radius.push_back(random_int(9, 81));
-		SurfaceTemperature.push_back(random_int(2, 20));
+		Radius.push_back(random_int(LuminousityWorkload::min_radius, LuminousityWorkload::max_radius));
+		SurfaceTemperature.push_back(random_int(LuminousityWorkload::min_temperature, LuminousityWorkload::max_temperature));
 	}
-	
-	Plaintext plain_radius = cc->MakePackedPlaintext(Radius);
-	Plaintext plain_temperature = cc->MakePackedPlaintext(SurfaceTemperature);
 
-	//Encrypt the encodings
-	auto enc_radius = cc->Encrypt(kp.publicKey, plain_radius);
-	auto enc_temperature = cc->Encrypt(kp.publicKey, plain_temperature);
-	
-	enc_clock = clock() - enc_clock;
+	Plaintext plain_radius;
+	Plaintext plain_temperature;
+	Ciphertext<DCRTPoly> enc_radius;
+	Ciphertext<DCRTPoly> enc_temperature;
+
+	benchmark.run(Phase::Encryption, [&](){
+		plain_radius = he.MakePackedPlaintext(Radius);
+		plain_temperature = he.MakePackedPlaintext(SurfaceTemperature);
+
+		//Encrypt the encodings
+		enc_radius = he.Encrypt(kp.publicKey, plain_radius);
+		enc_temperature = he.Encrypt(kp.publicKey, plain_temperature);
+	});
 
 	/*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
-	
-	vector<Ciphertext<DCRTPoly>> ciphertexts;
-	
-	ciphertexts.push_back(enc_radius);
-	ciphertexts.push_back(enc_radius);
-	ciphertexts.push_back(enc_temperature);
-	ciphertexts.push_back(enc_temperature);
-	ciphertexts.push_back(enc_temperature);
-	ciphertexts.push_back(enc_temperature);
-	
-	auto enc_Result = cc->EvalMultMany(ciphertexts);
+	PalisadeBackend<Scheme::BGV> backend(he);
+	Ciphertext<DCRTPoly> enc_radiusSquared, enc_temperatureSquared, enc_temperatureQuadruple;
+	Ciphertext<DCRTPoly> enc_Result;
 
-	eval_clock = clock() - eval_clock;
+	benchmark.run(Phase::Evaluation, [&](){
+		luminousity(backend, enc_radius, enc_temperature, enc_radiusSquared, enc_temperatureSquared,
+		            enc_temperatureQuadruple, enc_Result, pool);
+	});
 	
 	/*****Decryption*****/
-	clock_t dec_clock;
-	dec_clock = clock();
-
 	Plaintext plain_Result;
 
-	cc->Decrypt(kp.secretKey, enc_Result, &plain_Result);
-	
-	dec_clock = clock() - dec_clock;
+	benchmark.run(Phase::Decryption, [&](){
+		he.Decrypt(kp.secretKey, enc_Result, &plain_Result);
+	});
 	
 	/*
 	//Luminousity calculator
@@ -165,6 +171,7 @@ int main(){
 	*/
 
 	/*****Print*****/
+	cout << "Evaluation plan: " << luminousity_plan(backend.levelled) << endl << endl;
 	cout << "Radius \n\t" << endl;
 	print(plain_radius, N);
 	
@@ -177,13 +184,62 @@ int main(){
 	//cout << "Luminousity: " << endl;
 	//printDouble(Luminousity, num_slots);
 	
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
-
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	/*****Memory*****/
+	memory.track("public key", palisade_bytes(kp.publicKey));
+	memory.track("secret key", palisade_bytes(kp.secretKey));
+	memory.track("relin keys", palisade_relin_key_bytes<DCRTPoly>());
+	memory.track("rotation keys", palisade_rotation_key_bytes<DCRTPoly>());
+	for(const Plaintext* plain : {&plain_radius, &plain_temperature, &plain_Result})
+		memory.track("plaintext", palisade_bytes(*plain));
+	for(const Ciphertext<DCRTPoly>* enc : {&enc_radius, &enc_temperature, &enc_radiusSquared,
+			&enc_temperatureSquared, &enc_temperatureQuadruple, &enc_Result})
+		memory.track("ciphertext", palisade_bytes(*enc));
+
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", palisade_serialize(kp.publicKey));
+		footprint.add_key("secret key", palisade_serialize(kp.secretKey), false);
+		footprint.add_key("relin keys", palisade_relin_keys_serialized<DCRTPoly>());
+		footprint.add_key("rotation keys", palisade_rotation_keys_serialized<DCRTPoly>());
+		for(const Ciphertext<DCRTPoly>* enc : {&enc_radius, &enc_temperature})
+			palisade_footprint(footprint, FootprintRole::Input, *enc, N);
+		for(const Ciphertext<DCRTPoly>* enc : {&enc_radiusSquared, &enc_temperatureSquared, &enc_temperatureQuadruple})
+			palisade_footprint(footprint, FootprintRole::Intermediate, *enc, N);
+		palisade_footprint(footprint, FootprintRole::Result, enc_Result, N);
+	}
+
+	summary.ring_dimension = cc->GetRingDimension();
+	summary.slot_count = batchSize;
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
+
+	//Drop the keys and contexts PALISADE caches, the driver runs several calculators in one process
+	CryptoContextImpl<DCRTPoly>::ClearEvalMultKeys();
+	CryptoContextImpl<DCRTPoly>::ClearEvalSumKeys();
+	CryptoContextImpl<DCRTPoly>::ClearEvalAutomorphismKeys();
+	CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
 	return 0;
-}
\ No newline at end of file
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(BGV, PALISADE, Luminousity, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
@@ -11,237 +11,179 @@
 #include <vector>
 #include "seal/seal.h"
 #include "examples.h"
-#include <sys/resource.h>
 #include <unistd.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "seal_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
 
 using namespace std;
 using namespace seal;
 
+namespace {
+
 int random_int(int min, int max){
 	return min + rand() % (max+1 - min);
 }
 
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("BGV_SEAL_TotalCovidDeaths");
+	Benchmark benchmark(profiler);
+	summary.library_threads = seal_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	memory.set_pool_probe(seal_pool_bytes);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
 
 	/*****Parameter Generation*****/
-	clock_t cc_clock;
-	cc_clock = clock();
+	profiler.start(Phase::ParameterGeneration);
 
+	typedef SealParameters<Scheme::BGV, TotalCovidDeathsWorkload> Parameters;
 	EncryptionParameters parms(scheme_type::bgv);
-	size_t poly_modulus_degree = 32768;
+	size_t poly_modulus_degree = benchmark.config().ring_dimension_or(Parameters::ring_dimension);
 	parms.set_poly_modulus_degree(poly_modulus_degree);
-	parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, { 55, 46, 46, 46, 46, 60 }));
-	parms.set_plain_modulus(65537);
+	parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, seal_fit_bit_sizes(poly_modulus_degree, Parameters::coeff_modulus_bits)));
+	parms.set_plain_modulus(Parameters::plain_modulus);
 
 	SEALContext context(parms);
 	print_parameters(context);
+	profiler.stop();
 
 	/*****Key & Functions Generation*****/
-	clock_t key_clock;
-	key_clock = clock();
+	profiler.start(Phase::KeyGeneration);
 
 	KeyGenerator keygen(context);
     SecretKey secret_key = keygen.secret_key();
     PublicKey public_key;
-	keygen.create_public_key(public_key);
 	RelinKeys relin_keys;
-    keygen.create_relin_keys(relin_keys);
+	seal_create_keys(keygen, public_key, &relin_keys, pool);
+
+	profiler.stop();
 
-	key_clock = clock() - key_clock;
+	//Evaluator and encoder setup is counted as parameter generation
+	profiler.start(Phase::ParameterGeneration);
 
-	Encryptor encryptor(context, public_key);
-	Evaluator evaluator(context);
-	Decryptor decryptor(context, secret_key);
+	ProfiledEncryptor encryptor(context, public_key, ops);
+	ProfiledEvaluator evaluator(context, ops);
+	ProfiledDecryptor decryptor(context, secret_key, ops);
 
 	//Set up batch encoder
-	BatchEncoder batch_encoder(context);
+	ProfiledBatchEncoder batch_encoder(context, ops);
 	size_t slot_count = batch_encoder.slot_count();
 	cout<< "slot_count: " << slot_count << endl;
 	size_t row_size = slot_count / 2;
 	
-	cc_clock = clock() - cc_clock - key_clock;
+	profiler.stop();
 	
 	/*****Encoding & Encryption*****/	
-	clock_t enc_clock;
-	enc_clock = clock();
-	
 	//Generate the matrices of values 
-	int N = 8192;
-	vector<uint64_t> BW(slot_count, 0ULL), BY(slot_count, 0ULL), BE(slot_count, 0ULL), BB(slot_count, 0ULL),
-									HB(slot_count, 0ULL), HH(slot_count, 0ULL), HE(slot_count, 0ULL), NI(slot_count, 0ULL), 
-										MV(slot_count, 0ULL), NW(slot_count, 0ULL), RP(slot_count, 0ULL), SL(slot_count, 0ULL),
-											SN(slot_count, 0ULL), ST(slot_count, 0ULL), SH(slot_count, 0ULL), TH(slot_count, 0ULL);
-		
+	long N = benchmark.plan_chunks(min<long>(Parameters::batch_size, slot_count));
+	const int regions = TotalCovidDeathsWorkload::regions;
+	vector<vector<uint64_t>> deaths(regions, vector<uint64_t>(slot_count, 0ULL));
+
 	for(int r = 0; r < 2; r++){
 		for(int c = 0; c < N/2; c++) {
-			BW[r*row_size + c] = random_int(0, 50);
-			BY[r*row_size + c] = random_int(0, 50);
-			BE[r*row_size + c] = random_int(0, 50);
-			BB[r*row_size + c] = random_int(0, 50);
-			HB[r*row_size + c] = random_int(0, 50);
-			HH[r*row_size + c] = random_int(0, 50);
-			HE[r*row_size + c] = random_int(0, 50);
-			NI[r*row_size + c] = random_int(0, 50);
-			MV[r*row_size + c] = random_int(0, 50);
-			NW[r*row_size + c] = random_int(0, 50);
-			RP[r*row_size + c] = random_int(0, 50);
-			SL[r*row_size + c] = random_int(0, 50);
-			SN[r*row_size + c] = random_int(0, 50);
-			ST[r*row_size + c] = random_int(0, 50);
-			SH[r*row_size + c] = random_int(0, 50);
-			TH[r*row_size + c] = random_int(0, 50);
+			for(int s = 0; s < regions; s++)
+				deaths[s][r*row_size + c] = random_int(0, 50);
 		}
 	}
-	
-	Plaintext plain_BW, plain_BY, plain_BE, plain_BB, plain_HB, plain_HH, plain_HE, plain_NI,
-			  plain_MV, plain_NW, plain_RP, plain_SL, plain_SN, plain_ST, plain_SH, plain_TH;
-
-	batch_encoder.encode(BW, plain_BW);
-	batch_encoder.encode(BY, plain_BY);
-	batch_encoder.encode(BE, plain_BE);
-	batch_encoder.encode(BB, plain_BB);
-	batch_encoder.encode(HB, plain_HB);
-	batch_encoder.encode(HH, plain_HH);
-	batch_encoder.encode(HE, plain_HE);
-	batch_encoder.encode(NI, plain_NI);
-	batch_encoder.encode(MV, plain_MV);
-	batch_encoder.encode(NW, plain_NW);
-	batch_encoder.encode(RP, plain_RP);
-	batch_encoder.encode(SL, plain_SL);
-	batch_encoder.encode(SN, plain_SN);
-	batch_encoder.encode(ST, plain_ST);
-	batch_encoder.encode(SH, plain_SH);
-	batch_encoder.encode(TH, plain_TH);
-
-	Ciphertext enc_BW, enc_BY, enc_BE, enc_BB, enc_HB, enc_HH, enc_HE, enc_NI,
-			   enc_MV, enc_NW, enc_RP, enc_SL, enc_SN, enc_ST, enc_SH, enc_TH;
-
-	encryptor.encrypt(plain_BW, enc_BW);
-	encryptor.encrypt(plain_BY, enc_BY);
-	encryptor.encrypt(plain_BE, enc_BE);
-	encryptor.encrypt(plain_BB, enc_BB);
-	encryptor.encrypt(plain_HB, enc_HB);
-	encryptor.encrypt(plain_HH, enc_HH);
-	encryptor.encrypt(plain_HE, enc_HE);
-	encryptor.encrypt(plain_NI, enc_NI);
-	encryptor.encrypt(plain_MV, enc_MV);
-	encryptor.encrypt(plain_NW, enc_NW);
-	encryptor.encrypt(plain_RP, enc_RP);
-	encryptor.encrypt(plain_SL, enc_SL);
-	encryptor.encrypt(plain_SN, enc_SN);
-	encryptor.encrypt(plain_ST, enc_ST);
-	encryptor.encrypt(plain_SH, enc_SH);
-	encryptor.encrypt(plain_TH, enc_TH);
-	
-	enc_clock = clock() - enc_clock;
 
-	/*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
+	//The states are independent, each one is encoded and encrypted on its own thread
+	vector<Plaintext> plain_deaths;
+	vector<Ciphertext> enc_deaths;
+
+	benchmark.run(Phase::Encryption, [&](){
+		batch_encoder.encode(deaths, plain_deaths, pool);
+		encryptor.encrypt(plain_deaths, enc_deaths, pool);
+	});
 
+	/*****Evaluation*****/
+	SealBackend<Scheme::BGV> backend(evaluator, relin_keys);
 	Ciphertext enc_TotalDeaths;
-	Plaintext plain_one("1");
-	
-	evaluator.multiply_plain(enc_BW, plain_one, enc_TotalDeaths); // start with TotalDeaths = BW * 1
-	evaluator.add_inplace(enc_TotalDeaths, enc_BY);
-	evaluator.add_inplace(enc_TotalDeaths, enc_BE);
-	evaluator.add_inplace(enc_TotalDeaths, enc_BB);
-	evaluator.add_inplace(enc_TotalDeaths, enc_HB);
-	evaluator.add_inplace(enc_TotalDeaths, enc_HH);
-	evaluator.add_inplace(enc_TotalDeaths, enc_HE);
-	evaluator.add_inplace(enc_TotalDeaths, enc_NI);
-	evaluator.add_inplace(enc_TotalDeaths, enc_MV);
-	evaluator.add_inplace(enc_TotalDeaths, enc_NW);
-	evaluator.add_inplace(enc_TotalDeaths, enc_RP);
-	evaluator.add_inplace(enc_TotalDeaths, enc_SL);
-	evaluator.add_inplace(enc_TotalDeaths, enc_SN);
-	evaluator.add_inplace(enc_TotalDeaths, enc_ST);
-	evaluator.add_inplace(enc_TotalDeaths, enc_SH);
-	evaluator.add_inplace(enc_TotalDeaths, enc_TH);
-	
-	eval_clock = clock() - eval_clock;
 
-	/*****Decryption & Decoding*****/
-	clock_t dec_clock;
-	dec_clock = clock();
+	benchmark.run(Phase::Evaluation, [&](){
+		add_all(backend, enc_TotalDeaths, enc_deaths, pool);
+	});
 
+	/*****Decryption & Decoding*****/
 	Plaintext plain_TotalDeaths;
-
-	decryptor.decrypt(enc_TotalDeaths, plain_TotalDeaths);
-	
 	vector<uint64_t> totalDeaths;
-	batch_encoder.decode(plain_TotalDeaths, totalDeaths);
-	
-	dec_clock = clock() - dec_clock;
-	
-	/*****Print*****/
-	cout << "Starting the total Covid-19 Deaths calculator with " << N << " instances. "<< endl << endl;
 
-	cout << "Baden-Wuerttemberg: " << endl;
-	print_matrix(BW, row_size);
+	benchmark.run(Phase::Decryption, [&](){
+		decryptor.decrypt(enc_TotalDeaths, plain_TotalDeaths);
 
-	cout << "Bavaria: " << endl;
-	print_matrix(BY, row_size);
-
-	cout << "Berlin: " << endl;
-	print_matrix(BE, row_size);
-	
-	cout << "Brandenburg: " << endl;
-	print_matrix(BB, row_size);
-
-	cout << "Bremen: " << endl;
-	print_matrix(HB, row_size);
-	
-	cout << "Hamburg: " << endl;
-	print_matrix(HH, row_size);
-	
-	cout << "Hesse: " << endl;
-	print_matrix(HE, row_size);
-	
-	cout << "Lower Saxony: " << endl;
-	print_matrix(NI, row_size);
+		batch_encoder.decode(plain_TotalDeaths, totalDeaths);
+	});
 	
-	cout << "Mecklenburg-Vorpommern: " << endl;
-	print_matrix(MV, row_size);
-	
-	cout << "North Rhine-Westphalia: " << endl;
-	print_matrix(NW, row_size);
-	
-	cout << "Rhineland-Palatinate: " << endl;
-	print_matrix(RP, row_size);
-	
-	cout << "Saarland: " << endl;
-	print_matrix(SL, row_size);
+	/*****Print*****/
+	cout << "Starting the total Covid-19 Deaths calculator with " << N << " instances. "<< endl << endl;
+	cout << "Evaluation: " << tree_sum_shape(regions, pool.size()) << endl << endl;
 
-	cout << "Saxony: " << endl;
-	print_matrix(SN, row_size);
-	
-	cout << "Saxony-Anhalt: " << endl;
-	print_matrix(ST, row_size);
-	
-	cout << "Schleswig-Holstein: " << endl;
-	print_matrix(SH, row_size);
-	
-	cout << "Thuringia: " << endl;
-	print_matrix(TH, row_size);
+	for(int s = 0; s < regions; s++){
+		cout << COVID_REGION_NAMES[s] << ": " << endl;
+		print_matrix(deaths[s], row_size);
+	}
 	
 	cout << "Total Covid-19 Deaths: " << endl;
 	print_matrix(totalDeaths, row_size);
 
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
+	/*****Memory*****/
+	memory.track("public key", seal_bytes(public_key));
+	memory.track("secret key", seal_bytes(secret_key));
+	memory.track("relin keys", seal_bytes(relin_keys));
+	for(const Plaintext& plain : plain_deaths)
+		memory.track("plaintext", seal_bytes(plain));
+	memory.track("plaintext", seal_bytes(plain_TotalDeaths));
+	for(const Ciphertext& enc : enc_deaths)
+		memory.track("ciphertext", seal_bytes(enc));
+	memory.track("ciphertext", seal_bytes(enc_TotalDeaths));
+
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", seal_serialize(public_key));
+		footprint.add_key("secret key", seal_serialize(secret_key), false);
+		footprint.add_key("relin keys", seal_serialize(relin_keys));
+		for(const Ciphertext& enc : enc_deaths)
+			seal_footprint(footprint, FootprintRole::Input, enc, N);
+		seal_footprint(footprint, FootprintRole::Result, enc_TotalDeaths, N);
+		seal_footprint_chain(footprint, context, evaluator.unwrapped(), enc_deaths[0], N);
+	}
 
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	summary.ring_dimension = poly_modulus_degree;
+	summary.slot_count = slot_count;
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
 	return 0;
-}
\ No newline at end of file
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(BGV, SEAL, TotalCovidDeaths, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
@@ -1,183 +1,230 @@
-/****************************************************************/
-/* HElib CKKS Gross Pay calculator                              */
-/* Author: Majdi Maalej                                         */
-/* Parts of code learned from:                                  */
-/* 01_ckks_basics.cpp                                           */
-/* GrossPay = (NumberofRegularHours * RegularHourlyRate)        */
-/*                +(NumberofOvertimeHours * OvertimeHourlyRate) */
-/****************************************************************/
-#include <iostream>
-#include <vector>
-#include <time.h>
-#include <stdlib.h>
-#include <helib/helib.h>
-#include <sys/resource.h>
-#include <unistd.h>
-
-using namespace std;
-using namespace helib;
-
-void print(vector<double> v, long length){
-    int print_size = 20;
-    int end_size = 2;
-	
-    cout << endl;
-    cout << "    [";
-	
-    for (int i = 0; i < print_size; i++){
-        cout << setw(3) << right << v[i] << ",";
-    }
-
-    cout << setw(3) << " ...,";
-
-    for (int i = length - end_size; i < length; i++){
-        cout << setw(3) << v[i] << ((i != length - 1) ? "," : " ]\n");
-    }
-    
-    cout << endl;
-}
-
-double random_double(double  min, double  max){
-	double f = (double)rand() / RAND_MAX;
-    return min + f * (max - min);
-}
-
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
-	srand(time(NULL));
-	
-	/*****Set Parameters*****/
-	clock_t cc_clock;
-	cc_clock = clock();
-	
-	// Cyclotomic polynomial - defines phi(m).
-	unsigned long m = 32768;
-	// Number of bits of the modulus chain.
-	unsigned long bits = 299;
-	// Number of columns of Key-Switching matrix (typically 2 or 3).
-	unsigned long c = 3;
-	// Number of bits for Precision of of endoded data.
-	unsigned long precision = 40;
- 
-	// Initialize the context.
-	
-	// This object will hold information about the algebra created from the previously set parameters.
-	helib::Context context = helib::ContextBuilder<helib::CKKS>()
-                               .m(m)         //cyclotomic polynomial
-                               .bits(bits)   //number of bits in the modulo chain
-                               .c(c)         //number of columns of Key-Switching matrix (typically 2 or 3).
-							   .precision(precision) // bits of precision
-                               .build();
-							   
-	cout << "Security: " << context.securityLevel() << endl; 
-	cc_clock = clock() - cc_clock;
-
-	/*****Key Generation*****/
-	clock_t key_clock;
-	key_clock = clock();
-
-	SecKey secret_key(context);
-	secret_key.GenSecKey();
-	PubKey& public_key = secret_key;
-
-	long num_slots = context.getNSlots();
-	cout << "Number of slots: " << num_slots << endl; // equal to m/4
-
-	key_clock = clock() - key_clock;
-
-	/*****Encryption*****/
-	clock_t enc_clock;
-	enc_clock = clock();
-
-	vector<double> NumberOfRegularHours;
-	vector<double> RegularHourlyRate;
-	vector<double> NumberOfOvertimeHours;
-	vector<double> OvertimeHourlyRate;
-
-	for(int i = 0; i < num_slots; i++){
-		NumberOfRegularHours.push_back(random_double(40, 192));
-		RegularHourlyRate.push_back(random_double(9, 30));
-		NumberOfOvertimeHours.push_back(random_double(0, 40));
-		OvertimeHourlyRate.push_back(random_double(9, 20));
-	}
-	
-	PtxtArray ptxt_NumberOfRegularHours(context, NumberOfRegularHours);
-	PtxtArray ptxt_RegularHourlyRate(context, RegularHourlyRate);
-	PtxtArray ptxt_NumberOfOvertimeHours(context, NumberOfOvertimeHours);
-	PtxtArray ptxt_OvertimeHourlyRate(context, OvertimeHourlyRate);
-
-	Ctxt enc_NumberOfRegularHours(public_key);
-	Ctxt enc_RegularHourlyRate(public_key);
-	Ctxt enc_NumberOfOvertimeHours(public_key);
-	Ctxt enc_OvertimeHourlyRate(public_key);
-	
-	Ctxt enc_StandardPay(public_key);
-	Ctxt enc_GrossPay(public_key);
-	
-	ptxt_NumberOfRegularHours.encrypt(enc_NumberOfRegularHours);
-	ptxt_RegularHourlyRate.encrypt(enc_RegularHourlyRate);
-	ptxt_NumberOfOvertimeHours.encrypt(enc_NumberOfOvertimeHours);
-	ptxt_OvertimeHourlyRate.encrypt(enc_OvertimeHourlyRate);
-
-	enc_clock = clock() - enc_clock;
-
-	/*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
-
-	enc_StandardPay += enc_NumberOfRegularHours;
-	enc_StandardPay *= enc_RegularHourlyRate;
-	
-	enc_GrossPay += enc_NumberOfOvertimeHours;
-	enc_GrossPay *= enc_OvertimeHourlyRate;
-	
-	enc_GrossPay += enc_StandardPay;
-
-	eval_clock = clock() - eval_clock;
-
-	/*****Decryption*****/
-	clock_t dec_clock;
-	dec_clock = clock();
-	
-	PtxtArray ptxt_Result(context);
-	ptxt_Result.decrypt(enc_GrossPay, secret_key);
-
-	vector<double> GrossPay;
-	ptxt_Result.store(GrossPay);
-
-	dec_clock = clock() - dec_clock;
-	
-	/*****Print*****/
-	cout << "Starting the Gross Pay caluculator with " << num_slots << " instances. "<< endl << endl;
-
-	cout << "NumberOfRegularHours: " << endl;
-	print(NumberOfRegularHours, num_slots);
-
-	cout << "RegularHourlyRate: " << endl;
-	print(RegularHourlyRate, num_slots);
-
-	cout << "NumberOfOvertimeHours: " << endl;
-	print(NumberOfOvertimeHours, num_slots);
-	
-	cout << "OvertimeHourlyRate: " << endl;
-	print(OvertimeHourlyRate, num_slots);
-
-	cout << "GrossPay: " << endl;
-	print(GrossPay, num_slots);
-
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
-	
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
-	return 0;
-}
\ No newline at end of file
+/****************************************************************/
+/* HElib CKKS Gross Pay calculator                              */
+/* Author: Majdi Maalej                                         */
+/* Parts of code learned from:                                  */
+/* 01_ckks_basics.cpp                                           */
+/* GrossPay = (NumberofRegularHours * RegularHourlyRate)        */
+/*                +(NumberofOvertimeHours * OvertimeHourlyRate) */
+/****************************************************************/
+#include <iostream>
+#include <vector>
+#include <time.h>
+#include <stdlib.h>
+#include <helib/helib.h>
+#include <unistd.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "helib_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
+
+using namespace std;
+using namespace helib;
+
+namespace {
+
+void print(vector<double> v, long length){
+    int print_size = 20;
+    int end_size = 2;
+	
+    cout << endl;
+    cout << "    [";
+	
+    for (int i = 0; i < print_size; i++){
+        cout << setw(3) << right << v[i] << ",";
+    }
+
+    cout << setw(3) << " ...,";
+
+    for (int i = length - end_size; i < length; i++){
+        cout << setw(3) << v[i] << ((i != length - 1) ? "," : " ]\n");
+    }
+    
+    cout << endl;
+}
+
+double random_double(double  min, double  max){
+	double f = (double)rand() / RAND_MAX;
+    return min + f * (max - min);
+}
+
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("CKKS_HElib_Gross_Pay");
+	Benchmark benchmark(profiler);
+	summary.library_threads = helib_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
+	HElibOps he(ops);
+	srand(time(NULL));
+	
+	/*****Set Parameters*****/
+	profiler.start(Phase::ParameterGeneration);
+	
+	typedef HElibParameters<Scheme::CKKS, GrossPayWorkload> Parameters;
+	// Cyclotomic polynomial - defines phi(m).
+	unsigned long m = 2 * benchmark.config().ring_dimension_or(Parameters::ring_dimension);
+	// Number of bits of the modulus chain.
+	unsigned long bits = Parameters::modulus_bits;
+	// Number of columns of Key-Switching matrix (typically 2 or 3).
+	unsigned long c = Parameters::key_switching_columns;
+	// Number of bits for Precision of of endoded data.
+	unsigned long precision = Parameters::scale_bits;
+ 
+	// Initialize the context.
+	
+	// This object will hold information about the algebra created from the previously set parameters.
+	helib::Context context = helib::ContextBuilder<helib::CKKS>()
+                               .m(m)         //cyclotomic polynomial
+                               .bits(bits)   //number of bits in the modulo chain
+                               .c(c)         //number of columns of Key-Switching matrix (typically 2 or 3).
+							   .precision(precision) // bits of precision
+                               .build();
+							   
+	cout << "Security: " << context.securityLevel() << endl; 
+	profiler.stop();
+
+	/*****Key Generation*****/
+	profiler.start(Phase::KeyGeneration);
+
+	SecKey secret_key(context);
+	helib_generate_keys(secret_key, false, pool);
+	PubKey& public_key = secret_key;
+
+	long num_slots = context.getNSlots();
+	cout << "Number of slots: " << num_slots << endl; // equal to m/4
+
+	profiler.stop();
+
+	/*****Encryption*****/
+	vector<double> NumberOfRegularHours;
+	vector<double> RegularHourlyRate;
+	vector<double> NumberOfOvertimeHours;
+	vector<double> OvertimeHourlyRate;
+
+	long N = benchmark.plan_chunks(num_slots);
+	for(int i = 0; i < N; i++){
+		NumberOfRegularHours.push_back(random_double(GrossPayWorkload::min_regular_hours, GrossPayWorkload::max_regular_hours));
+		RegularHourlyRate.push_back(random_double(GrossPayWorkload::min_regular_rate, GrossPayWorkload::max_regular_rate));
+		NumberOfOvertimeHours.push_back(random_double(GrossPayWorkload::min_overtime_hours, GrossPayWorkload::max_overtime_hours));
+		OvertimeHourlyRate.push_back(random_double(GrossPayWorkload::min_overtime_rate, GrossPayWorkload::max_overtime_rate));
+	}
+
+	PtxtArray ptxt_NumberOfRegularHours(context);
+	PtxtArray ptxt_RegularHourlyRate(context);
+	PtxtArray ptxt_NumberOfOvertimeHours(context);
+	PtxtArray ptxt_OvertimeHourlyRate(context);
+	Ctxt enc_NumberOfRegularHours(public_key);
+	Ctxt enc_RegularHourlyRate(public_key);
+	Ctxt enc_NumberOfOvertimeHours(public_key);
+	Ctxt enc_OvertimeHourlyRate(public_key);
+
+	benchmark.run(Phase::Encryption, [&](){
+		he.load(ptxt_NumberOfRegularHours, NumberOfRegularHours);
+		he.load(ptxt_RegularHourlyRate, RegularHourlyRate);
+		he.load(ptxt_NumberOfOvertimeHours, NumberOfOvertimeHours);
+		he.load(ptxt_OvertimeHourlyRate, OvertimeHourlyRate);
+
+		he.encrypt(ptxt_NumberOfRegularHours, enc_NumberOfRegularHours);
+		he.encrypt(ptxt_RegularHourlyRate, enc_RegularHourlyRate);
+		he.encrypt(ptxt_NumberOfOvertimeHours, enc_NumberOfOvertimeHours);
+		he.encrypt(ptxt_OvertimeHourlyRate, enc_OvertimeHourlyRate);
+	});
+
+	/*****Evaluation*****/
+	HElibBackend backend(he);
+	Ctxt enc_StandardPay(public_key);
+	Ctxt enc_GrossPay(public_key);
+
+	benchmark.run(Phase::Evaluation, [&](){
+		gross_pay(backend, enc_NumberOfRegularHours, enc_RegularHourlyRate, enc_NumberOfOvertimeHours,
+		          enc_OvertimeHourlyRate, enc_StandardPay, enc_GrossPay, pool);
+	});
+
+	/*****Decryption*****/
+	PtxtArray ptxt_Result(context);
+	vector<double> GrossPay;
+
+	benchmark.run(Phase::Decryption, [&](){
+		he.decrypt(ptxt_Result, enc_GrossPay, secret_key);
+
+		he.store(ptxt_Result, GrossPay);
+	});
+	
+	/*****Print*****/
+	cout << "Starting the Gross Pay caluculator with " << num_slots << " instances. "<< endl << endl;
+	cout << "Evaluation plan: " << gross_pay_plan(backend.levelled) << endl << endl;
+
+	cout << "NumberOfRegularHours: " << endl;
+	print(NumberOfRegularHours, num_slots);
+
+	cout << "RegularHourlyRate: " << endl;
+	print(RegularHourlyRate, num_slots);
+
+	cout << "NumberOfOvertimeHours: " << endl;
+	print(NumberOfOvertimeHours, num_slots);
+	
+	cout << "OvertimeHourlyRate: " << endl;
+	print(OvertimeHourlyRate, num_slots);
+
+	cout << "GrossPay: " << endl;
+	print(GrossPay, num_slots);
+
+	/*****Memory*****/
+	memory.track("public key", helib_bytes(public_key));
+	memory.track("secret key", helib_bytes(secret_key));
+	for(const PtxtArray* plain : {&ptxt_NumberOfRegularHours, &ptxt_RegularHourlyRate,
+			&ptxt_NumberOfOvertimeHours, &ptxt_OvertimeHourlyRate, &ptxt_Result})
+		memory.track("plaintext", helib_bytes(*plain));
+	for(const Ctxt* enc : {&enc_NumberOfRegularHours, &enc_RegularHourlyRate, &enc_NumberOfOvertimeHours,
+			&enc_OvertimeHourlyRate, &enc_StandardPay, &enc_GrossPay})
+		memory.track("ciphertext", helib_bytes(*enc));
+	
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", helib_serialize(public_key));
+		footprint.add_key("secret key", helib_serialize(secret_key), false);
+		for(const Ctxt* enc : {&enc_NumberOfRegularHours, &enc_RegularHourlyRate, &enc_NumberOfOvertimeHours,
+				&enc_OvertimeHourlyRate})
+			helib_footprint(footprint, FootprintRole::Input, *enc, N);
+		helib_footprint(footprint, FootprintRole::Intermediate, enc_StandardPay, N);
+		helib_footprint(footprint, FootprintRole::Result, enc_GrossPay, N);
+	}
+
+	summary.ring_dimension = m / 2;
+	summary.slot_count = num_slots;
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
+	return 0;
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(CKKS, HElib, Gross_Pay, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
@@ -10,12 +10,23 @@
 #include <time.h>
 #include <stdlib.h>
 #include <helib/helib.h>
-#include <sys/resource.h>
 #include <unistd.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "helib_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
 
 using namespace std;
 using namespace helib;
 
+namespace {
+
 void print(vector<double> v, long length){
     int print_size = 20;
     int end_size = 2;
@@ -41,28 +52,31 @@ double random_double(double  min, double  max){
     return min + f * (max - min);
 }
 
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("CKKS_HElib_Luminousity");
+	Benchmark benchmark(profiler);
+	summary.library_threads = helib_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
+	HElibOps he(ops);
 	srand(time(NULL));
 	
 	/*****Set Parameters*****/
-	clock_t cc_clock;
-	cc_clock = clock();
+	profiler.start(Phase::ParameterGeneration);
 	
+	typedef HElibParameters<Scheme::CKKS, LuminousityWorkload> Parameters;
 	// Cyclotomic polynomial - defines phi(m).
-	unsigned long m = 32768; 
+	unsigned long m = 2 * benchmark.config().ring_dimension_or(Parameters::ring_dimension);
 	// Number of bits of the modulus chain.
-	unsigned long bits = 299;
+	unsigned long bits = Parameters::modulus_bits;
 	// Number of columns of Key-Switching matrix (typically 2 or 3).
-	unsigned long c = 3;
+	unsigned long c = Parameters::key_switching_columns;
 	// Number of bits for Precision of of endoded data.
-	unsigned long precision = 40;
+	unsigned long precision = Parameters::scale_bits;
  
 	// Initialize the context.
 	
@@ -75,82 +89,68 @@ int main(){
                                .build();
 							   
 	cout << "Security: " << context.securityLevel() << endl; 
-	cc_clock = clock() - cc_clock;
+	profiler.stop();
 
 	/*****Key Generation*****/
-	clock_t key_clock;
-	key_clock = clock();
+	profiler.start(Phase::KeyGeneration);
 
 	SecKey secret_key(context);
-	secret_key.GenSecKey();
+	helib_generate_keys(secret_key, false, pool);
 	PubKey& public_key = secret_key;
 
 	long num_slots = context.getNSlots();
 	cout << "Number of slots: " << num_slots << endl;
 
-	key_clock = clock() - key_clock;
+	profiler.stop();
 
 	/*****Encryption*****/
-	clock_t enc_clock;
-	enc_clock = clock();
-
 	vector<double> Radius;
 	vector<double> SurfaceTemperature;
 	
-	for(int i = 0; i < num_slots; i++){
-		Radius.push_back(random_double(9, 81));
-		SurfaceTemperature.push_back(random_double(2, 20));
+	long N = benchmark.plan_chunks(num_slots);
+	for(int i = 0; i < N; i++){
+		Radius.push_back(random_double(LuminousityWorkload::min_radius, LuminousityWorkload::max_radius));
+		SurfaceTemperature.push_back(random_double(LuminousityWorkload::min_temperature, LuminousityWorkload::max_temperature));
 	}
-	
-	PtxtArray ptxt_Radius(context, Radius);
-	PtxtArray ptxt_SurfaceTemperature(context, SurfaceTemperature);
 
+	PtxtArray ptxt_Radius(context);
+	PtxtArray ptxt_SurfaceTemperature(context);
 	Ctxt enc_Radius(public_key);
 	Ctxt enc_SurfaceTemperature(public_key);
-	Ctxt enc_Result(public_key);
-	
-	ptxt_Radius.encrypt(enc_Radius);
-	ptxt_SurfaceTemperature.encrypt(enc_SurfaceTemperature);
 
-	enc_clock = clock() - enc_clock;
+	benchmark.run(Phase::Encryption, [&](){
+		he.load(ptxt_Radius, Radius);
+		he.load(ptxt_SurfaceTemperature, SurfaceTemperature);
+
+		he.encrypt(ptxt_Radius, enc_Radius);
+		he.encrypt(ptxt_SurfaceTemperature, enc_SurfaceTemperature);
+	});
 
 	/*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
-
-	PtxtArray ptxt_one(context);
-	ptxt_one *= 0;
-	ptxt_one += 1;
-	PtxtArray ptxt_zero(context);
-	ptxt_zero *= 0;
-	
-	enc_Result *= ptxt_zero;
-	enc_Result += ptxt_one;
-	
-	enc_Result *= enc_Radius;
-	enc_Result *= enc_Radius;
-	
-	enc_Result *= enc_SurfaceTemperature;
-	enc_Result *= enc_SurfaceTemperature;
-	enc_Result *= enc_SurfaceTemperature;
-	enc_Result *= enc_SurfaceTemperature;
+	HElibBackend backend(he);
+	Ctxt enc_RadiusSquared(public_key);
+	Ctxt enc_TemperatureSquared(public_key);
+	Ctxt enc_TemperatureQuadruple(public_key);
+	Ctxt enc_Result(public_key);
 
-	eval_clock = clock() - eval_clock;
+	benchmark.run(Phase::Evaluation, [&](){
+		luminousity(backend, enc_Radius, enc_SurfaceTemperature, enc_RadiusSquared, enc_TemperatureSquared,
+		            enc_TemperatureQuadruple, enc_Result, pool);
+	});
 
 	/*****Decryption*****/
-	clock_t dec_clock;
-	dec_clock = clock();
-	
 	PtxtArray ptxt_Result(context);
-	ptxt_Result.decrypt(enc_Result, secret_key);
-
 	vector<double> Result;
-	ptxt_Result.store(Result);
 
-	dec_clock = clock() - dec_clock;
+	benchmark.run(Phase::Decryption, [&](){
+		he.decrypt(ptxt_Result, enc_Result, secret_key);
+
+		he.store(ptxt_Result, Result);
+	});
 	
 	/*****Print*****/
 	cout << "Starting the ( Luminousity/(4*pi*sigma) ) of a star caluculator with " << num_slots << " instances. "<< endl << endl;
+	cout << "Evaluation plan: " << luminousity_plan(backend.levelled) << endl << endl;
 
 	cout << "Radius: " << endl;
 	print(Radius, num_slots);
@@ -161,13 +161,52 @@ int main(){
 	cout << "Result: " << endl;
 	print(Result, num_slots);
 		
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
-
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	/*****Memory*****/
+	memory.track("public key", helib_bytes(public_key));
+	memory.track("secret key", helib_bytes(secret_key));
+	for(const PtxtArray* plain : {&ptxt_Radius, &ptxt_SurfaceTemperature, &ptxt_Result})
+		memory.track("plaintext", helib_bytes(*plain));
+	for(const Ctxt* enc : {&enc_Radius, &enc_SurfaceTemperature, &enc_RadiusSquared, &enc_TemperatureSquared,
+			&enc_TemperatureQuadruple, &enc_Result})
+		memory.track("ciphertext", helib_bytes(*enc));
+
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", helib_serialize(public_key));
+		footprint.add_key("secret key", helib_serialize(secret_key), false);
+		for(const Ctxt* enc : {&enc_Radius, &enc_SurfaceTemperature})
+			helib_footprint(footprint, FootprintRole::Input, *enc, N);
+		for(const Ctxt* enc : {&enc_RadiusSquared, &enc_TemperatureSquared, &enc_TemperatureQuadruple})
+			helib_footprint(footprint, FootprintRole::Intermediate, *enc, N);
+		helib_footprint(footprint, FootprintRole::Result, enc_Result, N);
+	}
+
+	summary.ring_dimension = m / 2;
+	summary.slot_count = num_slots;
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
 	return 0;
-}
\ No newline at end of file
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(CKKS, HElib, Luminousity, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
@@ -10,12 +10,23 @@
 #include <time.h>
 #include <stdlib.h>
 #include <helib/helib.h>
-#include <sys/resource.h>
 #include <unistd.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "helib_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
 
 using namespace std;
 using namespace helib;
 
+namespace {
+
 void print(vector<long> v, long length){
     int print_size = 20;
     int end_size = 2;
@@ -40,28 +51,31 @@ int random_int(int min, int max){
    return min + rand() % (max+1 - min);
 }
 
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("CKKS_HElib_TotalCovidDeaths");
+	Benchmark benchmark(profiler);
+	summary.library_threads = helib_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
+	HElibOps he(ops);
 	srand(time(NULL));
 	
 	/*****Set Parameters*****/
-	clock_t cc_clock;
-	cc_clock = clock();
+	profiler.start(Phase::ParameterGeneration);
 
+	typedef HElibParameters<Scheme::CKKS, TotalCovidDeathsWorkload> Parameters;
 	// Cyclotomic polynomial - defines phi(m).
-	unsigned long m = 32768;
+	unsigned long m = 2 * benchmark.config().ring_dimension_or(Parameters::ring_dimension);
 	// Number of bits of the modulus chain.
-	unsigned long bits = 299;
+	unsigned long bits = Parameters::modulus_bits;
 	// Number of columns of Key-Switching matrix (typically 2 or 3).
-	unsigned long c = 3;
+	unsigned long c = Parameters::key_switching_columns;
 	// Number of bits for Precision of of endoded data.
-	unsigned long precision = 40;
+	unsigned long precision = Parameters::scale_bits;
  
 	// Initialize the context.
 	
@@ -74,174 +88,114 @@ int main(){
                                .build();
 							   
 	cout << "Security: " << context.securityLevel() << endl; 
-	cc_clock = clock() - cc_clock;
+	profiler.stop();
 
 	/*****Key Generation*****/
-	clock_t key_clock;
-	key_clock = clock();
+	profiler.start(Phase::KeyGeneration);
 
 	SecKey secret_key(context);
-	secret_key.GenSecKey();
+	helib_generate_keys(secret_key, false, pool);
 	PubKey& public_key = secret_key;
 
 	long num_slots = context.getNSlots();
 	std::cout << "Number of slots: " << num_slots << std::endl;
 
-	key_clock = clock() - key_clock;
+	profiler.stop();
 
 	/*****Encryption*****/
-	clock_t enc_clock;
-	enc_clock = clock();
-
-	vector<long> BW, BY, BE, BB, HB, HH, HE, NI, 
-				 MV, NW, RP, SL, SN, ST, SH, TH;
-
-	for(int i = 0; i < num_slots; ++i){
-		BW.push_back(random_int(0, 50));
-		BY.push_back(random_int(0, 50));
-		BE.push_back(random_int(0, 50));
-		BB.push_back(random_int(0, 50));
-		HB.push_back(random_int(0, 50));
-		HH.push_back(random_int(0, 50));
-		HE.push_back(random_int(0, 50));
-		NI.push_back(random_int(0, 50));
-		MV.push_back(random_int(0, 50));
-		NW.push_back(random_int(0, 50));
-		RP.push_back(random_int(0, 50));
-		SL.push_back(random_int(0, 50));
-		SN.push_back(random_int(0, 50));
-		ST.push_back(random_int(0, 50));
-		SH.push_back(random_int(0, 50));
-		TH.push_back(random_int(0, 50));
+	const int regions = TotalCovidDeathsWorkload::regions;
+	vector<vector<long>> deaths(regions);
+
+	long N = benchmark.plan_chunks(num_slots);
+	for(int i = 0; i < N; ++i){
+		for(int s = 0; s < regions; s++)
+			deaths[s].push_back(random_int(0, 50));
 	}
-	
-	PtxtArray ptxt_BW(context, BW), ptxt_BY(context, BY), ptxt_BE(context, BE), ptxt_BB(context, BB), 
-						ptxt_HB(context, HB), ptxt_HH(context, HH), ptxt_HE(context, HE), ptxt_NI(context, NI), 
-							ptxt_MV(context, MV), ptxt_NW(context, NW), ptxt_RP(context, RP), ptxt_SL(context, SL), 
-								ptxt_SN(context, SN), ptxt_ST(context, ST), ptxt_SH(context, SH), ptxt_TH(context, TH);
-	
-	Ctxt enc_BW(public_key), enc_BY(public_key), enc_BE(public_key), enc_BB(public_key), 
-				enc_HB(public_key), enc_HH(public_key), enc_HE(public_key), enc_NI(public_key), 
-					enc_MV(public_key), enc_NW(public_key), enc_RP(public_key), enc_SL(public_key), 
-						enc_SN(public_key), enc_ST(public_key), enc_SH(public_key), enc_TH(public_key);
-	
-	Ctxt enc_TotalDeaths(public_key);
-	
-	ptxt_BW.encrypt(enc_BW);
-	ptxt_BY.encrypt(enc_BY);
-	ptxt_BE.encrypt(enc_BE);
-	ptxt_BB.encrypt(enc_BB);
-	ptxt_HB.encrypt(enc_HB);
-	ptxt_HH.encrypt(enc_HH);
-	ptxt_HE.encrypt(enc_HE);
-	ptxt_NI.encrypt(enc_NI);
-	ptxt_MV.encrypt(enc_MV);
-	ptxt_NW.encrypt(enc_NW);
-	ptxt_RP.encrypt(enc_RP);
-	ptxt_SL.encrypt(enc_SL);
-	ptxt_SN.encrypt(enc_SN);
-	ptxt_ST.encrypt(enc_ST);
-	ptxt_SH.encrypt(enc_SH);
-	ptxt_TH.encrypt(enc_TH);
-
-	enc_clock = clock() - enc_clock;
+
+	//The states are independent, each one is encoded and encrypted on its own thread
+	vector<PtxtArray> ptxt_deaths(regions, PtxtArray(context));
+	vector<Ctxt> enc_deaths(regions, Ctxt(public_key));
+
+	benchmark.run(Phase::Encryption, [&](){
+		he.load(ptxt_deaths, deaths, pool);
+		he.encrypt(ptxt_deaths, enc_deaths, pool);
+	});
 
 	/*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
-
-	enc_TotalDeaths += enc_BW;
-	enc_TotalDeaths += enc_BY;
-	enc_TotalDeaths += enc_BE;
-	enc_TotalDeaths += enc_BB;
-	enc_TotalDeaths += enc_HB;
-	enc_TotalDeaths += enc_HH;
-	enc_TotalDeaths += enc_HE;
-	enc_TotalDeaths += enc_NI;
-	enc_TotalDeaths += enc_MV;
-	enc_TotalDeaths += enc_NW;
-	enc_TotalDeaths += enc_RP;
-	enc_TotalDeaths += enc_SL;
-	enc_TotalDeaths += enc_SN;
-	enc_TotalDeaths += enc_ST;
-	enc_TotalDeaths += enc_SH;
-	enc_TotalDeaths += enc_TH;
-
-	eval_clock = clock() - eval_clock;
+	HElibBackend backend(he);
+	Ctxt enc_TotalDeaths(public_key);
+
+	benchmark.run(Phase::Evaluation, [&](){
+		add_all(backend, enc_TotalDeaths, enc_deaths, pool);
+	});
 
 	/*****Decryption*****/
-	clock_t dec_clock;
-	dec_clock = clock();
-	
 	PtxtArray ptxt_TotalDeaths(context);
-	ptxt_TotalDeaths.decrypt(enc_TotalDeaths, secret_key);
-
 	vector<long> TotalDeaths;
-	ptxt_TotalDeaths.store(TotalDeaths);
 
-	dec_clock = clock() - dec_clock;
+	benchmark.run(Phase::Decryption, [&](){
+		he.decrypt(ptxt_TotalDeaths, enc_TotalDeaths, secret_key);
+
+		he.store(ptxt_TotalDeaths, TotalDeaths);
+	});
 	
 	/*****Print*****/
 	cout << "Starting the total Covid-19 Deaths calculator with " << num_slots << " instances. "<< endl << endl;
+	cout << "Evaluation: " << tree_sum_shape(regions, pool.size()) << endl << endl;
 
-	cout << "Baden-Wuerttemberg: " << endl;
-	print(BW, num_slots);
-
-	cout << "Bavaria: " << endl;
-	print(BY, num_slots);
-
-	cout << "Berlin: " << endl;
-	print(BE, num_slots);
-	
-	cout << "Brandenburg: " << endl;
-	print(BB, num_slots);
-
-	cout << "Bremen: " << endl;
-	print(HB, num_slots);
-	
-	cout << "Hamburg: " << endl;
-	print(HH, num_slots);
-	
-	cout << "Hesse: " << endl;
-	print(HE, num_slots);
-	
-	cout << "Lower Saxony: " << endl;
-	print(NI, num_slots);
-	
-	cout << "Mecklenburg-Vorpommern: " << endl;
-	print(MV, num_slots);
-	
-	cout << "North Rhine-Westphalia: " << endl;
-	print(NW, num_slots);
-	
-	cout << "Rhineland-Palatinate: " << endl;
-	print(RP, num_slots);
-	
-	cout << "Saarland: " << endl;
-	print(SL, num_slots);
-
-	cout << "Saxony: " << endl;
-	print(SN, num_slots);
-	
-	cout << "Saxony-Anhalt: " << endl;
-	print(ST, num_slots);
-	
-	cout << "Schleswig-Holstein: " << endl;
-	print(SH, num_slots);
-	
-	cout << "Thuringia	: " << endl;
-	print(TH, num_slots);
+	for(int s = 0; s < regions; s++){
+		cout << COVID_REGION_NAMES[s] << ": " << endl;
+		print(deaths[s], num_slots);
+	}
 	
 	cout << "Total Covid-19 Deaths	: " << endl;
 	print(TotalDeaths, num_slots);
 	
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
-	
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	/*****Memory*****/
+	memory.track("public key", helib_bytes(public_key));
+	memory.track("secret key", helib_bytes(secret_key));
+	for(const PtxtArray& plain : ptxt_deaths)
+		memory.track("plaintext", helib_bytes(plain));
+	memory.track("plaintext", helib_bytes(ptxt_TotalDeaths));
+	for(const Ctxt& enc : enc_deaths)
+		memory.track("ciphertext", helib_bytes(enc));
+	memory.track("ciphertext", helib_bytes(enc_TotalDeaths));
+	
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", helib_serialize(public_key));
+		footprint.add_key("secret key", helib_serialize(secret_key), false);
+		for(const Ctxt& enc : enc_deaths)
+			helib_footprint(footprint, FootprintRole::Input, enc, N);
+		helib_footprint(footprint, FootprintRole::Result, enc_TotalDeaths, N);
+	}
+
+	summary.ring_dimension = m / 2;
+	summary.slot_count = num_slots;
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
 	return 0;
-}
\ No newline at end of file
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(CKKS, HElib, TotalCovidDeaths, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
@@ -1,180 +1,248 @@
-/****************************************************************/
-/* PALISADE CKKS Gross Pay calculator                           */
-/* Author: Majdi Maalej                                         */
-/* Parts of code learned from:                                  */
-/* demo-simple-real-numbers.cpp                                 */
-/* GrossPay = (NumberofRegularHours * RegularHourlyRate)        */
-/*                +(NumberofOvertimeHours * OvertimeHourlyRate) */
-/****************************************************************/
-#include "palisade.h"
-#include "ciphertext-ser.h"                                                                                                            
-#include "cryptocontext-ser.h"                                                                                                         
-#include "pubkeylp-ser.h"                                                                                                              
-#include "scheme/ckks/ckks-ser.h"                                                                                                      
-#include <iostream>
-#include <vector>
-#include <time.h>
-#include <stdlib.h>
-#include <sys/resource.h>
-#include <unistd.h>
-
-using namespace std;
-using namespace lbcrypto;
-
-void print(Plaintext v, int length){
-    int print_size = 20;
-    int end_size = 2;
-
-    cout << endl;
-    cout << "    [";
-
-    for (int i = 0; i < print_size; i++){
-        cout << setw(3) << right << v->GetCKKSPackedValue()[i].real() << ",";
-    }
-
-    cout << setw(3) << " ...,";
-
-    for (int i = length - end_size; i < length; i++){
-        cout << setw(3) << v->GetCKKSPackedValue()[i].real() << ((i != length - 1) ? "," : " ]\n");
-    }
-    
-    cout << endl;
-}
-
-double random_double(double  min, double  max){
-	double f = (double)rand() / RAND_MAX;
-    return min + f * (max - min);
-}
-
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
-	
-	/*****Parameter Generation*****/
-	clock_t cc_clock;
-	cc_clock = clock();
-
-	uint32_t depth = 3;
-	uint32_t scaleFactorBits = 40;
-	uint32_t batchSize = 8192;
-	SecurityLevel securityLevel = HEStd_128_classic;
-	usint ringDim = 32768;
-	uint32_t numLargeDigits = 6;
-	usint firstModSize = 55;
-
-	CryptoContext<DCRTPoly> cc = CryptoContextFactory<DCRTPoly>::genCryptoContextCKKS(
-																					  depth,
-																					  scaleFactorBits,
-																					  batchSize,
-																					  securityLevel,
-																					  ringDim,
-																					  APPROXRESCALE,
-																					  BV,
-																					  numLargeDigits,
-																					  depth,
-																					  firstModSize,
-																					  0, //relinWindows
-																					  OPTIMIZED);
-
-	cout << "CKKS scheme is using ring dimension " << cc->GetRingDimension() << endl << endl;
-
-	cc->Enable(ENCRYPTION);
-	cc->Enable(SHE);
-	cc->Enable(LEVELEDSHE);
-
-	cc_clock = clock() - cc_clock;
-
-	/*****Key Generation*****/
-	clock_t key_clock;
-	key_clock = clock();
-
-	auto keys = cc->KeyGen();
-	cc->EvalMultKeyGen(keys.secretKey);
-	cc->EvalAtIndexKeyGen(keys.secretKey, { 1, -2 });
-
-	key_clock = clock() - key_clock;
-
-	/*****Encoding & Encryption*****/
-	clock_t enc_clock;
-	enc_clock = clock();
-
-	int N = 8192; 
-	vector<complex<double>> NumberOfRegularHours;
-	vector<complex<double>> RegularHourlyRate;
-	vector<complex<double>> NumberOfOvertimeHours;
-	vector<complex<double>> OvertimeHourlyRate;
-
-	for(int i = 0; i < N; i++){
-		NumberOfRegularHours.push_back(random_double(40,192));
-		RegularHourlyRate.push_back(random_double(9,30));
-		NumberOfOvertimeHours.push_back(random_double(0,40));
-		OvertimeHourlyRate.push_back(random_double(9,20));
-	}
-	
-	Plaintext plain_regular_hours = cc->MakeCKKSPackedPlaintext(NumberOfRegularHours);
-	Plaintext plain_regular_rate = cc->MakeCKKSPackedPlaintext(RegularHourlyRate);
-	Plaintext plain_overtime_hours = cc->MakeCKKSPackedPlaintext(NumberOfOvertimeHours);
-	Plaintext plain_overtime_rate = cc->MakeCKKSPackedPlaintext(OvertimeHourlyRate);
-
-	// Encrypt the encoded vectors
-	auto enc_regular_hours = cc->Encrypt(keys.publicKey, plain_regular_hours);
-	auto enc_regular_rate = cc->Encrypt(keys.publicKey, plain_regular_rate);
-	auto enc_overtime_hours = cc->Encrypt(keys.publicKey, plain_overtime_hours);
-	auto enc_overtime_rate = cc->Encrypt(keys.publicKey, plain_overtime_rate);
-
-	enc_clock = clock() - enc_clock;
-
-	/*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
-
-	auto enc_StandardPay = cc->EvalMult(enc_regular_hours, enc_regular_rate);
-	auto enc_GrossPay = cc->EvalMult(enc_overtime_hours, enc_overtime_rate);
-	enc_GrossPay = cc->EvalAdd(enc_GrossPay, enc_StandardPay);
-
-	eval_clock = clock() - eval_clock;
-
-	/*****Decryption*****/
-	clock_t dec_clock;
-	dec_clock = clock();
-	
-	Plaintext plain_GrossPay;
-	cout.precision(6);
-
-	cc->Decrypt(keys.secretKey, enc_GrossPay, &plain_GrossPay);
-
-	dec_clock = clock() - dec_clock;
-
-	/*****Print*****/
-	cout << "Starting the Gross Pay calculator with " << N << " instances. "<< endl << endl;
-
-	cout << "NumberOfRegularHours: " << endl;
-	print(plain_regular_hours, N);
-
-	cout << "RegularHourlyRate: " << endl;
-	print(plain_regular_rate, N);
-
-	cout << "NumberOfOvertimeHours: " << endl;
-	print(plain_overtime_hours, N);
-	
-	cout << "OvertimeHourlyRate: " << endl;
-	print(plain_overtime_rate, N);
-
-	cout << "GrossPay: " << endl;
-	print(plain_GrossPay, N);
-	
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
-
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
-	return 0;
-}
\ No newline at end of file
+/****************************************************************/
+/* PALISADE CKKS Gross Pay calculator                           */
+/* Author: Majdi Maalej                                         */
+/* Parts of code learned from:                                  */
+/* demo-simple-real-numbers.cpp                                 */
+/* GrossPay = (NumberofRegularHours * RegularHourlyRate)        */
+/*                +(NumberofOvertimeHours * OvertimeHourlyRate) */
+/****************************************************************/
+#include "palisade.h"
+#include "ciphertext-ser.h"                                                                                                            
+#include "cryptocontext-ser.h"                                                                                                         
+#include "pubkeylp-ser.h"                                                                                                              
+#include "scheme/ckks/ckks-ser.h"                                                                                                      
+#include <iostream>
+#include <vector>
+#include <time.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "palisade_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
+
+using namespace std;
+using namespace lbcrypto;
+
+namespace {
+
+void print(Plaintext v, int length){
+    int print_size = 20;
+    int end_size = 2;
+
+    cout << endl;
+    cout << "    [";
+
+    for (int i = 0; i < print_size; i++){
+        cout << setw(3) << right << v->GetCKKSPackedValue()[i].real() << ",";
+    }
+
+    cout << setw(3) << " ...,";
+
+    for (int i = length - end_size; i < length; i++){
+        cout << setw(3) << v->GetCKKSPackedValue()[i].real() << ((i != length - 1) ? "," : " ]\n");
+    }
+    
+    cout << endl;
+}
+
+double random_double(double  min, double  max){
+	double f = (double)rand() / RAND_MAX;
+    return min + f * (max - min);
+}
+
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("CKKS_PALISADE_Gross_Pay");
+	Benchmark benchmark(profiler);
+	summary.library_threads = palisade_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
+	
+	/*****Parameter Generation*****/
+	profiler.start(Phase::ParameterGeneration);
+
+	typedef PalisadeParameters<Scheme::CKKS, GrossPayWorkload> Parameters;
+	uint32_t depth = Parameters::depth;
+	uint32_t scaleFactorBits = Parameters::scale_bits;
+	SecurityLevel securityLevel = HEStd_128_classic;
+	usint ringDim = benchmark.config().ring_dimension_or(Parameters::ring_dimension);
+	uint32_t batchSize = min<uint32_t>(Parameters::batch_size, ringDim / 2);
+	uint32_t numLargeDigits = Parameters::large_digits;
+	usint firstModSize = Parameters::first_modulus_bits;
+
+	CryptoContext<DCRTPoly> cc = CryptoContextFactory<DCRTPoly>::genCryptoContextCKKS(
+																					  depth,
+																					  scaleFactorBits,
+																					  batchSize,
+																					  securityLevel,
+																					  ringDim,
+																					  APPROXRESCALE,
+																					  BV,
+																					  numLargeDigits,
+																					  depth,
+																					  firstModSize,
+																					  0, //relinWindows
+																					  OPTIMIZED);
+
+	cout << "CKKS scheme is using ring dimension " << cc->GetRingDimension() << endl << endl;
+
+	cc->Enable(ENCRYPTION);
+	cc->Enable(SHE);
+	cc->Enable(LEVELEDSHE);
+
+	//Every encoding, encryption and evaluation goes through the profiled context
+	ProfiledCryptoContext<DCRTPoly> he(cc, ops);
+
+	profiler.stop();
+
+	/*****Key Generation*****/
+	profiler.start(Phase::KeyGeneration);
+
+	auto keys = cc->KeyGen();
+	palisade_generate_keys(cc, keys, true, false, { 1, -2 }, pool);
+
+	profiler.stop();
+
+	/*****Encoding & Encryption*****/
+	long N = benchmark.plan_chunks(batchSize);
+	vector<complex<double>> NumberOfRegularHours;
+	vector<complex<double>> RegularHourlyRate;
+	vector<complex<double>> NumberOfOvertimeHours;
+	vector<complex<double>> OvertimeHourlyRate;
+
+	for(int i = 0; i < N; i++){
+		NumberOfRegularHours.push_back(random_double(GrossPayWorkload::min_regular_hours, GrossPayWorkload::max_regular_hours));
+		RegularHourlyRate.push_back(random_double(GrossPayWorkload::min_regular_rate, GrossPayWorkload::max_regular_rate));
+		NumberOfOvertimeHours.push_back(random_double(GrossPayWorkload::min_overtime_hours, GrossPayWorkload::max_overtime_hours));
+		OvertimeHourlyRate.push_back(random_double(GrossPayWorkload::min_overtime_rate, GrossPayWorkload::max_overtime_rate));
+	}
+
+	Plaintext plain_regular_hours;
+	Plaintext plain_regular_rate;
+	Plaintext plain_overtime_hours;
+	Plaintext plain_overtime_rate;
+	Ciphertext<DCRTPoly> enc_regular_hours;
+	Ciphertext<DCRTPoly> enc_regular_rate;
+	Ciphertext<DCRTPoly> enc_overtime_hours;
+	Ciphertext<DCRTPoly> enc_overtime_rate;
+
+	benchmark.run(Phase::Encryption, [&](){
+		plain_regular_hours = he.MakeCKKSPackedPlaintext(NumberOfRegularHours);
+		plain_regular_rate = he.MakeCKKSPackedPlaintext(RegularHourlyRate);
+		plain_overtime_hours = he.MakeCKKSPackedPlaintext(NumberOfOvertimeHours);
+		plain_overtime_rate = he.MakeCKKSPackedPlaintext(OvertimeHourlyRate);
+
+		// Encrypt the encoded vectors
+		enc_regular_hours = he.Encrypt(keys.publicKey, plain_regular_hours);
+		enc_regular_rate = he.Encrypt(keys.publicKey, plain_regular_rate);
+		enc_overtime_hours = he.Encrypt(keys.publicKey, plain_overtime_hours);
+		enc_overtime_rate = he.Encrypt(keys.publicKey, plain_overtime_rate);
+	});
+
+	/*****Evaluation*****/
+	PalisadeBackend<Scheme::CKKS> backend(he);
+	Ciphertext<DCRTPoly> enc_StandardPay;
+	Ciphertext<DCRTPoly> enc_GrossPay;
+
+	benchmark.run(Phase::Evaluation, [&](){
+		gross_pay(backend, enc_regular_hours, enc_regular_rate, enc_overtime_hours, enc_overtime_rate,
+		          enc_StandardPay, enc_GrossPay, pool);
+	});
+
+	/*****Decryption*****/
+	Plaintext plain_GrossPay;
+	cout.precision(6);
+
+	benchmark.run(Phase::Decryption, [&](){
+		he.Decrypt(keys.secretKey, enc_GrossPay, &plain_GrossPay);
+	});
+
+	/*****Print*****/
+	cout << "Starting the Gross Pay calculator with " << N << " instances. "<< endl << endl;
+	cout << "Evaluation plan: " << gross_pay_plan(backend.levelled) << endl << endl;
+
+	cout << "NumberOfRegularHours: " << endl;
+	print(plain_regular_hours, N);
+
+	cout << "RegularHourlyRate: " << endl;
+	print(plain_regular_rate, N);
+
+	cout << "NumberOfOvertimeHours: " << endl;
+	print(plain_overtime_hours, N);
+	
+	cout << "OvertimeHourlyRate: " << endl;
+	print(plain_overtime_rate, N);
+
+	cout << "GrossPay: " << endl;
+	print(plain_GrossPay, N);
+	
+	/*****Memory*****/
+	memory.track("public key", palisade_bytes(keys.publicKey));
+	memory.track("secret key", palisade_bytes(keys.secretKey));
+	memory.track("relin keys", palisade_relin_key_bytes<DCRTPoly>());
+	memory.track("rotation keys", palisade_rotation_key_bytes<DCRTPoly>());
+	for(const Plaintext* plain : {&plain_regular_hours, &plain_regular_rate, &plain_overtime_hours,
+			&plain_overtime_rate, &plain_GrossPay})
+		memory.track("plaintext", palisade_bytes(*plain));
+	for(const Ciphertext<DCRTPoly>* enc : {&enc_regular_hours, &enc_regular_rate, &enc_overtime_hours,
+			&enc_overtime_rate, &enc_StandardPay, &enc_GrossPay})
+		memory.track("ciphertext", palisade_bytes(*enc));
+
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", palisade_serialize(keys.publicKey));
+		footprint.add_key("secret key", palisade_serialize(keys.secretKey), false);
+		footprint.add_key("relin keys", palisade_relin_keys_serialized<DCRTPoly>());
+		footprint.add_key("rotation keys", palisade_rotation_keys_serialized<DCRTPoly>());
+		for(const Ciphertext<DCRTPoly>* enc : {&enc_regular_hours, &enc_regular_rate, &enc_overtime_hours,
+				&enc_overtime_rate})
+			palisade_footprint(footprint, FootprintRole::Input, *enc, N);
+		palisade_footprint(footprint, FootprintRole::Intermediate, enc_StandardPay, N);
+		palisade_footprint(footprint, FootprintRole::Result, enc_GrossPay, N);
+	}
+
+	summary.ring_dimension = cc->GetRingDimension();
+	summary.slot_count = batchSize;
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
+
+	//Drop the keys and contexts PALISADE caches, the driver runs several calculators in one process
+	CryptoContextImpl<DCRTPoly>::ClearEvalMultKeys();
+	CryptoContextImpl<DCRTPoly>::ClearEvalSumKeys();
+	CryptoContextImpl<DCRTPoly>::ClearEvalAutomorphismKeys();
+	CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
+	return 0;
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(CKKS, PALISADE, Gross_Pay, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
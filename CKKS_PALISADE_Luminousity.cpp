@@ -14,12 +14,23 @@
 #include <vector>
 #include <time.h>
 #include <stdlib.h>
-#include <sys/resource.h>
 #include <unistd.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "palisade_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
 
 using namespace std;
 using namespace lbcrypto;
 
+namespace {
+
 void print(Plaintext v, int length){
     int print_size = 20;
     int end_size = 2;
@@ -65,27 +76,29 @@ double random_double(double  min, double  max){
     return min + f * (max - min);
 }
 
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("CKKS_PALISADE_Luminousity");
+	Benchmark benchmark(profiler);
+	summary.library_threads = palisade_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
 	
 	/*****Parameter Generation*****/
-	clock_t cc_clock;
-	cc_clock = clock();
+	profiler.start(Phase::ParameterGeneration);
 
-	uint32_t multiplicativeDepth = 6;
-	uint32_t maxDepth = 3;
-	uint32_t scaleFactorBits = 40;
-	uint32_t batchSize = 8192;
+	typedef PalisadeParameters<Scheme::CKKS, LuminousityWorkload, 6> Parameters;
+	uint32_t multiplicativeDepth = Parameters::depth;
+	uint32_t maxDepth = Parameters::key_depth;
+	uint32_t scaleFactorBits = Parameters::scale_bits;
 	SecurityLevel securityLevel = HEStd_128_classic;
-	usint ringDim = 32768;
-	uint32_t numLargeDigits = 6;
-	usint firstModSize = 55;
+	usint ringDim = benchmark.config().ring_dimension_or(Parameters::ring_dimension);
+	uint32_t batchSize = min<uint32_t>(Parameters::batch_size, ringDim / 2);
+	uint32_t numLargeDigits = Parameters::large_digits;
+	usint firstModSize = Parameters::first_modulus_bits;
 
 	CryptoContext<DCRTPoly> cc = CryptoContextFactory<DCRTPoly>::genCryptoContextCKKS(
 																					  multiplicativeDepth,
@@ -107,67 +120,60 @@ int main(){
 	cc->Enable(SHE);
 	cc->Enable(LEVELEDSHE);
 
-	cc_clock = clock() - cc_clock;
+	//Every encoding, encryption and evaluation goes through the profiled context
+	ProfiledCryptoContext<DCRTPoly> he(cc, ops);
+
+	profiler.stop();
 
 	/*****Key Generation*****/
-	clock_t key_clock;
-	key_clock = clock();
+	profiler.start(Phase::KeyGeneration);
 
 	auto keys = cc->KeyGen();
-	cc->EvalMultKeyGen(keys.secretKey);
-	cc->EvalAtIndexKeyGen(keys.secretKey, { 1, -2 });
+	palisade_generate_keys(cc, keys, true, false, { 1, -2 }, pool);
 
-	key_clock = clock() - key_clock;
+	profiler.stop();
 
 	/*****Encoding & Encryption*****/
-	clock_t enc_clock;
-	enc_clock = clock();
-
-	int N = 8192; 
+	long N = benchmark.plan_chunks(batchSize);
 	vector<complex<double>> Radius; 
 	vector<complex<double>> SurfaceTemperature; 
 
 	for(int i = 0; i < N; i++){
-		Radius.push_back(random_double(9, 81));
-		SurfaceTemperature.push_back(random_double(2, 20));
+		Radius.push_back(random_double(LuminousityWorkload::min_radius, LuminousityWorkload::max_radius));
+		SurfaceTemperature.push_back(random_double(LuminousityWorkload::min_temperature, LuminousityWorkload::max_temperature));
 	}
 
-	Plaintext plain_radius = cc->MakeCKKSPackedPlaintext(Radius);
-	Plaintext plain_temperature = cc->MakeCKKSPackedPlaintext(SurfaceTemperature);
+	Plaintext plain_radius;
+	Plaintext plain_temperature;
+	Ciphertext<DCRTPoly> enc_radius;
+	Ciphertext<DCRTPoly> enc_temperature;
 
-	// Encrypt the encoded vectors
-	auto enc_radius = cc->Encrypt(keys.publicKey, plain_radius);
-	auto enc_temperature = cc->Encrypt(keys.publicKey, plain_temperature);
+	benchmark.run(Phase::Encryption, [&](){
+		plain_radius = he.MakeCKKSPackedPlaintext(Radius);
+		plain_temperature = he.MakeCKKSPackedPlaintext(SurfaceTemperature);
 
-	enc_clock = clock() - enc_clock;
+		// Encrypt the encoded vectors
+		enc_radius = he.Encrypt(keys.publicKey, plain_radius);
+		enc_temperature = he.Encrypt(keys.publicKey, plain_temperature);
+	});
 
 	/*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
+	PalisadeBackend<Scheme::CKKS> backend(he);
+	Ciphertext<DCRTPoly> enc_radiusSquared, enc_temperatureSquared, enc_temperatureQuadruple;
+	Ciphertext<DCRTPoly> enc_Result;
 
-	vector<Ciphertext<DCRTPoly>> ciphertexts;
-	
-	ciphertexts.push_back(enc_radius);
-	ciphertexts.push_back(enc_radius);
-	ciphertexts.push_back(enc_temperature);
-	ciphertexts.push_back(enc_temperature);
-	ciphertexts.push_back(enc_temperature);
-	ciphertexts.push_back(enc_temperature);
-	
-	auto enc_Result = cc->EvalMultMany(ciphertexts);
-
-	eval_clock = clock() - eval_clock;
+	benchmark.run(Phase::Evaluation, [&](){
+		luminousity(backend, enc_radius, enc_temperature, enc_radiusSquared, enc_temperatureSquared,
+		            enc_temperatureQuadruple, enc_Result, pool);
+	});
 
 	/*****Decryption*****/
-	clock_t dec_clock;
-	dec_clock = clock();
-	
 	Plaintext plain_Result;
 	cout.precision(6);
 
-	cc->Decrypt(keys.secretKey, enc_Result, &plain_Result);
-
-	dec_clock = clock() - dec_clock;
+	benchmark.run(Phase::Decryption, [&](){
+		he.Decrypt(keys.secretKey, enc_Result, &plain_Result);
+	});
 	
 	/*
 	//Luminousity calculator
@@ -182,6 +188,7 @@ int main(){
 
 	/*****Print*****/
 	cout << "Starting the ( Luminousity/(4*pi*sigma) ) of a star caluculator with " << N << " instances. "<< endl << endl;
+	cout << "Evaluation plan: " << luminousity_plan(backend.levelled) << endl << endl;
 
 	cout << "Radius: " << endl;
 	print(plain_radius, N);
@@ -195,13 +202,62 @@ int main(){
 	//cout << "Luminousity: " << endl;
 	//printDouble(Luminousity, num_slots);
 	
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
-
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
+	/*****Memory*****/
+	memory.track("public key", palisade_bytes(keys.publicKey));
+	memory.track("secret key", palisade_bytes(keys.secretKey));
+	memory.track("relin keys", palisade_relin_key_bytes<DCRTPoly>());
+	memory.track("rotation keys", palisade_rotation_key_bytes<DCRTPoly>());
+	for(const Plaintext* plain : {&plain_radius, &plain_temperature, &plain_Result})
+		memory.track("plaintext", palisade_bytes(*plain));
+	for(const Ciphertext<DCRTPoly>* enc : {&enc_radius, &enc_temperature, &enc_radiusSquared,
+			&enc_temperatureSquared, &enc_temperatureQuadruple, &enc_Result})
+		memory.track("ciphertext", palisade_bytes(*enc));
+
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", palisade_serialize(keys.publicKey));
+		footprint.add_key("secret key", palisade_serialize(keys.secretKey), false);
+		footprint.add_key("relin keys", palisade_relin_keys_serialized<DCRTPoly>());
+		footprint.add_key("rotation keys", palisade_rotation_keys_serialized<DCRTPoly>());
+		for(const Ciphertext<DCRTPoly>* enc : {&enc_radius, &enc_temperature})
+			palisade_footprint(footprint, FootprintRole::Input, *enc, N);
+		for(const Ciphertext<DCRTPoly>* enc : {&enc_radiusSquared, &enc_temperatureSquared, &enc_temperatureQuadruple})
+			palisade_footprint(footprint, FootprintRole::Intermediate, *enc, N);
+		palisade_footprint(footprint, FootprintRole::Result, enc_Result, N);
+	}
+
+	summary.ring_dimension = cc->GetRingDimension();
+	summary.slot_count = batchSize;
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
+
+	//Drop the keys and contexts PALISADE caches, the driver runs several calculators in one process
+	CryptoContextImpl<DCRTPoly>::ClearEvalMultKeys();
+	CryptoContextImpl<DCRTPoly>::ClearEvalSumKeys();
+	CryptoContextImpl<DCRTPoly>::ClearEvalAutomorphismKeys();
+	CryptoContextFactory<DCRTPoly>::ReleaseAllContexts();
 	return 0;
-}
\ No newline at end of file
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(CKKS, PALISADE, Luminousity, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
@@ -1,164 +1,202 @@
-/****************************************************************/
-/* SEAL CKKS Gross Pay calculator                               */
-/* Author: Majdi Maalej                                         */
-/* Parts of code learned from:                                  */
-/* 4_CKKS_basics.cpp                                            */
-/* GrossPay = (NumberofRegularHours * RegularHourlyRate)        */
-/*                +(NumberofOvertimeHours * OvertimeHourlyRate) */
-/****************************************************************/
-#include <iostream>
-#include <time.h>
-#include <stdlib.h>
-#include <vector>
-#include "seal/seal.h"
-#include "examples.h"
-#include <sys/resource.h>
-#include <unistd.h>
-
-using namespace std;
-using namespace seal;
-
-double random_double(double  min, double  max){
-	double f = (double)rand() / RAND_MAX;
-    return min + f * (max - min);
-}
-
-long get_mem_usage(){
-	struct rusage myUsage;
-	getrusage(RUSAGE_SELF, &myUsage);
-	return myUsage.ru_maxrss;
-}
-
-int main(){
-	long baseline = get_mem_usage();
-	
-	/*****Parameter Generation*****/
-	clock_t cc_clock;
-	cc_clock = clock();
-
-	EncryptionParameters parms(scheme_type::ckks);
-	size_t poly_modulus_degree = 32768;
-    parms.set_poly_modulus_degree(poly_modulus_degree);
-    parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, { 55, 46, 46, 46, 46, 60 }));
-	double scale = pow(2.0, 40);
-
-	SEALContext context(parms);
-	print_parameters(context);
-
-	/*****Key Generation*****/
-	clock_t key_clock;
-	key_clock = clock();
-
-    KeyGenerator keygen(context);
-	PublicKey public_key;
-	keygen.create_public_key(public_key);
-	RelinKeys relin_keys;
-    keygen.create_relin_keys(relin_keys);
-    auto secret_key = keygen.secret_key();
-
-    Encryptor encryptor(context, public_key);
-    Evaluator evaluator(context);
-    Decryptor decryptor(context, secret_key);
-	
-    CKKSEncoder encoder(context);
-    size_t slot_count = encoder.slot_count();
-    cout << "Number of slots: " << slot_count << endl;
-	
-	cc_clock = clock() - cc_clock - key_clock;
-
-	/*****Encoding & Encryption*****/
-	clock_t enc_clock;
-	enc_clock = clock();
-
-    int N = 8192; 
-	vector<double> NumberOfRegularHours; 
-	vector<double> RegularHourlyRate; 
-	vector<double> NumberOfOvertimeHours; 
-	vector<double> OvertimeHourlyRate;   	
-
-	for(int i = 0; i < N; i++){
-		NumberOfRegularHours.push_back(random_double(40,192));
-		RegularHourlyRate.push_back(random_double(9,30));
-		NumberOfOvertimeHours.push_back(random_double(0,40));
-		OvertimeHourlyRate.push_back(random_double(9,20));
-	}
-	
-    Plaintext plain_regular_hours, plain_regular_rate, plain_overtime_hours, plain_overtime_rate;
-	
-    encoder.encode(NumberOfRegularHours, scale, plain_regular_hours);
-    encoder.encode(RegularHourlyRate, scale, plain_regular_rate);
-    encoder.encode(NumberOfOvertimeHours, scale, plain_overtime_hours);
-	encoder.encode(OvertimeHourlyRate, scale, plain_overtime_rate);
-
-    Ciphertext enc_regular_hours, enc_regular_rate, enc_overtime_hours, enc_overtime_rate;
-	
-    encryptor.encrypt(plain_regular_hours, enc_regular_hours);
-	encryptor.encrypt(plain_regular_rate, enc_regular_rate);
-	encryptor.encrypt(plain_overtime_hours, enc_overtime_hours);
-	encryptor.encrypt(plain_overtime_rate, enc_overtime_rate);
-
-	enc_clock = clock() - enc_clock;
-
-    /*****Evaluation*****/
-	clock_t eval_clock;
-	eval_clock = clock();
-
-    Ciphertext enc_StandardPay;
-	Ciphertext enc_GrossPay;
-	Ciphertext enc_OvertimePay;
-
-    evaluator.multiply(enc_regular_hours, enc_regular_rate, enc_StandardPay);
-	evaluator.relinearize_inplace(enc_StandardPay, relin_keys);
-	evaluator.rescale_to_next_inplace(enc_StandardPay);
-
-	evaluator.multiply(enc_overtime_hours, enc_overtime_rate, enc_OvertimePay);
-	evaluator.relinearize_inplace(enc_OvertimePay, relin_keys);
-	evaluator.rescale_to_next_inplace(enc_OvertimePay);
-
-	parms_id_type last_parms_id = enc_StandardPay.parms_id();
-	evaluator.mod_switch_to_inplace(enc_OvertimePay, last_parms_id);
-
-	evaluator.add(enc_StandardPay, enc_OvertimePay, enc_GrossPay);
-
-	eval_clock = clock() - eval_clock;
-
-	/*****Decryption & Decoding*****/
-	clock_t dec_clock;
-	dec_clock = clock();
-
-	Plaintext plain_GrossPay;
-	decryptor.decrypt(enc_GrossPay, plain_GrossPay);
-	
-	vector<double> grossPay;
-	encoder.decode(plain_GrossPay, grossPay);
-
-	dec_clock = clock() - dec_clock;
-
-	/*****Print*****/
-	cout << "Starting the Gross Pay calculator with " << N << " instances. "<< endl << endl;
-	
-	cout << "NumberOfRegularHours: " << endl;
-	print_vector(NumberOfRegularHours, 10, 4);
-
-	cout << "RegularHourlyRate: " << endl;
-	print_vector(RegularHourlyRate, 10, 4);
-
-	cout << "NumberOfOvertimeHours: " << endl;
-	print_vector(NumberOfOvertimeHours, 10, 4);
-	
-	cout << "OvertimeHourlyRate: " << endl;
-	print_vector(OvertimeHourlyRate, 10, 4);
-
-	cout << "GrossPay: " << endl;
-	print_vector(grossPay, 10, 4);
-	
-	cout<< "Memory Usage: " << get_mem_usage() - baseline << endl;
-
-	cout << "Times:" <<endl;
-	cout << "Parameter Generation  : " << ((float)cc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Key Generation        : " << ((float)key_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Encryption            : " << ((float)enc_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Evaluation            : " << ((float)eval_clock)/CLOCKS_PER_SEC << endl;
-	cout << "Decryption            : " << ((float)dec_clock)/CLOCKS_PER_SEC << endl;
-	return 0;
-}
\ No newline at end of file
+/****************************************************************/
+/* SEAL CKKS Gross Pay calculator                               */
+/* Author: Majdi Maalej                                         */
+/* Parts of code learned from:                                  */
+/* 4_CKKS_basics.cpp                                            */
+/* GrossPay = (NumberofRegularHours * RegularHourlyRate)        */
+/*                +(NumberofOvertimeHours * OvertimeHourlyRate) */
+/****************************************************************/
+#include <iostream>
+#include <time.h>
+#include <stdlib.h>
+#include <vector>
+#include "seal/seal.h"
+#include "examples.h"
+#include <unistd.h>
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "perf_counters.h"
+#include "alloc_profiler.h"
+#include "footprint.h"
+#include "benchmark_registry.h"
+#include "seal_ops.h"
+#include "thread_pool.h"
+#include "workloads.h"
+
+using namespace std;
+using namespace seal;
+
+namespace {
+
+double random_double(double  min, double  max){
+	double f = (double)rand() / RAND_MAX;
+    return min + f * (max - min);
+}
+
+int run(BenchmarkResult& summary){
+	PhaseProfiler profiler("CKKS_SEAL_Gross_Pay");
+	Benchmark benchmark(profiler);
+	summary.library_threads = seal_set_threads(benchmark.config().library_threads());
+	ThreadPool pool(benchmark.config().pool_size(), benchmark.config().pin);
+	OpProfiler ops(profiler);
+	MemoryProfiler memory(profiler);
+	memory.set_pool_probe(seal_pool_bytes);
+	PerfCounters counters(profiler, ops);
+	AllocProfiler allocations(profiler);
+	Footprint footprint(profiler);
+	
+	/*****Parameter Generation*****/
+	profiler.start(Phase::ParameterGeneration);
+
+	typedef SealParameters<Scheme::CKKS, GrossPayWorkload> Parameters;
+	EncryptionParameters parms(scheme_type::ckks);
+	size_t poly_modulus_degree = benchmark.config().ring_dimension_or(Parameters::ring_dimension);
+    parms.set_poly_modulus_degree(poly_modulus_degree);
+    parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, seal_fit_bit_sizes(poly_modulus_degree, Parameters::coeff_modulus_bits)));
+	double scale = pow(2.0, Parameters::scale_bits);
+
+	SEALContext context(parms);
+	print_parameters(context);
+	profiler.stop();
+
+	/*****Key Generation*****/
+	profiler.start(Phase::KeyGeneration);
+
+    KeyGenerator keygen(context);
+	PublicKey public_key;
+	RelinKeys relin_keys;
+	seal_create_keys(keygen, public_key, &relin_keys, pool);
+    auto secret_key = keygen.secret_key();
+
+    ProfiledEncryptor encryptor(context, public_key, ops);
+    ProfiledEvaluator evaluator(context, ops);
+    ProfiledDecryptor decryptor(context, secret_key, ops);
+	
+    ProfiledCKKSEncoder encoder(context, ops);
+    size_t slot_count = encoder.slot_count();
+    cout << "Number of slots: " << slot_count << endl;
+	
+	profiler.stop();
+
+	/*****Encoding & Encryption*****/
+    long N = benchmark.plan_chunks(min<long>(Parameters::batch_size, slot_count));
+	vector<double> NumberOfRegularHours; 
+	vector<double> RegularHourlyRate; 
+	vector<double> NumberOfOvertimeHours; 
+	vector<double> OvertimeHourlyRate;   	
+
+	for(int i = 0; i < N; i++){
+		NumberOfRegularHours.push_back(random_double(GrossPayWorkload::min_regular_hours, GrossPayWorkload::max_regular_hours));
+		RegularHourlyRate.push_back(random_double(GrossPayWorkload::min_regular_rate, GrossPayWorkload::max_regular_rate));
+		NumberOfOvertimeHours.push_back(random_double(GrossPayWorkload::min_overtime_hours, GrossPayWorkload::max_overtime_hours));
+		OvertimeHourlyRate.push_back(random_double(GrossPayWorkload::min_overtime_rate, GrossPayWorkload::max_overtime_rate));
+	}
+
+	Plaintext plain_regular_hours, plain_regular_rate, plain_overtime_hours, plain_overtime_rate;
+	Ciphertext enc_regular_hours, enc_regular_rate, enc_overtime_hours, enc_overtime_rate;
+
+	benchmark.run(Phase::Encryption, [&](){
+		encoder.encode(NumberOfRegularHours, scale, plain_regular_hours);
+		encoder.encode(RegularHourlyRate, scale, plain_regular_rate);
+		encoder.encode(NumberOfOvertimeHours, scale, plain_overtime_hours);
+		encoder.encode(OvertimeHourlyRate, scale, plain_overtime_rate);
+
+		encryptor.encrypt(plain_regular_hours, enc_regular_hours);
+		encryptor.encrypt(plain_regular_rate, enc_regular_rate);
+		encryptor.encrypt(plain_overtime_hours, enc_overtime_hours);
+		encryptor.encrypt(plain_overtime_rate, enc_overtime_rate);
+	});
+
+    /*****Evaluation*****/
+	SealBackend<Scheme::CKKS> backend(evaluator, relin_keys);
+	Ciphertext enc_StandardPay;
+	Ciphertext enc_GrossPay;
+
+	benchmark.run(Phase::Evaluation, [&](){
+		gross_pay(backend, enc_regular_hours, enc_regular_rate, enc_overtime_hours, enc_overtime_rate,
+		          enc_StandardPay, enc_GrossPay, pool);
+	});
+
+	/*****Decryption & Decoding*****/
+	Plaintext plain_GrossPay;
+	vector<double> grossPay;
+
+	benchmark.run(Phase::Decryption, [&](){
+		decryptor.decrypt(enc_GrossPay, plain_GrossPay);
+
+		encoder.decode(plain_GrossPay, grossPay);
+	});
+
+	/*****Print*****/
+	cout << "Starting the Gross Pay calculator with " << N << " instances. "<< endl << endl;
+	cout << "Evaluation plan: " << gross_pay_plan(backend.levelled) << endl << endl;
+	
+	cout << "NumberOfRegularHours: " << endl;
+	print_vector(NumberOfRegularHours, 10, 4);
+
+	cout << "RegularHourlyRate: " << endl;
+	print_vector(RegularHourlyRate, 10, 4);
+
+	cout << "NumberOfOvertimeHours: " << endl;
+	print_vector(NumberOfOvertimeHours, 10, 4);
+	
+	cout << "OvertimeHourlyRate: " << endl;
+	print_vector(OvertimeHourlyRate, 10, 4);
+
+	cout << "GrossPay: " << endl;
+	print_vector(grossPay, 10, 4);
+	
+	/*****Memory*****/
+	memory.track("public key", seal_bytes(public_key));
+	memory.track("secret key", seal_bytes(secret_key));
+	memory.track("relin keys", seal_bytes(relin_keys));
+	for(const Plaintext* plain : {&plain_regular_hours, &plain_regular_rate, &plain_overtime_hours,
+			&plain_overtime_rate, &plain_GrossPay})
+		memory.track("plaintext", seal_bytes(*plain));
+	for(const Ciphertext* enc : {&enc_regular_hours, &enc_regular_rate, &enc_overtime_hours,
+			&enc_overtime_rate, &enc_StandardPay, &enc_GrossPay})
+		memory.track("ciphertext", seal_bytes(*enc));
+
+	/*****Footprint*****/
+	if(footprint.enabled()){
+		footprint.add_key("public key", seal_serialize(public_key));
+		footprint.add_key("secret key", seal_serialize(secret_key), false);
+		footprint.add_key("relin keys", seal_serialize(relin_keys));
+		for(const Ciphertext* enc : {&enc_regular_hours, &enc_regular_rate, &enc_overtime_hours,
+				&enc_overtime_rate})
+			seal_footprint(footprint, FootprintRole::Input, *enc, N);
+		seal_footprint(footprint, FootprintRole::Intermediate, enc_StandardPay, N);
+		seal_footprint(footprint, FootprintRole::Result, enc_GrossPay, N);
+		seal_footprint_chain(footprint, context, evaluator.unwrapped(), enc_regular_hours, N);
+	}
+
+	summary.ring_dimension = poly_modulus_degree;
+	summary.slot_count = slot_count;
+	summary.instances = N;
+	summary.record_pool(pool);
+	summary.record(benchmark, memory);
+	profiler.set_configuration(summary.configuration());
+	footprint.set_ring_dimension(summary.ring_dimension);
+
+	profiler.report(cout);
+	benchmark.report(cout);
+	pool.report(cout);
+	ops.report(cout);
+	memory.report(cout);
+	counters.report(cout);
+	allocations.report(cout);
+	footprint.report(cout);
+	return 0;
+}
+
+}
+
+#ifdef FHE_BENCH_DRIVER
+REGISTER_BENCHMARK(CKKS, SEAL, Gross_Pay, run)
+#else
+int main(){
+	BenchmarkResult summary;
+	return run(summary);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+/****************************************************************/
+/* HElib runtime shared by the registered workloads             */
+/* Author: Majdi Maalej                                         */
+/* One context and key set per scheme, sized for the built-in   */
+/* workloads together (workload_registry.h), serves the         */
+/* workloads named on the command line or every registered one. */
+/* FHE_RECORDS and FHE_RING_DIM apply as for the calculators.   */
+/* FHE_SHARDS=N serves them from N worker processes instead,    */
+/* which return every chunk's results for the coordinator to    */
+/* decrypt into place, or their sums for an aggregate workload. */
+/* FHE_PIPELINE=e,v,d streams the chunks through encryption,    */
+/* evaluation and decryption stages of e, v and d threads.      */
+/* FHE_DECRYPT_BENCH=N times decrypting N ciphertexts batched   */
+/* on the thread pool against one at a time.                    */
+/****************************************************************/
+#include <iostream>
+#include <exception>
+#include <time.h>
+#include <stdlib.h>
+#include "helib_runtime.h"
+
+using namespace std;
+
+int main(int argc, char** argv){
+	srand(time(NULL));
+	vector<WorkloadDefinition> workloads;
+	try{
+		workloads = selected_workloads(argc, argv);
+	}
+	catch(const exception& e){
+		cerr << e.what() << endl;
+		return 2;
+	}
+
+	int status = 0;
+	status |= serve_workloads<HElibRuntime<Scheme::BGV, HElibParameters<Scheme::BGV, BuiltinWorkloads>>>("BGV_HElib_Runtime", workloads);
+	status |= serve_workloads<HElibRuntime<Scheme::CKKS, HElibParameters<Scheme::CKKS, BuiltinWorkloads>>>("CKKS_HElib_Runtime", workloads);
+	return status;
+}
@@ -0,0 +1,411 @@
+/****************************************************************/
+/* Heap allocation counting shared by all calculators           */
+/* Author: Majdi Maalej                                         */
+/* Built with -DFHE_ALLOC_PROFILE the global operator new and   */
+/* delete are replaced to count allocations, bytes and the peak */
+/* of outstanding bytes per phase, including the threads the    */
+/* libraries start. Without the flag nothing is replaced and    */
+/* the report is empty.                                         */
+/*                                                              */
+/* Set FHE_ALLOC_SITES=<n> to record the call stack of one in   */
+/* every n allocations and list the call sites that allocate    */
+/* the most, with counts and bytes scaled back up by n. Link    */
+/* with -rdynamic -ldl to get function names for the calculator */
+/* itself. Set FHE_ALLOC_CSV=<file> to append the results as    */
+/* CSV. Memory the libraries take with malloc directly is not   */
+/* seen here, the memory profiler's heap column covers it.      */
+/****************************************************************/
+#ifndef ALLOC_PROFILER_H
+#define ALLOC_PROFILER_H
+
+#include "phase_profiler.h"
+#include <cstddef>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#ifdef FHE_ALLOC_PROFILE
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <malloc.h>
+#include <cxxabi.h>
+#include <new>
+#endif
+
+const int ALLOC_STACK_DEPTH = 10;
+const int ALLOC_SITE_SLOTS = 4096;
+
+//One call stack, in one phase (-1 outside the phases)
+struct AllocSite{
+	void* frames[ALLOC_STACK_DEPTH];
+	int depth;
+	int phase;
+	uint64_t count;
+	uint64_t bytes;
+};
+
+//State of the hook. Plain globals: operator new can run before main and on
+//any thread, so nothing here may allocate or need a constructor.
+inline std::atomic<uint64_t> alloc_hook_allocations{0};
+inline std::atomic<uint64_t> alloc_hook_frees{0};
+inline std::atomic<uint64_t> alloc_hook_bytes{0};
+inline std::atomic<int64_t> alloc_hook_live{0};
+inline std::atomic<int64_t> alloc_hook_peak{0};
+inline std::atomic<int> alloc_hook_phase{-1};
+inline std::atomic<long> alloc_hook_sample_every{-1}; //-1 until FHE_ALLOC_SITES is read
+inline std::atomic<uint64_t> alloc_hook_dropped_sites{0};
+inline std::atomic_flag alloc_hook_sites_lock = ATOMIC_FLAG_INIT;
+inline AllocSite alloc_hook_sites[ALLOC_SITE_SLOTS];
+inline thread_local bool alloc_hook_busy = false;
+inline thread_local long alloc_hook_countdown = 0;
+
+inline bool alloc_hook_compiled(){
+#ifdef FHE_ALLOC_PROFILE
+	return true;
+#else
+	return false;
+#endif
+}
+
+#ifdef FHE_ALLOC_PROFILE
+
+inline long alloc_hook_sampling(){
+	long every = alloc_hook_sample_every.load(std::memory_order_relaxed);
+	if(every < 0){
+		const char* sites = getenv("FHE_ALLOC_SITES");
+		every = sites != nullptr ? std::max(0L, atol(sites)) : 0;
+		alloc_hook_sample_every.store(every, std::memory_order_relaxed);
+	}
+	return every;
+}
+
+__attribute__((noinline)) inline void alloc_hook_capture(size_t bytes, long weight){
+	AllocSite site;
+	site.depth = backtrace(site.frames, ALLOC_STACK_DEPTH);
+	site.phase = alloc_hook_phase.load(std::memory_order_relaxed);
+
+	uintptr_t hash = (uintptr_t)site.phase;
+	for(int i = 0; i < site.depth; i++)
+		hash = hash * 31 + ((uintptr_t)site.frames[i] >> 4);
+
+	while(alloc_hook_sites_lock.test_and_set(std::memory_order_acquire)){}
+	for(int probe = 0; probe < ALLOC_SITE_SLOTS; probe++){
+		AllocSite& slot = alloc_hook_sites[(hash + probe) % ALLOC_SITE_SLOTS];
+		if(slot.count == 0){
+			slot = site;
+			slot.count = 0;
+			slot.bytes = 0;
+		}
+		else if(slot.phase != site.phase || slot.depth != site.depth ||
+		        !std::equal(site.frames, site.frames + site.depth, slot.frames))
+			continue;
+		slot.count += weight;
+		slot.bytes += bytes * weight;
+		alloc_hook_sites_lock.clear(std::memory_order_release);
+		return;
+	}
+	alloc_hook_sites_lock.clear(std::memory_order_release);
+	alloc_hook_dropped_sites.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void alloc_hook_record(void* p){
+	size_t bytes = malloc_usable_size(p);
+	alloc_hook_allocations.fetch_add(1, std::memory_order_relaxed);
+	alloc_hook_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	int64_t live = alloc_hook_live.fetch_add((int64_t)bytes, std::memory_order_relaxed) + (int64_t)bytes;
+	int64_t peak = alloc_hook_peak.load(std::memory_order_relaxed);
+	while(live > peak && !alloc_hook_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)){}
+
+	long every = alloc_hook_sampling();
+	if(every == 0 || alloc_hook_busy)
+		return;
+	if(--alloc_hook_countdown > 0)
+		return;
+	alloc_hook_countdown = every;
+	//backtrace() may allocate the first time it runs
+	alloc_hook_busy = true;
+	alloc_hook_capture(bytes, every);
+	alloc_hook_busy = false;
+}
+
+inline void* alloc_hook_allocate(size_t size, size_t alignment, bool nothrow){
+	if(size == 0)
+		size = 1;
+	for(;;){
+		void* p = nullptr;
+		if(alignment > alignof(std::max_align_t)){
+			if(posix_memalign(&p, alignment, size) != 0)
+				p = nullptr;
+		}
+		else
+			p = malloc(size);
+		if(p != nullptr){
+			alloc_hook_record(p);
+			return p;
+		}
+		std::new_handler handler = std::get_new_handler();
+		if(handler == nullptr){
+			if(nothrow)
+				return nullptr;
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+inline void alloc_hook_free(void* p){
+	if(p == nullptr)
+		return;
+	alloc_hook_frees.fetch_add(1, std::memory_order_relaxed);
+	alloc_hook_live.fetch_sub((int64_t)malloc_usable_size(p), std::memory_order_relaxed);
+	free(p);
+}
+
+inline std::string alloc_hook_symbol(void* address){
+	char buffer[32];
+	Dl_info info;
+	if(dladdr(address, &info) == 0){
+		snprintf(buffer, sizeof(buffer), "%p", address);
+		return buffer;
+	}
+	if(info.dli_sname != nullptr){
+		int status = 0;
+		char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+		std::string name = status == 0 && demangled != nullptr ? demangled : info.dli_sname;
+		free(demangled);
+		snprintf(buffer, sizeof(buffer), "+0x%lx", (unsigned long)((char*)address - (char*)info.dli_saddr));
+		return name + buffer;
+	}
+	std::string module = info.dli_fname != nullptr ? info.dli_fname : "?";
+	snprintf(buffer, sizeof(buffer), "+0x%lx", (unsigned long)((char*)address - (char*)info.dli_fbase));
+	return module.substr(module.find_last_of('/') + 1) + buffer;
+}
+
+//The replacement operators have to be defined once per program: in every
+//calculator built on its own, in benchmark_driver.cpp for the driver.
+#if !defined(FHE_BENCH_DRIVER) || defined(FHE_ALLOC_DEFINE_OPERATORS)
+void* operator new(size_t size){ return alloc_hook_allocate(size, 0, false); }
+void* operator new[](size_t size){ return alloc_hook_allocate(size, 0, false); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept{ return alloc_hook_allocate(size, 0, true); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{ return alloc_hook_allocate(size, 0, true); }
+void* operator new(size_t size, std::align_val_t alignment){ return alloc_hook_allocate(size, (size_t)alignment, false); }
+void* operator new[](size_t size, std::align_val_t alignment){ return alloc_hook_allocate(size, (size_t)alignment, false); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+	return alloc_hook_allocate(size, (size_t)alignment, true);
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+	return alloc_hook_allocate(size, (size_t)alignment, true);
+}
+void operator delete(void* p) noexcept{ alloc_hook_free(p); }
+void operator delete[](void* p) noexcept{ alloc_hook_free(p); }
+void operator delete(void* p, size_t) noexcept{ alloc_hook_free(p); }
+void operator delete[](void* p, size_t) noexcept{ alloc_hook_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept{ alloc_hook_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept{ alloc_hook_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept{ alloc_hook_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept{ alloc_hook_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept{ alloc_hook_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept{ alloc_hook_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept{ alloc_hook_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept{ alloc_hook_free(p); }
+#endif
+
+#endif
+
+struct PhaseAllocations{
+	uint64_t allocations = 0;
+	uint64_t frees = 0;
+	uint64_t bytes = 0;
+	int64_t peak_live_bytes = 0; //highest outstanding bytes while the phase ran
+	int64_t live_growth_bytes = 0; //outstanding bytes at the last stop minus the first start
+};
+
+class AllocProfiler : public PhaseListener{
+public:
+	//Starts a new site table, the driver runs several calculators in turn
+	explicit AllocProfiler(PhaseProfiler& profiler) : profiler_(profiler){
+		if(!alloc_hook_compiled())
+			return;
+		profiler_.add_listener(this);
+		while(alloc_hook_sites_lock.test_and_set(std::memory_order_acquire)){}
+		for(int i = 0; i < ALLOC_SITE_SLOTS; i++)
+			alloc_hook_sites[i].count = 0;
+		alloc_hook_sites_lock.clear(std::memory_order_release);
+		alloc_hook_dropped_sites.store(0);
+	}
+
+	const PhaseAllocations& phase(Phase phase) const{
+		return phases_[(int)phase];
+	}
+
+	void phase_started(Phase phase) override{
+		PhaseAllocations& a = phases_[(int)phase];
+		if(!seen_[(int)phase]){
+			a.live_growth_bytes = -alloc_hook_live.load();
+			seen_[(int)phase] = true;
+		}
+		start_allocations_ = alloc_hook_allocations.load();
+		start_frees_ = alloc_hook_frees.load();
+		start_bytes_ = alloc_hook_bytes.load();
+		alloc_hook_peak.store(alloc_hook_live.load());
+		alloc_hook_phase.store((int)phase);
+	}
+
+	void phase_stopped(Phase phase) override{
+		alloc_hook_phase.store(-1);
+		PhaseAllocations& a = phases_[(int)phase];
+		a.allocations += alloc_hook_allocations.load() - start_allocations_;
+		a.frees += alloc_hook_frees.load() - start_frees_;
+		a.bytes += alloc_hook_bytes.load() - start_bytes_;
+		a.peak_live_bytes = std::max(a.peak_live_bytes, alloc_hook_peak.load());
+		live_at_stop_[(int)phase] = alloc_hook_live.load();
+	}
+
+	//Sites sorted by bytes, largest first
+	std::vector<AllocSite> top_sites(size_t limit) const{
+		//Neither the report's own allocations nor ones made while the table
+		//is locked may be sampled
+		std::vector<AllocSite> sites;
+		bool busy = alloc_hook_busy;
+		alloc_hook_busy = true;
+		sites.reserve(ALLOC_SITE_SLOTS);
+		while(alloc_hook_sites_lock.test_and_set(std::memory_order_acquire)){}
+		for(int i = 0; i < ALLOC_SITE_SLOTS; i++){
+			if(alloc_hook_sites[i].count > 0)
+				sites.push_back(alloc_hook_sites[i]);
+		}
+		alloc_hook_sites_lock.clear(std::memory_order_release);
+		alloc_hook_busy = busy;
+		std::sort(sites.begin(), sites.end(), [](const AllocSite& a, const AllocSite& b){
+			return a.bytes > b.bytes;
+		});
+		if(sites.size() > limit)
+			sites.resize(limit);
+		return sites;
+	}
+
+	void report(std::ostream& out) const{
+		if(!alloc_hook_compiled())
+			return;
+
+		out << "Heap allocations (operator new):" << std::endl;
+		out << "                        " << std::setw(12) << "Allocs" << std::setw(12) << "Frees"
+		    << std::setw(12) << "MB" << std::setw(14) << "Peak live MB" << std::setw(14) << "Live delta MB"
+		    << std::endl;
+		out << std::fixed << std::setprecision(3);
+		for(int p = 0; p < PHASE_COUNT; p++){
+			if(!seen_[p])
+				continue;
+			PhaseAllocations a = totals((Phase)p);
+			out << std::left << std::setw(22) << phase_name((Phase)p) << std::right << ": "
+			    << std::setw(12) << a.allocations << std::setw(12) << a.frees
+			    << std::setw(12) << a.bytes / 1048576.0 << std::setw(14) << a.peak_live_bytes / 1048576.0
+			    << std::setw(14) << a.live_growth_bytes / 1048576.0 << std::endl;
+		}
+		out << std::defaultfloat;
+
+		std::vector<AllocSite> sites = top_sites(10);
+		if(!sites.empty()){
+			out << "Top allocation sites (one in " << alloc_hook_sample_every.load() << " allocations sampled):"
+			    << std::endl;
+			out << std::fixed << std::setprecision(3);
+			for(const AllocSite& s : sites){
+				out << std::setw(12) << s.count << " allocs " << std::setw(12) << s.bytes / 1048576.0 << " MB in "
+				    << (s.phase >= 0 ? phase_name((Phase)s.phase) : "no phase") << std::endl;
+				for(const std::string& frame : frames(s, 4))
+					out << "        " << frame << std::endl;
+			}
+			out << std::defaultfloat;
+			if(alloc_hook_dropped_sites.load() > 0)
+				out << alloc_hook_dropped_sites.load() << " samples dropped, the site table is full" << std::endl;
+		}
+
+		const char* csv_path = getenv("FHE_ALLOC_CSV");
+		if(csv_path != nullptr && *csv_path != '\0')
+			append_csv(csv_path);
+	}
+
+	static void write_csv_header(std::ostream& out){
+		out << "program,phase,metric,count,bytes" << std::endl;
+	}
+
+	//Site rows name the innermost frame outside the allocator, commas replaced
+	void write_csv(std::ostream& out) const{
+		const std::string& program = profiler_.program();
+		for(int p = 0; p < PHASE_COUNT; p++){
+			if(!seen_[p])
+				continue;
+			PhaseAllocations a = totals((Phase)p);
+			const char* phase = phase_key((Phase)p);
+			out << program << "," << phase << ",allocations," << a.allocations << "," << a.bytes << std::endl;
+			out << program << "," << phase << ",frees," << a.frees << "," << std::endl;
+			out << program << "," << phase << ",peak_live,1," << a.peak_live_bytes << std::endl;
+			out << program << "," << phase << ",live_growth,1," << a.live_growth_bytes << std::endl;
+		}
+		for(const AllocSite& s : top_sites(50)){
+			std::vector<std::string> names = frames(s, 1);
+			std::string name = names.empty() ? "unknown" : names[0];
+			std::replace(name.begin(), name.end(), ',', ';');
+			out << program << "," << (s.phase >= 0 ? phase_key((Phase)s.phase) : "none") << ",site:" << name
+			    << "," << s.count << "," << s.bytes << std::endl;
+		}
+	}
+
+	void append_csv(const std::string& path) const{
+		bool empty;
+		{
+			std::ifstream in(path);
+			empty = !in.good() || in.peek() == std::ifstream::traits_type::eof();
+		}
+		std::ofstream out(path, std::ios::app);
+		if(!out){
+			std::cerr << "Could not open " << path << " for writing" << std::endl;
+			return;
+		}
+		if(empty)
+			write_csv_header(out);
+		write_csv(out);
+	}
+
+private:
+	PhaseAllocations totals(Phase phase) const{
+		PhaseAllocations a = phases_[(int)phase];
+		a.live_growth_bytes += live_at_stop_[(int)phase];
+		return a;
+	}
+
+	//Frames of the site outside the hook itself, innermost first
+	static std::vector<std::string> frames(const AllocSite& site, size_t limit){
+		std::vector<std::string> names;
+#ifdef FHE_ALLOC_PROFILE
+		for(int i = 0; i < site.depth && names.size() < limit; i++){
+			std::string name = alloc_hook_symbol(site.frames[i]);
+			if(name.find("alloc_hook_") != std::string::npos || name.compare(0, 12, "operator new") == 0)
+				continue;
+			if(name.size() > 120)
+				name = name.substr(0, 117) + "...";
+			names.push_back(name);
+		}
+#else
+		(void)site;
+		(void)limit;
+#endif
+		return names;
+	}
+
+	PhaseProfiler& profiler_;
+	PhaseAllocations phases_[PHASE_COUNT];
+	bool seen_[PHASE_COUNT] = {};
+	int64_t live_at_stop_[PHASE_COUNT] = {};
+	uint64_t start_allocations_ = 0;
+	uint64_t start_frees_ = 0;
+	uint64_t start_bytes_ = 0;
+};
+
+#endif
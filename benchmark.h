@@ -0,0 +1,288 @@
+/****************************************************************/
+/* Repeated-trial benchmark mode shared by all calculators      */
+/* Author: Majdi Maalej                                         */
+/* Runs the encryption, evaluation and decryption phases        */
+/* FHE_BENCH_TRIALS times after FHE_BENCH_WARMUP untimed runs,  */
+/* reusing the context and keys, and reports latency            */
+/* statistics per phase. Both default to a single timed run.    */
+/*                                                              */
+/* FHE_RECORDS and FHE_RING_DIM set the problem size for        */
+/* sweeps. The records are split into chunks of one ciphertext  */
+/* each, processed one after another through the same buffers,  */
+/* and every timed trial covers all chunks. FHE_RING_DIM        */
+/* replaces the calculator's default ring dimension.            */
+/* FHE_THREADS is the number of threads a run may use, by       */
+/* default one per core. FHE_POOL_THREADS of them (all by       */
+/* default) make up the thread pool (thread_pool.h) running     */
+/* independent operations side by side; each operation gets     */
+/* FHE_THREADS / FHE_POOL_THREADS library threads (NTL for      */
+/* HElib, OpenMP for PALISADE; SEAL runs each operation on one  */
+/* thread), so the two never oversubscribe the cores.           */
+/* FHE_PIN=1 pins the pool threads to cores, with NUMA-local    */
+/* allocation.                                                  */
+/* FHE_SHARDS makes the shared runtimes spread the chunks over  */
+/* that many worker processes (workload_runtime.h).             */
+/* FHE_PIPELINE=e,v,d streams their chunks through encryption,  */
+/* evaluation and decryption stages of e, v and d threads, with */
+/* queues of FHE_QUEUE_DEPTH chunks (4 by default) between them */
+/* (pipeline.h).                                                */
+/* FHE_DECRYPT_BENCH=N adds a decryption throughput benchmark   */
+/* of N ciphertexts to the shared runtimes.                     */
+/****************************************************************/
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "phase_profiler.h"
+#include "thread_pool.h"
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct BenchmarkConfig{
+	int warmup = 0;
+	int trials = 1;
+	long records = 0;        //0 keeps one ciphertext worth of records
+	long ring_dimension = 0; //0 keeps the calculator's default
+	int threads = 0;         //0 uses every core
+	int pool_threads = 0;    //0 gives the pool every thread
+	bool pin = false;
+	int shards = 0;          //worker processes, 0 serves in this process
+	std::vector<int> pipeline; //threads per stage, empty runs the phases in turn
+	int queue_depth = 4;       //chunks between two stages
+	long decrypt_ciphertexts = 0; //of the decryption benchmark, 0 skips it
+
+	static BenchmarkConfig from_env(){
+		BenchmarkConfig config;
+		const char* warmup = getenv("FHE_BENCH_WARMUP");
+		const char* trials = getenv("FHE_BENCH_TRIALS");
+		if(warmup != nullptr)
+			config.warmup = std::max(0, atoi(warmup));
+		if(trials != nullptr)
+			config.trials = std::max(1, atoi(trials));
+		const char* records = getenv("FHE_RECORDS");
+		const char* ring_dimension = getenv("FHE_RING_DIM");
+		if(records != nullptr)
+			config.records = std::max(0L, atol(records));
+		if(ring_dimension != nullptr)
+			config.ring_dimension = std::max(0L, atol(ring_dimension));
+		const char* threads = getenv("FHE_THREADS");
+		if(threads != nullptr)
+			config.threads = std::max(0, atoi(threads));
+		const char* pool_threads = getenv("FHE_POOL_THREADS");
+		if(pool_threads != nullptr)
+			config.pool_threads = std::max(0, atoi(pool_threads));
+		const char* pin = getenv("FHE_PIN");
+		config.pin = pin != nullptr && atoi(pin) != 0;
+		const char* shards = getenv("FHE_SHARDS");
+		if(shards != nullptr)
+			config.shards = std::max(0, atoi(shards));
+		const char* pipeline = getenv("FHE_PIPELINE");
+		if(pipeline != nullptr && *pipeline != '\0'){
+			std::istringstream stages(pipeline);
+			std::string workers;
+			while(std::getline(stages, workers, ','))
+				config.pipeline.push_back(std::max(1, atoi(workers.c_str())));
+		}
+		const char* queue_depth = getenv("FHE_QUEUE_DEPTH");
+		if(queue_depth != nullptr)
+			config.queue_depth = std::max(1, atoi(queue_depth));
+		const char* decrypt_ciphertexts = getenv("FHE_DECRYPT_BENCH");
+		if(decrypt_ciphertexts != nullptr)
+			config.decrypt_ciphertexts = std::max(0L, atol(decrypt_ciphertexts));
+		return config;
+	}
+
+	long ring_dimension_or(long fallback) const{
+		return ring_dimension > 0 ? ring_dimension : fallback;
+	}
+
+	int total_threads() const{
+		return threads > 0 ? threads : hardware_threads();
+	}
+
+	int pool_size() const{
+		return pool_threads > 0 ? std::min(pool_threads, total_threads()) : total_threads();
+	}
+
+	//For each operation the pool runs
+	int library_threads() const{
+		return std::max(1, total_threads() / pool_size());
+	}
+
+	//For each operation of a pipeline stage
+	int pipeline_library_threads() const{
+		int workers = 0;
+		for(int stage : pipeline)
+			workers += stage;
+		return std::max(1, total_threads() / std::max(1, workers));
+	}
+};
+
+struct LatencyStats{
+	size_t count = 0;
+	double min = 0;
+	double median = 0;
+	double p95 = 0;
+	double p99 = 0;
+	double mean = 0;
+	double stddev = 0;
+};
+
+//Nearest-rank percentile of an already sorted sample
+inline double percentile(const std::vector<double>& sorted, double pct){
+	if(sorted.empty())
+		return 0;
+	size_t rank = (size_t)ceil(pct / 100.0 * sorted.size());
+	if(rank < 1)
+		rank = 1;
+	return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+inline LatencyStats compute_stats(std::vector<double> values){
+	LatencyStats stats;
+	stats.count = values.size();
+	if(values.empty())
+		return stats;
+
+	std::sort(values.begin(), values.end());
+	stats.min = values.front();
+	size_t mid = values.size() / 2;
+	stats.median = values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+	stats.p95 = percentile(values, 95);
+	stats.p99 = percentile(values, 99);
+
+	double sum = 0;
+	for(double v : values)
+		sum += v;
+	stats.mean = sum / values.size();
+
+	double squares = 0;
+	for(double v : values)
+		squares += (v - stats.mean) * (v - stats.mean);
+	stats.stddev = values.size() > 1 ? sqrt(squares / (values.size() - 1)) : 0;
+	return stats;
+}
+
+class Benchmark{
+public:
+	explicit Benchmark(PhaseProfiler& profiler, BenchmarkConfig config = BenchmarkConfig::from_env())
+		: profiler_(profiler), config_(config){}
+
+	const PhaseProfiler& profiler() const{
+		return profiler_;
+	}
+
+	const BenchmarkConfig& config() const{
+		return config_;
+	}
+
+	//Splits the configured records into chunks of at most capacity records,
+	//the number one ciphertext holds, and returns the records per chunk.
+	//The homomorphic work does not depend on the values, so every chunk
+	//reuses the same data.
+	long plan_chunks(long capacity){
+		capacity = std::max(1L, capacity);
+		if(config_.records > 0){
+			chunk_records_ = std::min(config_.records, capacity);
+			chunks_ = (config_.records + capacity - 1) / capacity;
+		}
+		else{
+			chunk_records_ = capacity;
+			chunks_ = 1;
+		}
+		return chunk_records_;
+	}
+
+	long chunks() const{
+		return chunks_;
+	}
+
+	long records() const{
+		return config_.records > 0 ? config_.records : chunk_records_;
+	}
+
+	//The phase body must be repeatable: it has to produce the same outputs
+	//every time it runs instead of accumulating into them.
+	template<typename Function>
+	void run(Phase phase, Function&& body){
+		for(int i = 0; i < config_.warmup; i++)
+			body();
+		for(int trial = 0; trial < config_.trials; trial++){
+			if(trial > 0 || !profiler_.samples(phase).empty())
+				profiler_.new_trial(phase);
+			profiler_.start(phase);
+			for(long chunk = 0; chunk < chunks_; chunk++)
+				body();
+			profiler_.stop();
+		}
+	}
+
+	//Mean wall time of encrypting, evaluating and decrypting all records
+	double pipeline_wall_ns() const{
+		double total = 0;
+		for(Phase phase : { Phase::Encryption, Phase::Evaluation, Phase::Decryption })
+			total += profiler_.times(phase).wall_ns;
+		return total;
+	}
+
+	double records_per_second() const{
+		double wall_ns = pipeline_wall_ns();
+		return wall_ns > 0 ? records() * 1e9 / wall_ns : 0;
+	}
+
+	double chunk_latency_ns() const{
+		return pipeline_wall_ns() / chunks_;
+	}
+
+	LatencyStats wall_stats(Phase phase) const{
+		std::vector<double> wall_ms;
+		for(const PhaseTimes& t : profiler_.samples(phase))
+			wall_ms.push_back(t.wall_ns / 1e6);
+		return compute_stats(wall_ms);
+	}
+
+	//Prints nothing for a single-trial run without FHE_RECORDS, the profiler
+	//table covers it
+	void report(std::ostream& out) const{
+		if(config_.records > 0){
+			out << "Throughput, " << records() << " records in " << chunks_ << " chunks of "
+			    << chunk_records_ << ":" << std::endl;
+			out << std::fixed << std::setprecision(3);
+			out << std::left << std::setw(22) << "Records per second" << std::right << ": "
+			    << std::setw(12) << records_per_second() << std::endl;
+			out << std::left << std::setw(22) << "Chunk latency (ms)" << std::right << ": "
+			    << std::setw(12) << chunk_latency_ns() / 1e6 << std::endl;
+			out << std::defaultfloat;
+		}
+		if(config_.trials < 2)
+			return;
+
+		out << "Wall time statistics (ms), " << config_.trials << " trials after "
+		    << config_.warmup << " warmup runs:" << std::endl;
+		out << "                        " << std::setw(12) << "min" << std::setw(12) << "median"
+		    << std::setw(12) << "p95" << std::setw(12) << "p99" << std::setw(12) << "stddev" << std::endl;
+		for(int p = 0; p < PHASE_COUNT; p++){
+			if(profiler_.samples((Phase)p).size() < 2)
+				continue;
+			LatencyStats s = wall_stats((Phase)p);
+			out << std::left << std::setw(22) << phase_name((Phase)p) << std::right << ": "
+			    << std::fixed << std::setprecision(3)
+			    << std::setw(12) << s.min << std::setw(12) << s.median << std::setw(12) << s.p95
+			    << std::setw(12) << s.p99 << std::setw(12) << s.stddev << std::endl;
+		}
+		out << std::defaultfloat;
+	}
+
+private:
+	PhaseProfiler& profiler_;
+	BenchmarkConfig config_;
+	long chunk_records_ = 0;
+	long chunks_ = 1;
+};
+
+#endif
@@ -0,0 +1,295 @@
+/****************************************************************/
+/* Regression check against a stored benchmark baseline         */
+/* Author: Majdi Maalej                                         */
+/* Compares two per-trial profile CSV files (FHE_PROFILE_CSV    */
+/* output, see phase_profiler.h) phase by phase with a two-     */
+/* sided Mann-Whitney U test on the trials. A phase is a        */
+/* regression when it got slower with p < alpha and its median  */
+/* moved by more than the threshold; the exit code is then 1.   */
+/* Trials are only compared with those of the same program and  */
+/* configuration: ring dimension, records, pool and library     */
+/* threads, so a sweep's rows are not pooled. A baseline        */
+/* written before those columns existed has to be recorded      */
+/* again.                                                       */
+/*                                                              */
+/* Record a baseline once per library build or parameter set    */
+/* and keep it under version control, e.g.                      */
+/*   FHE_BENCH_TRIALS=20 FHE_BENCH_WARMUP=2                     */
+/*   FHE_PROFILE_CSV=baselines/seal-4.0.csv ./benchmark_driver  */
+/* Lines starting with '#' are ignored and can hold notes on    */
+/* the library versions and the host.                           */
+/*                                                              */
+/* Build: g++ -std=c++17 -O2 -o benchmark_compare               */
+/*            benchmark_compare.cpp                             */
+/* Usage: benchmark_compare BASELINE.csv CURRENT.csv            */
+/*            [--alpha 0.05] [--threshold 5]                    */
+/*            [--metric wall_ns|process_cpu_ns|thread_cpu_ns]   */
+/****************************************************************/
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//Program, configuration ("ring/records/threadsxlibrary threads", empty in
+//files without those columns) and phase
+typedef tuple<string, string, string> SampleKey;
+typedef map<SampleKey, vector<double>> Samples;
+
+const char* const CONFIGURATION_COLUMNS[] = { "ring_dimension", "records", "threads", "library_threads" };
+
+vector<string> split_csv_line(const string& line){
+	vector<string> fields;
+	stringstream in(line);
+	string field;
+	while(getline(in, field, ','))
+		fields.push_back(field);
+	return fields;
+}
+
+//Reads program,<configuration>,phase,<metric> of every trial, in the order
+//the phases appear
+bool read_samples(const string& path, const string& metric, Samples& samples, vector<SampleKey>& order){
+	ifstream in(path);
+	if(!in){
+		cerr << "Could not open " << path << endl;
+		return false;
+	}
+
+	string line;
+	int program_column = -1, phase_column = -1, metric_column = -1;
+	vector<int> configuration_columns;
+	while(getline(in, line)){
+		if(!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if(line.empty() || line[0] == '#')
+			continue;
+		vector<string> fields = split_csv_line(line);
+
+		//Appended files may repeat the header
+		if(fields.size() > 0 && fields[0] == "program"){
+			configuration_columns.clear();
+			for(const char* name : CONFIGURATION_COLUMNS){
+				for(size_t i = 0; i < fields.size(); i++){
+					if(fields[i] == name)
+						configuration_columns.push_back((int)i);
+				}
+			}
+			for(size_t i = 0; i < fields.size(); i++){
+				if(fields[i] == "program") program_column = (int)i;
+				if(fields[i] == "phase") phase_column = (int)i;
+				if(fields[i] == metric) metric_column = (int)i;
+			}
+			continue;
+		}
+		if(program_column < 0 || phase_column < 0 || metric_column < 0){
+			cerr << path << ": missing program, phase or " << metric << " column" << endl;
+			return false;
+		}
+		int last = max(program_column, max(phase_column, metric_column));
+		for(int column : configuration_columns)
+			last = max(last, column);
+		if((int)fields.size() <= last)
+			continue;
+
+		string configuration;
+		if(configuration_columns.size() == 4){
+			configuration = fields[configuration_columns[0]] + "/" + fields[configuration_columns[1]] + "/"
+			                + fields[configuration_columns[2]] + "x" + fields[configuration_columns[3]];
+		}
+		SampleKey key(fields[program_column], configuration, fields[phase_column]);
+		if(samples.find(key) == samples.end())
+			order.push_back(key);
+		samples[key].push_back(atof(fields[metric_column].c_str()));
+	}
+	return true;
+}
+
+double median(vector<double> values){
+	sort(values.begin(), values.end());
+	size_t mid = values.size() / 2;
+	return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+double normal_cdf(double z){
+	return 0.5 * erfc(-z / sqrt(2.0));
+}
+
+//Two-sided p-value of the Mann-Whitney U test. Exact distribution for small
+//samples without ties, normal approximation with tie and continuity
+//correction otherwise.
+double mann_whitney_p(const vector<double>& a, const vector<double>& b){
+	size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+	vector<pair<double, int>> all;
+	for(double v : a) all.push_back(make_pair(v, 0));
+	for(double v : b) all.push_back(make_pair(v, 1));
+	sort(all.begin(), all.end());
+
+	//Average ranks over ties
+	double rank_sum_a = 0, tie_term = 0;
+	bool ties = false;
+	for(size_t i = 0; i < n;){
+		size_t j = i;
+		while(j < n && all[j].first == all[i].first)
+			j++;
+		double rank = (i + 1 + j) / 2.0;
+		for(size_t k = i; k < j; k++)
+			if(all[k].second == 0)
+				rank_sum_a += rank;
+		double t = (double)(j - i);
+		if(t > 1){
+			ties = true;
+			tie_term += t * t * t - t;
+		}
+		i = j;
+	}
+	double u = rank_sum_a - n1 * (n1 + 1) / 2.0;
+	double mean_u = n1 * n2 / 2.0;
+
+	if(!ties && n1 <= 30 && n2 <= 30){
+		//count[i][j][u]: orderings of i values of a and j of b with statistic u,
+		//built row by row with count(i, j, u) = count(i-1, j, u-j) + count(i, j-1, u)
+		size_t max_u = n1 * n2;
+		vector<vector<vector<double>>> count(n1 + 1, vector<vector<double>>(n2 + 1));
+		for(size_t i = 0; i <= n1; i++){
+			for(size_t j = 0; j <= n2; j++){
+				count[i][j].assign(i * j + 1, 0);
+				if(i == 0 || j == 0){
+					count[i][j][0] = 1;
+					continue;
+				}
+				for(size_t k = 0; k <= i * j; k++){
+					double c = 0;
+					if(k >= j && k - j <= (i - 1) * j)
+						c += count[i - 1][j][k - j];
+					if(k <= i * (j - 1))
+						c += count[i][j - 1][k];
+					count[i][j][k] = c;
+				}
+			}
+		}
+		const vector<double>& dist = count[n1][n2];
+		double total = 0;
+		for(double c : dist)
+			total += c;
+		double distance = fabs(u - mean_u);
+		double tail = 0;
+		for(size_t k = 0; k <= max_u; k++)
+			if(fabs(k - mean_u) >= distance - 1e-9)
+				tail += dist[k];
+		return min(1.0, tail / total);
+	}
+
+	double variance = n1 * n2 / 12.0 * ((n + 1) - tie_term / ((double)n * (n - 1)));
+	if(variance <= 0)
+		return 1.0;
+	double z = (fabs(u - mean_u) - 0.5) / sqrt(variance);
+	if(z < 0)
+		z = 0;
+	return min(1.0, 2 * (1 - normal_cdf(z)));
+}
+
+void print_usage(const char* program){
+	cerr << "Usage: " << program << " BASELINE.csv CURRENT.csv [--alpha 0.05] [--threshold 5]"
+	     << " [--metric wall_ns|process_cpu_ns|thread_cpu_ns]" << endl;
+}
+
+int main(int argc, char** argv){
+	vector<string> files;
+	double alpha = 0.05;
+	double threshold = 5;
+	string metric = "wall_ns";
+
+	for(int i = 1; i < argc; i++){
+		string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if(arg == "--alpha" && has_value)
+			alpha = atof(argv[++i]);
+		else if(arg == "--threshold" && has_value)
+			threshold = atof(argv[++i]);
+		else if(arg == "--metric" && has_value)
+			metric = argv[++i];
+		else if(arg.size() > 2 && arg.compare(0, 2, "--") == 0){
+			print_usage(argv[0]);
+			return 2;
+		}
+		else
+			files.push_back(arg);
+	}
+	if(files.size() != 2){
+		print_usage(argv[0]);
+		return 2;
+	}
+
+	Samples baseline, current;
+	vector<SampleKey> order, current_order;
+	if(!read_samples(files[0], metric, baseline, order) || !read_samples(files[1], metric, current, current_order))
+		return 2;
+	auto configured = [](const vector<SampleKey>& keys){
+		return any_of(keys.begin(), keys.end(), [](const SampleKey& key){ return !get<1>(key).empty(); });
+	};
+	if(configured(order) != configured(current_order))
+		cerr << "Only one of the files has the ring dimension, records and threads columns, record the baseline again"
+		     << endl;
+	for(const SampleKey& key : current_order)
+		if(baseline.find(key) == baseline.end())
+			order.push_back(key);
+
+	int regressions = 0, improvements = 0;
+	cout << left << setw(36) << "Program" << setw(24) << "Ring/records/threads" << setw(22) << "Phase" << right
+	     << setw(14) << "Baseline" << setw(14) << "Current" << setw(10) << "Change" << setw(10) << "p" << "  Verdict"
+	     << endl;
+	cout << left << setw(36) << "" << setw(24) << "" << setw(22) << "" << right << setw(14) << "(median ms)"
+	     << setw(14) << "(median ms)" << endl;
+	for(const SampleKey& key : order){
+		auto b = baseline.find(key);
+		auto c = current.find(key);
+		cout << left << setw(36) << get<0>(key) << setw(24) << get<1>(key) << setw(22) << get<2>(key) << right;
+		if(b == baseline.end() || c == current.end()){
+			cout << setw(14) << (b == baseline.end() ? "-" : "") << setw(14) << (c == current.end() ? "-" : "")
+			     << setw(10) << "" << setw(10) << "" << "  " << (b == baseline.end() ? "new" : "missing") << endl;
+			continue;
+		}
+
+		double before = median(b->second);
+		double after = median(c->second);
+		cout << fixed << setprecision(3) << setw(14) << before / 1e6 << setw(14) << after / 1e6;
+		if(before <= 0){
+			cout << setw(10) << "-" << setw(10) << "-" << "  not timed" << defaultfloat << endl;
+			continue;
+		}
+		double change = 100.0 * (after - before) / before;
+		cout << setprecision(1) << setw(9) << change << "%";
+		if(b->second.size() < 2 || c->second.size() < 2){
+			cout << setw(10) << "-" << "  too few trials" << defaultfloat << endl;
+			continue;
+		}
+
+		double p = mann_whitney_p(b->second, c->second);
+		cout << setprecision(4) << setw(10) << p << defaultfloat;
+		if(p < alpha && change > threshold){
+			cout << "  REGRESSION";
+			regressions++;
+		}
+		else if(p < alpha && change < -threshold){
+			cout << "  improvement";
+			improvements++;
+		}
+		else
+			cout << "  unchanged";
+		cout << endl;
+	}
+
+	cout << regressions << " regressions, " << improvements << " improvements (alpha " << alpha
+	     << ", threshold " << threshold << "%, " << metric << ")" << endl;
+	return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,363 @@
+/****************************************************************/
+/* Benchmark driver for the scheme x library x workload grid    */
+/* Author: Majdi Maalej                                         */
+/* Runs every calculator linked into it, or the subset selected */
+/* with --scheme, --library and --workload, and writes one row  */
+/* per calculator with phase times, memory, ciphertext sizes    */
+/* and slot counts as CSV and/or JSON.                          */
+/*                                                              */
+/* Sweep mode: --records and --ring-dim take lists and run      */
+/* every selected calculator once per combination, adding       */
+/* records per second, latency per chunk and memory per record  */
+/* to each row. A ring a calculator cannot use with its modulus */
+/* chain shows up as a failed row.                              */
+/* Scaling mode: --threads takes a list of thread budgets       */
+/* (FHE_THREADS) and --pool-threads a list of how many of them  */
+/* go to the thread pool (FHE_POOL_THREADS), the rest running   */
+/* inside each library operation (benchmark.h). --pin pins the  */
+/* pool threads to cores (FHE_PIN). Each row gets the           */
+/* encryption, the whole-pipeline and the key generation        */
+/* speedup over the first setting swept for the same            */
+/* calculator, ring and records. The sweep ends with a table    */
+/* of key generation wall time against cores (pool threads      */
+/* times the threads inside each operation) on stderr.          */
+/* Every row also gets the pool's steal count and the           */
+/* utilization of its least busy thread, to check the load was  */
+/* balanced.                                                    */
+/*   benchmark_driver --workload TotalCovidDeaths               */
+/*                    --threads 1,2,4,8,16 --pin                */
+/*                                                              */
+/* Build with every calculator (drop the files of a library     */
+/* that is not installed, they only register themselves):       */
+/*   g++ -std=c++17 -O2 -DFHE_BENCH_DRIVER -o benchmark_driver  */
+/*       benchmark_driver.cpp *_SEAL_*.cpp *_HElib_*.cpp        */
+/*       *_PALISADE_*.cpp <SEAL, HElib and PALISADE flags> -lz  */
+/* Add -DFHE_ALLOC_PROFILE -rdynamic -ldl to every file for the */
+/* allocation report (alloc_profiler.h).                        */
+/*                                                              */
+/* Usage:                                                       */
+/*   benchmark_driver [--scheme BFV,BGV,CKKS] [--library ...]   */
+/*                    [--workload ...] [--trials N]             */
+/*                    [--warmup N] [--csv FILE] [--json FILE]   */
+/*                    [--records N,...] [--ring-dim N,...]      */
+/*                    [--threads N,...] [--pool-threads N,...]  */
+/*                    [--pin]                                   */
+/*                    [--verbose] [--list]                      */
+/* Without --csv or --json the CSV table goes to stdout. The    */
+/* calculators' own output is discarded unless --verbose.       */
+/****************************************************************/
+#include "benchmark_registry.h"
+#define FHE_ALLOC_DEFINE_OPERATORS //one definition for every calculator linked in
+#include "alloc_profiler.h"
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <exception>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+vector<string> split(const string& list){
+	vector<string> items;
+	stringstream in(list);
+	string item;
+	while(getline(in, item, ','))
+		if(!item.empty())
+			items.push_back(item);
+	return items;
+}
+
+bool selected(const vector<string>& filter, const char* value){
+	if(filter.empty())
+		return true;
+	for(const string& f : filter)
+		if(f == value)
+			return true;
+	return false;
+}
+
+void print_usage(const char* program){
+	cerr << "Usage: " << program << " [--scheme BFV,BGV,CKKS] [--library SEAL,HElib,PALISADE]"
+	     << " [--workload Gross_Pay,Luminousity,TotalCovidDeaths] [--trials N] [--warmup N]"
+	     << " [--csv FILE] [--json FILE] [--records N,...] [--ring-dim N,...] [--threads N,...]"
+	     << " [--pool-threads N,...] [--pin] [--verbose] [--list]" << endl;
+}
+
+//Wall time of the phases in the first row of the same calculator, ring
+//and records over this row's, 0 when either failed
+double speedup(const vector<BenchmarkResult>& results, const BenchmarkResult& r, initializer_list<Phase> phases){
+	for(const BenchmarkResult& first : results){
+		if(first.program() != r.program() || first.ring_dimension != r.ring_dimension || first.records != r.records)
+			continue;
+		int64_t base = 0, wall = 0;
+		for(Phase phase : phases){
+			base += first.phases[(int)phase].wall_ns;
+			wall += r.phases[(int)phase].wall_ns;
+		}
+		return first.ok && r.ok && wall > 0 ? (double)base / wall : 0;
+	}
+	return 0;
+}
+
+double encryption_speedup(const vector<BenchmarkResult>& results, const BenchmarkResult& r){
+	return speedup(results, r, { Phase::Encryption });
+}
+
+double pipeline_speedup(const vector<BenchmarkResult>& results, const BenchmarkResult& r){
+	return speedup(results, r, { Phase::Encryption, Phase::Evaluation, Phase::Decryption });
+}
+
+double keygen_speedup(const vector<BenchmarkResult>& results, const BenchmarkResult& r){
+	return speedup(results, r, { Phase::KeyGeneration });
+}
+
+void write_csv(ostream& out, const vector<BenchmarkResult>& results){
+	out << "scheme,library,workload,status,ring_dimension,slot_count,records,chunks,instances,threads,trials";
+	for(int p = 0; p < PHASE_COUNT; p++)
+		out << "," << phase_key((Phase)p) << "_wall_ns";
+	out << ",evaluation_process_cpu_ns,rss_growth_bytes,key_bytes,ciphertext_bytes,ciphertexts"
+	    << ",records_per_s,chunk_latency_ns,rss_bytes_per_record,ciphertext_bytes_per_record,encryption_speedup"
+	    << ",steals,min_utilization,library_threads,pinned,pipeline_speedup,keygen_speedup" << endl;
+
+	for(const BenchmarkResult& r : results){
+		out << r.scheme << "," << r.library << "," << r.workload << "," << (r.ok ? "ok" : "failed") << ","
+		    << r.ring_dimension << "," << r.slot_count << "," << r.records << "," << r.chunks << ","
+		    << r.instances << "," << r.threads << "," << r.trials;
+		for(int p = 0; p < PHASE_COUNT; p++)
+			out << "," << r.phases[p].wall_ns;
+		out << "," << r.phases[(int)Phase::Evaluation].process_cpu_ns << "," << r.rss_growth_bytes << ","
+		    << r.key_bytes << "," << r.ciphertext_bytes << "," << r.ciphertexts << "," << r.records_per_second << ","
+		    << (int64_t)r.chunk_latency_ns << "," << r.rss_bytes_per_record() << "," << r.ciphertext_bytes_per_record() << ","
+		    << encryption_speedup(results, r) << "," << r.steals << "," << r.min_utilization << ","
+		    << r.library_threads << "," << r.pinned << "," << pipeline_speedup(results, r) << ","
+		    << keygen_speedup(results, r) << endl;
+	}
+}
+
+string json_string(const string& value){
+	string escaped = "\"";
+	for(char c : value){
+		if(c == '"' || c == '\\')
+			escaped += '\\';
+		if(c == '\n')
+			escaped += "\\n";
+		else
+			escaped += c;
+	}
+	return escaped + "\"";
+}
+
+void write_json(ostream& out, const vector<BenchmarkResult>& results){
+	out << "[" << endl;
+	for(size_t i = 0; i < results.size(); i++){
+		const BenchmarkResult& r = results[i];
+		out << "  {\"scheme\": " << json_string(r.scheme) << ", \"library\": " << json_string(r.library)
+		    << ", \"workload\": " << json_string(r.workload) << ", \"status\": \"" << (r.ok ? "ok" : "failed") << "\"";
+		if(!r.ok)
+			out << ", \"error\": " << json_string(r.error);
+		out << "," << endl << "   \"ring_dimension\": " << r.ring_dimension << ", \"slot_count\": " << r.slot_count
+		    << ", \"records\": " << r.records << ", \"chunks\": " << r.chunks << ", \"instances\": " << r.instances
+		    << ", \"threads\": " << r.threads << ", \"trials\": " << r.trials << "," << endl << "   \"phases\": {";
+		for(int p = 0; p < PHASE_COUNT; p++){
+			out << (p ? ", " : "") << "\"" << phase_key((Phase)p) << "\": {\"wall_ns\": " << r.phases[p].wall_ns
+			    << ", \"process_cpu_ns\": " << r.phases[p].process_cpu_ns << "}";
+		}
+		out << "}," << endl << "   \"rss_growth_bytes\": " << r.rss_growth_bytes << ", \"key_bytes\": " << r.key_bytes
+		    << ", \"ciphertext_bytes\": " << r.ciphertext_bytes << ", \"ciphertexts\": " << r.ciphertexts << "," << endl
+		    << "   \"records_per_s\": " << r.records_per_second << ", \"chunk_latency_ns\": " << (int64_t)r.chunk_latency_ns
+		    << ", \"rss_bytes_per_record\": " << r.rss_bytes_per_record()
+		    << ", \"ciphertext_bytes_per_record\": " << r.ciphertext_bytes_per_record()
+		    << ", \"encryption_speedup\": " << encryption_speedup(results, r) << "," << endl
+		    << "   \"steals\": " << r.steals << ", \"min_utilization\": " << r.min_utilization
+		    << ", \"library_threads\": " << r.library_threads << ", \"pinned\": " << (r.pinned ? "true" : "false")
+		    << ", \"pipeline_speedup\": " << pipeline_speedup(results, r)
+		    << ", \"keygen_speedup\": " << keygen_speedup(results, r) << "}"
+		    << (i + 1 < results.size() ? "," : "") << endl;
+	}
+	out << "]" << endl;
+}
+
+//Key generation wall time of each calculator, ring and records, one row
+//per thread setting in the order they ran
+void write_keygen_report(ostream& out, const vector<BenchmarkResult>& results){
+	out << "Key generation against cores:" << endl;
+	vector<bool> done(results.size(), false);
+	for(size_t i = 0; i < results.size(); i++){
+		if(done[i])
+			continue;
+		const BenchmarkResult& first = results[i];
+		out << first.program() << " (ring " << first.ring_dimension << ", " << first.records << " records)" << endl;
+		out << setw(10) << "Cores" << setw(8) << "Pool" << setw(16) << "Keygen (ms)" << setw(10) << "Speedup" << endl;
+		for(size_t j = i; j < results.size(); j++){
+			const BenchmarkResult& r = results[j];
+			if(r.program() != first.program() || r.ring_dimension != first.ring_dimension || r.records != first.records)
+				continue;
+			done[j] = true;
+			out << setw(10) << r.threads * r.library_threads << setw(8) << r.threads;
+			if(r.ok){
+				out << fixed << setprecision(3) << setw(16) << r.phases[(int)Phase::KeyGeneration].wall_ns / 1e6
+				    << setprecision(2) << setw(10) << keygen_speedup(results, r) << defaultfloat << endl;
+			}
+			else{
+				out << setw(16) << "failed" << endl;
+			}
+		}
+	}
+}
+
+bool write_file(const string& path, const vector<BenchmarkResult>& results, bool json){
+	ofstream out(path);
+	if(!out){
+		cerr << "Could not open " << path << " for writing" << endl;
+		return false;
+	}
+	if(json)
+		write_json(out, results);
+	else
+		write_csv(out, results);
+	return true;
+}
+
+int main(int argc, char** argv){
+	vector<string> schemes, libraries, workloads;
+	vector<string> record_counts, ring_dimensions, thread_counts, pool_sizes;
+	string csv_path, json_path;
+	bool verbose = false, list = false;
+
+	for(int i = 1; i < argc; i++){
+		string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if(arg == "--scheme" && has_value)
+			schemes = split(argv[++i]);
+		else if(arg == "--library" && has_value)
+			libraries = split(argv[++i]);
+		else if(arg == "--workload" && has_value)
+			workloads = split(argv[++i]);
+		else if(arg == "--trials" && has_value)
+			setenv("FHE_BENCH_TRIALS", argv[++i], 1);
+		else if(arg == "--warmup" && has_value)
+			setenv("FHE_BENCH_WARMUP", argv[++i], 1);
+		else if(arg == "--records" && has_value)
+			record_counts = split(argv[++i]);
+		else if(arg == "--ring-dim" && has_value)
+			ring_dimensions = split(argv[++i]);
+		else if(arg == "--threads" && has_value)
+			thread_counts = split(argv[++i]);
+		else if(arg == "--pool-threads" && has_value)
+			pool_sizes = split(argv[++i]);
+		else if(arg == "--pin")
+			setenv("FHE_PIN", "1", 1);
+		else if(arg == "--csv" && has_value)
+			csv_path = argv[++i];
+		else if(arg == "--json" && has_value)
+			json_path = argv[++i];
+		else if(arg == "--verbose")
+			verbose = true;
+		else if(arg == "--list")
+			list = true;
+		else{
+			print_usage(argv[0]);
+			return 2;
+		}
+	}
+
+	vector<BenchmarkEntry> entries;
+	for(const BenchmarkEntry& e : benchmark_registry()){
+		if(selected(schemes, e.scheme) && selected(libraries, e.library) && selected(workloads, e.workload))
+			entries.push_back(e);
+	}
+	if(list){
+		for(const BenchmarkEntry& e : entries)
+			cout << e.scheme << " " << e.library << " " << e.workload << endl;
+		return 0;
+	}
+	if(entries.empty()){
+		cerr << "No calculator matches the selection" << endl;
+		return 2;
+	}
+
+	//An empty entry keeps FHE_RECORDS / FHE_RING_DIM / FHE_THREADS /
+	//FHE_POOL_THREADS as they are
+	if(record_counts.empty())
+		record_counts.push_back("");
+	if(ring_dimensions.empty())
+		ring_dimensions.push_back("");
+	if(thread_counts.empty())
+		thread_counts.push_back("");
+	if(pool_sizes.empty())
+		pool_sizes.push_back("");
+
+	vector<BenchmarkResult> results;
+	ofstream discard;
+	int failures = 0;
+	for(const string& ring_dimension : ring_dimensions){
+		if(!ring_dimension.empty())
+			setenv("FHE_RING_DIM", ring_dimension.c_str(), 1);
+		for(const string& records : record_counts){
+			if(!records.empty())
+				setenv("FHE_RECORDS", records.c_str(), 1);
+			for(const string& threads : thread_counts){
+				if(!threads.empty())
+					setenv("FHE_THREADS", threads.c_str(), 1);
+				for(const string& pool_threads : pool_sizes){
+					if(!pool_threads.empty())
+						setenv("FHE_POOL_THREADS", pool_threads.c_str(), 1);
+					for(const BenchmarkEntry& e : entries){
+						BenchmarkResult result;
+						result.scheme = e.scheme;
+						result.library = e.library;
+						result.workload = e.workload;
+						//What was asked for, run() overwrites them with what it used
+						result.ring_dimension = atol(ring_dimension.c_str());
+						result.records = atol(records.c_str());
+						cerr << "Running " << result.program();
+						if(!ring_dimension.empty())
+							cerr << " ring " << ring_dimension;
+						if(!records.empty())
+							cerr << " records " << records;
+						if(!threads.empty())
+							cerr << " threads " << threads;
+						if(!pool_threads.empty())
+							cerr << " pool " << pool_threads;
+						cerr << "..." << endl;
+
+						streambuf* stdout_buffer = cout.rdbuf();
+						if(!verbose)
+							cout.rdbuf(discard.rdbuf());
+						try{
+							if(e.run(result) != 0 && result.error.empty())
+								result.error = "non-zero exit status";
+						}
+						catch(const exception& ex){
+							result.error = ex.what();
+						}
+						cout.rdbuf(stdout_buffer);
+						cout.clear(); //writes to the discarded buffer set failbit
+
+						if(!result.error.empty()){
+							result.ok = false;
+							failures++;
+							cerr << result.program() << " failed: " << result.error << endl;
+						}
+						results.push_back(result);
+					}
+				}
+			}
+		}
+	}
+
+	bool written = true;
+	if(!csv_path.empty())
+		written = write_file(csv_path, results, false) && written;
+	if(!json_path.empty())
+		written = write_file(json_path, results, true) && written;
+	if(csv_path.empty() && json_path.empty())
+		write_csv(cout, results);
+	if(thread_counts.size() > 1 || pool_sizes.size() > 1)
+		write_keygen_report(cerr, results);
+
+	return failures == 0 && written ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+/****************************************************************/
+/* Registry of the calculators for the benchmark driver         */
+/* Author: Majdi Maalej                                         */
+/* Every calculator is a run() function filling a               */
+/* BenchmarkResult. Built with -DFHE_BENCH_DRIVER the files     */
+/* register run() with the driver (benchmark_driver.cpp),       */
+/* otherwise each one keeps its own main().                     */
+/****************************************************************/
+#ifndef BENCHMARK_REGISTRY_H
+#define BENCHMARK_REGISTRY_H
+
+#include "phase_profiler.h"
+#include "benchmark.h"
+#include "memory_profiler.h"
+#include "thread_pool.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct BenchmarkResult{
+	std::string scheme;
+	std::string library;
+	std::string workload;
+	bool ok = false;
+	std::string error;
+	long ring_dimension = 0;
+	long slot_count = 0;
+	long instances = 0;             //records per chunk
+	long records = 0;
+	long chunks = 0;
+	int threads = 1;                //thread pool size (thread_pool.h)
+	int library_threads = 1;        //inside each library operation
+	bool pinned = false;
+	long steals = 0;
+	double min_utilization = 0;     //of the least busy pool thread
+	size_t trials = 0;
+	PhaseTimes phases[PHASE_COUNT]; //mean over the trials
+	int64_t rss_growth_bytes = 0;   //RSS after the last phase minus RSS at start
+	int64_t key_bytes = 0;
+	int64_t ciphertext_bytes = 0;   //per ciphertext
+	long ciphertexts = 0;
+	double records_per_second = 0;
+	double chunk_latency_ns = 0;
+
+	std::string program() const{
+		return scheme + "_" + library + "_" + workload;
+	}
+
+	//Only the ciphertexts of one chunk are live at a time
+	int64_t ciphertext_bytes_per_record() const{
+		return instances > 0 ? ciphertext_bytes * ciphertexts / instances : 0;
+	}
+
+	int64_t rss_bytes_per_record() const{
+		return records > 0 ? rss_growth_bytes / records : 0;
+	}
+
+	void record(const Benchmark& benchmark, const MemoryProfiler& memory){
+		const PhaseProfiler& profiler = benchmark.profiler();
+		trials = profiler.samples(Phase::Evaluation).size();
+		for(int p = 0; p < PHASE_COUNT; p++)
+			phases[p] = profiler.times((Phase)p);
+		records = benchmark.records();
+		chunks = benchmark.chunks();
+		records_per_second = benchmark.records_per_second();
+		chunk_latency_ns = benchmark.chunk_latency_ns();
+
+		int64_t last_rss = memory.baseline().rss_bytes;
+		for(int p = 0; p < PHASE_COUNT; p++){
+			if(memory.phase((Phase)p).seen)
+				last_rss = memory.phase((Phase)p).after.rss_bytes;
+		}
+		rss_growth_bytes = last_rss - memory.baseline().rss_bytes;
+
+		for(const ObjectMemory& o : memory.objects()){
+			if(o.kind.find("key") != std::string::npos)
+				key_bytes += o.bytes;
+			else if(o.kind == "ciphertext"){
+				ciphertexts = o.count;
+				ciphertext_bytes = o.bytes / o.count;
+			}
+		}
+		ok = true;
+	}
+
+	ProfileConfiguration configuration() const{
+		return ProfileConfiguration{ ring_dimension, records, threads, library_threads };
+	}
+
+	void record_pool(const ThreadPool& pool){
+		threads = pool.size();
+		pinned = pool.pinned();
+		steals = pool.steals();
+		min_utilization = pool.min_utilization();
+	}
+};
+
+typedef int (*BenchmarkFunction)(BenchmarkResult& result);
+
+struct BenchmarkEntry{
+	const char* scheme;
+	const char* library;
+	const char* workload;
+	BenchmarkFunction run;
+};
+
+inline std::vector<BenchmarkEntry>& benchmark_registry(){
+	static std::vector<BenchmarkEntry> registry;
+	return registry;
+}
+
+struct BenchmarkRegistrar{
+	BenchmarkRegistrar(const char* scheme, const char* library, const char* workload, BenchmarkFunction run){
+		benchmark_registry().push_back(BenchmarkEntry{ scheme, library, workload, run });
+	}
+};
+
+#define REGISTER_BENCHMARK(scheme, library, workload, function) \
+	static BenchmarkRegistrar benchmark_registrar(#scheme, #library, #workload, function);
+
+#endif
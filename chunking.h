@@ -0,0 +1,66 @@
+/****************************************************************/
+/* Chunking of columns longer than one ciphertext               */
+/* Author: Majdi Maalej                                         */
+/* A ChunkLayout splits columns of any number of records into   */
+/* blocks of at most one ciphertext's slots. slice() gives the  */
+/* records of a block to encrypt, first() and size() where its  */
+/* decrypted slots go in an output column, so the outputs come  */
+/* out in the order of the inputs whatever order the blocks     */
+/* ran in.                                                      */
+/* Blocks are independent: serve() (workload_runtime.h) runs as */
+/* many at a time as the thread pool has threads.               */
+/****************************************************************/
+#ifndef CHUNKING_H
+#define CHUNKING_H
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+class ChunkLayout{
+public:
+	ChunkLayout(long records, long capacity) : records_(records), capacity_(capacity){
+		if(records < 1 || capacity < 1)
+			throw std::invalid_argument("chunks need at least one record and one slot");
+	}
+
+	long records() const{
+		return records_;
+	}
+
+	//Records per full chunk
+	long capacity() const{
+		return capacity_;
+	}
+
+	long chunks() const{
+		return (records_ + capacity_ - 1) / capacity_;
+	}
+
+	long first(long chunk) const{
+		return chunk * capacity_;
+	}
+
+	//Only the last chunk can be shorter
+	long size(long chunk) const{
+		return std::min(capacity_, records_ - first(chunk));
+	}
+
+	template<typename T>
+	std::vector<T> slice(const std::vector<T>& column, long chunk) const{
+		check(column, chunk);
+		return std::vector<T>(column.begin() + first(chunk), column.begin() + first(chunk) + size(chunk));
+	}
+
+private:
+	template<typename T>
+	void check(const std::vector<T>& column, long chunk) const{
+		if(chunk < 0 || chunk >= chunks() || (long)column.size() != records_)
+			throw std::out_of_range("the column or the chunk does not match the layout");
+	}
+
+	long records_;
+	long capacity_;
+};
+
+#endif
@@ -0,0 +1,791 @@
+/****************************************************************/
+/* Expression graphs of the workload formulas                   */
+/* Author: Majdi Maalej                                         */
+/* A workload is written as a formula over its input            */
+/* ciphertexts with + and *, and compile() derives the order of */
+/* evaluation instead of the calculator sequencing it by hand:  */
+/*  - repeated subexpressions are computed once                 */
+/*  - chains of products are rebuilt from squares and a         */
+/*    balanced tree, for the minimum multiplicative depth       */
+/*  - a product is relinearized only when it is multiplied      */
+/*    again or returned, so a sum of products shares one        */
+/*    key switch                                                */
+/*  - only the operands of a multiplication are rescaled, and   */
+/*    operands left at different levels are switched down to a  */
+/*    common one; plans for a backend that is not levelled      */
+/*    (BFV, or a library that does it itself) leave both out    */
+/*  - chains of sums are rebuilt as a balanced tree of          */
+/*    pairwise additions, so n terms take log2(n) rounds, and   */
+/*    accumulate in place in their destination. A tree of three */
+/*    or more terms runs as one n-ary addition (add_many) of    */
+/*    them, the library's fused one where there is one          */
+/*  - constants are folded: products with a one and sums with   */
+/*    a zero leave it out, a product with a zero is zero. A     */
+/*    constant left over has no step to run it and is refused.  */
+/*    The plan counts what was folded and the levels saved.     */
+/* execute() runs the compiled plan on any backend              */
+/* (fhe_backend.h). Given a thread pool (thread_pool.h) it runs */
+/* the plan stage by stage: the steps of a stage touch none of  */
+/* the ciphertexts the others write, like the two products of   */
+/* a sum of products, and run at the same time.                 */
+/****************************************************************/
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include "fhe_backend.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+enum class ExprOp { Input, Constant, Add, Multiply };
+
+struct ExprNode{
+	ExprOp op = ExprOp::Input;
+	int a = -1;     //operands, in the order they were written
+	int b = -1;
+	int input = -1; //index of the input ciphertext
+	double value = 0; //of a constant
+	int depth = 0;  //multiplicative depth
+};
+
+//A formula output stored in the caller's ciphertext number slot
+struct ExprBinding{
+	int slot = 0;
+	int node = 0;
+	bool result = false; //false: an intermediate kept for the size reports
+};
+
+class ExpressionGraph;
+
+class Expr{
+public:
+	Expr(){}
+	Expr(ExpressionGraph* graph, int id) : graph_(graph), id_(id){}
+
+	ExpressionGraph* graph() const{
+		return graph_;
+	}
+
+	int id() const{
+		return id_;
+	}
+
+private:
+	ExpressionGraph* graph_ = nullptr;
+	int id_ = -1;
+};
+
+class ExpressionGraph{
+public:
+	Expr input(int index){
+		ExprNode n;
+		n.input = index;
+		inputs_ = std::max(inputs_, index + 1);
+		return Expr(this, intern(n));
+	}
+
+	//A plain value in every slot, folded away by the compiler
+	Expr constant(double value){
+		ExprNode n;
+		n.op = ExprOp::Constant;
+		n.value = value;
+		return Expr(this, intern(n));
+	}
+
+	Expr add(Expr a, Expr b){
+		return binary(ExprOp::Add, a.id(), b.id());
+	}
+
+	Expr multiply(Expr a, Expr b){
+		return binary(ExprOp::Multiply, a.id(), b.id());
+	}
+
+	//Stores an intermediate in the caller's ciphertext, as it is when the plan ends
+	void keep(int slot, Expr e){
+		bind(slot, e, false);
+	}
+
+	//Stores a result, relinearized, in the caller's ciphertext
+	void result(int slot, Expr e){
+		bind(slot, e, true);
+	}
+
+	const std::vector<ExprNode>& nodes() const{
+		return nodes_;
+	}
+
+	const std::vector<ExprBinding>& bindings() const{
+		return bindings_;
+	}
+
+	int inputs() const{
+		return inputs_;
+	}
+
+	int outputs() const{
+		return outputs_;
+	}
+
+	Expr binary(ExprOp op, int a, int b){
+		ExprNode n;
+		n.op = op;
+		n.a = a;
+		n.b = b;
+		n.depth = std::max(nodes_[a].depth, nodes_[b].depth) + (op == ExprOp::Multiply ? 1 : 0);
+		return Expr(this, intern(n));
+	}
+
+private:
+	//Operands are looked up unordered, so a*b and b*a are the same node
+	int intern(const ExprNode& n){
+		auto key = std::make_tuple((int)n.op, std::min(n.a, n.b), std::max(n.a, n.b), n.input, n.value);
+		auto found = index_.find(key);
+		if(found != index_.end())
+			return found->second;
+		nodes_.push_back(n);
+		index_[key] = (int)nodes_.size() - 1;
+		return (int)nodes_.size() - 1;
+	}
+
+	void bind(int slot, Expr e, bool result){
+		ExprBinding binding;
+		binding.slot = slot;
+		binding.node = e.id();
+		binding.result = result;
+		bindings_.push_back(binding);
+		outputs_ = std::max(outputs_, slot + 1);
+	}
+
+	std::vector<ExprNode> nodes_;
+	std::map<std::tuple<int, int, int, int, double>, int> index_;
+	std::vector<ExprBinding> bindings_;
+	int inputs_ = 0;
+	int outputs_ = 0;
+};
+
+inline Expr operator+(Expr a, Expr b){
+	return a.graph()->add(a, b);
+}
+
+inline Expr operator*(Expr a, Expr b){
+	return a.graph()->multiply(a, b);
+}
+
+//The formula on plain values, one per input, returned in slot order. The
+//reference a decrypted result is checked against.
+template<typename T>
+std::vector<T> evaluate(const ExpressionGraph& graph, const std::vector<T>& inputs){
+	const std::vector<ExprNode>& nodes = graph.nodes();
+	std::vector<T> values(nodes.size());
+	for(size_t id = 0; id < nodes.size(); id++){
+		const ExprNode& n = nodes[id];
+		if(n.op == ExprOp::Input)
+			values[id] = inputs[n.input];
+		else if(n.op == ExprOp::Constant)
+			values[id] = T(n.value);
+		else if(n.op == ExprOp::Add)
+			values[id] = values[n.a] + values[n.b];
+		else
+			values[id] = values[n.a] * values[n.b];
+	}
+	std::vector<T> outputs(graph.outputs());
+	for(const ExprBinding& binding : graph.bindings())
+		outputs[binding.slot] = values[binding.node];
+	return outputs;
+}
+
+enum class StepOp { Copy, Add, AddInplace, AddMany, Multiply, Square, Relinearize, Rescale, Align };
+
+//Slots number the inputs first, then the outputs, then the temporaries
+struct PlanStep{
+	StepOp op;
+	int destination;
+	int a;
+	int b;
+	std::vector<int> terms = {}; //of an AddMany
+};
+
+struct Plan{
+	int inputs = 0;
+	int outputs = 0;
+	int temporaries = 0;
+	std::vector<PlanStep> steps;
+	std::vector<std::vector<int>> stages; //indices of the steps that can run at the same time, in order
+	int depth = 0;
+	int products = 0;
+	int squares = 0;
+	int additions = 0;
+	int sums = 0;             //AddMany steps, their additions counted in additions
+	int relinearizations = 0;
+	int rescales = 0;
+	int level_switches = 0;
+	int folded_products = 0;  //by one or zero, or of constants, left out of the steps
+	int folded_additions = 0; //of zero, or of constants
+	int levels_saved = 0;     //depth of the plan compiled with the constants left in, less this one's
+};
+
+inline std::ostream& operator<<(std::ostream& out, const Plan& plan){
+	out << "depth " << plan.depth << ", " << plan.products << " products (" << plan.squares << " squares), "
+	    << plan.additions << " additions";
+	if(plan.sums > 0)
+		out << " (" << plan.sums << " n-ary)";
+	out << ", " << plan.relinearizations << " relinearizations, "
+	    << plan.rescales << " rescales, " << plan.level_switches << " level switches";
+	if(plan.folded_products + plan.folded_additions > 0){
+		out << ", folded " << plan.folded_products << " products and " << plan.folded_additions << " additions ("
+		    << plan.levels_saved << " levels saved)";
+	}
+	return out;
+}
+
+class ExpressionCompiler{
+public:
+	//folds false keeps the constants as factors and terms, only to measure
+	//the depth folding saves (result_depth())
+	ExpressionCompiler(const ExpressionGraph& source, bool levelled, bool folds = true)
+		: source_(source), levelled_(levelled), folds_(folds){
+		const std::vector<ExprNode>& nodes = source_.nodes();
+		std::vector<int> uses(nodes.size(), 0);
+		for(const ExprNode& n : nodes){
+			if(n.op == ExprOp::Add || n.op == ExprOp::Multiply){
+				uses[n.a]++;
+				uses[n.b]++;
+			}
+		}
+		//Shared and bound nodes are kept as they are written
+		anchored_.assign(nodes.size(), false);
+		for(size_t id = 0; id < nodes.size(); id++)
+			anchored_[id] = uses[id] > 1;
+		for(const ExprBinding& binding : source_.bindings())
+			anchored_[binding.node] = true;
+	}
+
+	Plan compile(){
+		for(const ExprBinding& binding : source_.bindings()){
+			ExprBinding rewritten = binding;
+			rewritten.node = rewrite(binding.node);
+			if(graph_.nodes()[rewritten.node].op == ExprOp::Constant)
+				throw std::invalid_argument("output " + std::to_string(binding.slot)
+				                            + " folds to a constant, a plan only returns ciphertexts");
+			bindings_.push_back(rewritten);
+		}
+		Plan plan = schedule();
+		plan.folded_products = folded_products_;
+		plan.folded_additions = folded_additions_;
+		//Against the same rewrite with the constants left in, so the depth the
+		//balanced products save on their own is not counted
+		if(folded_products_ > 0)
+			plan.levels_saved = ExpressionCompiler(source_, levelled_, false).result_depth() - plan.depth;
+		return plan;
+	}
+
+	//Multiplicative depth of the rewritten results
+	int result_depth(){
+		int depth = 0;
+		for(const ExprBinding& binding : source_.bindings()){
+			if(binding.result)
+				depth = std::max(depth, graph_.nodes()[rewrite(binding.node)].depth);
+		}
+		return depth;
+	}
+
+private:
+	//Rebuilds a node of the source graph in graph_
+	int rewrite(int id){
+		auto done = rewritten_.find(id);
+		if(done != rewritten_.end())
+			return done->second;
+
+		const ExprNode& n = source_.nodes()[id];
+		int result;
+		if(n.op == ExprOp::Input){
+			result = graph_.input(n.input).id();
+		}
+		else if(n.op == ExprOp::Constant){
+			result = graph_.constant(n.value).id();
+		}
+		else{
+			std::vector<int> leaves;
+			flatten(id, n.op, id, leaves);
+			for(int& leaf : leaves)
+				leaf = rewrite(leaf);
+			result = fold(n.op, leaves);
+		}
+		rewritten_[id] = result;
+		return result;
+	}
+
+	//Operands of a chain of the same operation, down to anchored nodes
+	void flatten(int id, ExprOp op, int root, std::vector<int>& leaves) const{
+		const ExprNode& n = source_.nodes()[id];
+		if(n.op != op || (id != root && anchored_[id])){
+			leaves.push_back(id);
+			return;
+		}
+		flatten(n.a, op, root, leaves);
+		flatten(n.b, op, root, leaves);
+	}
+
+	//Combines the constant leaves of a chain of one operation. A product
+	//with a zero is zero and one of constants only is a constant, otherwise
+	//the constants have to come to the identity and are left out.
+	int fold(ExprOp op, const std::vector<int>& leaves){
+		bool product = op == ExprOp::Multiply;
+		if(!folds_)
+			return product ? balanced_product(leaves) : balanced_sum(leaves);
+		double identity = product ? 1 : 0;
+		double constant = identity;
+		std::vector<int> operands;
+		for(int leaf : leaves){
+			const ExprNode& n = graph_.nodes()[leaf];
+			if(n.op != ExprOp::Constant)
+				operands.push_back(leaf);
+			else if(product)
+				constant *= n.value;
+			else
+				constant += n.value;
+		}
+		int& folded = product ? folded_products_ : folded_additions_;
+		if(operands.empty() || (product && constant == 0)){
+			folded += (int)leaves.size() - 1;
+			return graph_.constant(operands.empty() ? constant : 0).id();
+		}
+		if(constant != identity)
+			throw std::invalid_argument(std::string(product ? "a product with " : "a sum with ") + std::to_string(constant)
+			                            + ": a plan has no step for a plain constant");
+		folded += (int)(leaves.size() - operands.size());
+		return product ? balanced_product(operands) : balanced_sum(operands);
+	}
+
+	//Squares every factor that appears twice, then multiplies the two
+	//shallowest factors until one is left
+	int balanced_product(std::vector<int> factors){
+		bool squared = true;
+		while(squared){
+			squared = false;
+			std::sort(factors.begin(), factors.end());
+			for(size_t i = 0; i + 1 < factors.size(); i++){
+				if(factors[i] == factors[i + 1]){
+					int square = graph_.binary(ExprOp::Multiply, factors[i], factors[i]).id();
+					factors.erase(factors.begin() + i, factors.begin() + i + 2);
+					factors.push_back(square);
+					squared = true;
+					break;
+				}
+			}
+		}
+		const std::vector<ExprNode>& nodes = graph_.nodes();
+		while(factors.size() > 1){
+			std::sort(factors.begin(), factors.end(), [&](int x, int y){
+				return nodes[x].depth != nodes[y].depth ? nodes[x].depth < nodes[y].depth : x < y;
+			});
+			int product = graph_.binary(ExprOp::Multiply, factors[0], factors[1]).id();
+			factors.erase(factors.begin(), factors.begin() + 2);
+			factors.push_back(product);
+		}
+		return factors.front();
+	}
+
+	//Adds neighbouring terms pairwise until one is left. The additions of a
+	//round are independent, the terms keep the order of the formula.
+	int balanced_sum(std::vector<int> terms){
+		while(terms.size() > 1){
+			std::vector<int> sums;
+			for(size_t i = 0; i + 1 < terms.size(); i += 2)
+				sums.push_back(graph_.binary(ExprOp::Add, terms[i], terms[i + 1]).id());
+			if(terms.size() % 2 == 1)
+				sums.push_back(terms.back());
+			terms.swap(sums);
+		}
+		return terms.front();
+	}
+
+	Plan schedule(){
+		const std::vector<ExprNode>& nodes = graph_.nodes();
+		int count = (int)nodes.size();
+		Plan plan;
+		plan.inputs = source_.inputs();
+		plan.outputs = source_.outputs();
+
+		std::vector<bool> live(count, false);
+		std::vector<bool> result(count, false);
+		for(const ExprBinding& binding : bindings_){
+			live[binding.node] = true;
+			if(binding.result)
+				result[binding.node] = true;
+		}
+		std::vector<int> consumers(count, 0);
+		std::vector<int> consumer(count, -1);
+		std::vector<bool> multiplied(count, false);
+		for(int id = count - 1; id >= 0; id--){
+			const ExprNode& n = nodes[id];
+			if(!live[id] || n.op == ExprOp::Input)
+				continue;
+			for(int operand : { n.a, n.b }){
+				live[operand] = true;
+				consumers[operand]++;
+				consumer[operand] = id;
+				if(n.op == ExprOp::Multiply)
+					multiplied[operand] = true;
+				if(n.a == n.b)
+					break;
+			}
+		}
+
+		//A balanced sum of three or more terms is one AddMany over the terms:
+		//its inner additions, used only by the next one up, get no step
+		std::vector<bool> bound(count, false);
+		for(const ExprBinding& binding : bindings_)
+			bound[binding.node] = true;
+		auto pairwise = [&](int id){
+			return nodes[id].op == ExprOp::Add && nodes[id].a != nodes[id].b;
+		};
+		std::vector<bool> inner(count, false);
+		for(int id = 0; id < count; id++){
+			int c = consumer[id];
+			inner[id] = live[id] && pairwise(id) && !bound[id] && consumers[id] == 1 && pairwise(c);
+		}
+		std::vector<std::vector<int>> terms(count);
+		for(int id = 0; id < count; id++){
+			if(!live[id] || !pairwise(id) || inner[id])
+				continue;
+			std::vector<int> pending = { nodes[id].b, nodes[id].a };
+			while(!pending.empty()){
+				int term = pending.back();
+				pending.pop_back();
+				if(inner[term]){
+					pending.push_back(nodes[term].b);
+					pending.push_back(nodes[term].a);
+				}
+				else{
+					terms[id].push_back(term);
+				}
+			}
+			if(terms[id].size() < 3)
+				terms[id].clear();
+		}
+
+		//Inputs and bound nodes have their slots, a node only used by one
+		//addition accumulates in the slot of that addition
+		std::vector<int> slot(count, -1);
+		std::vector<bool> accumulates(count, false);
+		for(int id = 0; id < count; id++){
+			if(nodes[id].op == ExprOp::Input)
+				slot[id] = nodes[id].input;
+		}
+		std::vector<std::pair<int, int>> copies;
+		for(const ExprBinding& binding : bindings_){
+			int output = plan.inputs + binding.slot;
+			if(slot[binding.node] == -1)
+				slot[binding.node] = output;
+			else
+				copies.push_back(std::make_pair(output, binding.node));
+		}
+		for(int id = count - 1; id >= 0; id--){
+			if(!live[id] || inner[id] || slot[id] != -1)
+				continue;
+			int c = consumer[id];
+			if(consumers[id] == 1 && pairwise(c) && !inner[c] && terms[c].empty() && !accumulates[c]){
+				slot[id] = slot[c];
+				accumulates[c] = true;
+			}
+			else{
+				slot[id] = plan.inputs + plan.outputs + plan.temporaries++;
+			}
+		}
+
+		//Rescales done on the way to a node, and whether it still needs relinearizing
+		std::vector<int> level(count, 0);
+		std::vector<bool> unrelinearized(count, false);
+		for(int id = 0; id < count; id++){
+			const ExprNode& n = nodes[id];
+			if(!live[id] || inner[id] || n.op == ExprOp::Input)
+				continue;
+			int destination = slot[id];
+			if(!terms[id].empty()){
+				//Terms left at fewer rescales are switched down to the most
+				int top = terms[id].front();
+				for(int term : terms[id]){
+					if(level[term] > level[top])
+						top = term;
+				}
+				PlanStep sum{ StepOp::AddMany, destination, -1, -1 };
+				for(int term : terms[id]){
+					int term_slot = slot[term];
+					if(level[term] < level[top]){
+						if(nodes[term].op == ExprOp::Input){
+							int copy = plan.inputs + plan.outputs + plan.temporaries++;
+							plan.steps.push_back(PlanStep{ StepOp::Copy, copy, term_slot, -1 });
+							term_slot = copy;
+						}
+						plan.steps.push_back(PlanStep{ StepOp::Align, -1, term_slot, slot[top] });
+						plan.level_switches++;
+						if(nodes[term].op != ExprOp::Input)
+							level[term] = level[top];
+					}
+					sum.terms.push_back(term_slot);
+					unrelinearized[id] = unrelinearized[id] || unrelinearized[term];
+				}
+				plan.steps.push_back(sum);
+				level[id] = level[top];
+				plan.additions += (int)terms[id].size() - 1;
+				plan.sums++;
+			}
+			else{
+				int a = slot[n.a];
+				int b = slot[n.b];
+				if(level[n.a] != level[n.b]){
+					//The operand with fewer rescales is switched down, inputs on a copy
+					int lower = level[n.a] < level[n.b] ? n.a : n.b;
+					int& lower_slot = lower == n.a ? a : b;
+					if(nodes[lower].op == ExprOp::Input){
+						int copy = plan.inputs + plan.outputs + plan.temporaries++;
+						plan.steps.push_back(PlanStep{ StepOp::Copy, copy, lower_slot, -1 });
+						lower_slot = copy;
+					}
+					plan.steps.push_back(PlanStep{ StepOp::Align, -1, a, b });
+					plan.level_switches++;
+					if(nodes[lower].op != ExprOp::Input)
+						level[lower] = std::max(level[n.a], level[n.b]);
+				}
+				level[id] = std::max(level[n.a], level[n.b]);
+
+				if(n.op == ExprOp::Add){
+					if(destination == a)
+						plan.steps.push_back(PlanStep{ StepOp::AddInplace, destination, b, -1 });
+					else if(destination == b)
+						plan.steps.push_back(PlanStep{ StepOp::AddInplace, destination, a, -1 });
+					else
+						plan.steps.push_back(PlanStep{ StepOp::Add, destination, a, b });
+					unrelinearized[id] = unrelinearized[n.a] || unrelinearized[n.b];
+					plan.additions++;
+				}
+				else{
+					if(n.a == n.b){
+						plan.steps.push_back(PlanStep{ StepOp::Square, destination, a, -1 });
+						plan.squares++;
+					}
+					else{
+						plan.steps.push_back(PlanStep{ StepOp::Multiply, destination, a, b });
+					}
+					unrelinearized[id] = true;
+					plan.products++;
+				}
+			}
+
+			if(unrelinearized[id] && (multiplied[id] || result[id])){
+				plan.steps.push_back(PlanStep{ StepOp::Relinearize, destination, -1, -1 });
+				unrelinearized[id] = false;
+				plan.relinearizations++;
+			}
+			if(levelled_ && multiplied[id]){
+				plan.steps.push_back(PlanStep{ StepOp::Rescale, destination, -1, -1 });
+				level[id]++;
+				plan.rescales++;
+			}
+			if(result[id])
+				plan.depth = std::max(plan.depth, n.depth);
+		}
+
+		//A node bound twice, or an input returned as it is
+		for(const std::pair<int, int>& copy : copies)
+			plan.steps.push_back(PlanStep{ StepOp::Copy, copy.first, slot[copy.second], -1 });
+		stage(plan);
+		return plan;
+	}
+
+	//A step goes after the last step that writes a slot it uses and after
+	//the last step that reads a slot it writes
+	static void stage(Plan& plan){
+		int slots = plan.inputs + plan.outputs + plan.temporaries;
+		std::vector<int> last_write(slots, -1);
+		std::vector<int> last_read(slots, -1);
+		for(int i = 0; i < (int)plan.steps.size(); i++){
+			const PlanStep& step = plan.steps[i];
+			std::vector<int> reads, writes;
+			switch(step.op){
+				case StepOp::Copy:
+				case StepOp::Square:
+					reads = { step.a };
+					writes = { step.destination };
+					break;
+				case StepOp::Add:
+				case StepOp::Multiply:
+					reads = { step.a, step.b };
+					writes = { step.destination };
+					break;
+				case StepOp::AddInplace:
+					reads = { step.destination, step.a };
+					writes = { step.destination };
+					break;
+				case StepOp::AddMany:
+					reads = step.terms;
+					writes = { step.destination };
+					break;
+				case StepOp::Relinearize:
+				case StepOp::Rescale:
+					reads = writes = { step.destination };
+					break;
+				case StepOp::Align:
+					reads = writes = { step.a, step.b };
+					break;
+			}
+			int stage = 0;
+			for(int s : reads)
+				stage = std::max(stage, last_write[s] + 1);
+			for(int s : writes)
+				stage = std::max(stage, std::max(last_write[s], last_read[s]) + 1);
+			for(int s : reads)
+				last_read[s] = std::max(last_read[s], stage);
+			for(int s : writes)
+				last_write[s] = stage;
+			if(stage == (int)plan.stages.size())
+				plan.stages.emplace_back();
+			plan.stages[stage].push_back(i);
+		}
+	}
+
+	const ExpressionGraph& source_;
+	bool levelled_;
+	bool folds_;
+	std::vector<bool> anchored_;
+	ExpressionGraph graph_;
+	std::map<int, int> rewritten_;
+	std::vector<ExprBinding> bindings_;
+	int folded_products_ = 0;
+	int folded_additions_ = 0;
+};
+
+inline Plan compile(const ExpressionGraph& graph, bool levelled = true){
+	return ExpressionCompiler(graph, levelled).compile();
+}
+
+//The slots of one run of a plan. Steps that write different slots can run
+//at the same time, a temporary is only created by the step writing it.
+template<typename Backend>
+class PlanExecution{
+public:
+	typedef BackendCiphertext<Backend> Ciphertext;
+
+	PlanExecution(const Plan& plan, Backend& he, const std::vector<const Ciphertext*>& inputs,
+	              const std::vector<Ciphertext*>& outputs)
+		: plan_(plan), he_(he), in_(inputs), out_(outputs), temporaries_(plan.temporaries){
+		static_assert(is_fhe_backend<Backend>::value, "execute needs a backend as described in fhe_backend.h");
+		if((int)inputs.size() != plan.inputs || (int)outputs.size() != plan.outputs)
+			throw std::invalid_argument("the plan takes " + std::to_string(plan.inputs) + " inputs and "
+			                            + std::to_string(plan.outputs) + " outputs");
+	}
+
+	void run(const PlanStep& step){
+		switch(step.op){
+			case StepOp::Copy:
+				write(step.destination, read(step.a)) = read(step.a);
+				break;
+			case StepOp::Add:
+				he_.add(read(step.a), read(step.b), write(step.destination, read(step.a)));
+				break;
+			case StepOp::AddInplace:
+				he_.add_inplace(written(step.destination), read(step.a));
+				break;
+			case StepOp::AddMany:{
+				std::vector<const Ciphertext*> terms;
+				for(int term : step.terms)
+					terms.push_back(&read(term));
+				he_.add_many(terms, write(step.destination, *terms.front()));
+				break;
+			}
+			case StepOp::Multiply:
+				he_.multiply(read(step.a), read(step.b), write(step.destination, read(step.a)));
+				break;
+			case StepOp::Square:
+				he_.square(read(step.a), write(step.destination, read(step.a)));
+				break;
+			case StepOp::Relinearize:
+				he_.relinearize(written(step.destination));
+				break;
+			case StepOp::Rescale:
+				he_.rescale(written(step.destination));
+				break;
+			case StepOp::Align:
+				he_.align(written(step.a), written(step.b));
+				break;
+		}
+	}
+
+private:
+	const Ciphertext& read(int slot){
+		if(slot < plan_.inputs)
+			return *in_[slot];
+		if(slot < plan_.inputs + plan_.outputs)
+			return *out_[slot - plan_.inputs];
+		return *temporaries_[slot - plan_.inputs - plan_.outputs];
+	}
+
+	//Only outputs and temporaries are written. HElib ciphertexts have no
+	//default constructor, a temporary starts as a copy of the first operand.
+	Ciphertext& write(int slot, const Ciphertext& like){
+		if(slot < plan_.inputs + plan_.outputs)
+			return *out_[slot - plan_.inputs];
+		std::optional<Ciphertext>& temporary = temporaries_[slot - plan_.inputs - plan_.outputs];
+		if(!temporary){
+			if constexpr(std::is_default_constructible<Ciphertext>::value)
+				temporary.emplace();
+			else
+				temporary.emplace(like);
+		}
+		return *temporary;
+	}
+
+	Ciphertext& written(int slot){
+		return write(slot, read(slot));
+	}
+
+	const Plan& plan_;
+	Backend& he_;
+	const std::vector<const Ciphertext*>& in_;
+	const std::vector<Ciphertext*>& out_;
+	std::vector<std::optional<Ciphertext>> temporaries_;
+};
+
+//Runs the plan with the inputs and outputs in slot order
+template<typename Backend>
+void execute(const Plan& plan, Backend& he, const std::vector<const BackendCiphertext<Backend>*>& inputs,
+             const std::vector<BackendCiphertext<Backend>*>& outputs){
+	PlanExecution<Backend> execution(plan, he, inputs, outputs);
+	for(const PlanStep& step : plan.steps)
+		execution.run(step);
+}
+
+//Runs the steps of each stage at the same time on the pool, the backend
+//has to allow operations on different ciphertexts from several threads
+template<typename Backend>
+void execute(const Plan& plan, Backend& he, const std::vector<const BackendCiphertext<Backend>*>& inputs,
+             const std::vector<BackendCiphertext<Backend>*>& outputs, ThreadPool& pool){
+	PlanExecution<Backend> execution(plan, he, inputs, outputs);
+	for(const std::vector<int>& stage : plan.stages)
+		pool.parallel_for(stage.size(), [&](size_t i){ execution.run(plan.steps[stage[i]]); });
+}
+
+template<typename Backend>
+void execute(const Plan& plan, Backend& he, std::initializer_list<const BackendCiphertext<Backend>*> inputs,
+             std::initializer_list<BackendCiphertext<Backend>*> outputs){
+	execute(plan, he, std::vector<const BackendCiphertext<Backend>*>(inputs),
+	        std::vector<BackendCiphertext<Backend>*>(outputs));
+}
+
+template<typename Backend>
+void execute(const Plan& plan, Backend& he, std::initializer_list<const BackendCiphertext<Backend>*> inputs,
+             std::initializer_list<BackendCiphertext<Backend>*> outputs, ThreadPool& pool){
+	execute(plan, he, std::vector<const BackendCiphertext<Backend>*>(inputs),
+	        std::vector<BackendCiphertext<Backend>*>(outputs), pool);
+}
+
+#endif
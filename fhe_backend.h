@@ -0,0 +1,73 @@
+/****************************************************************/
+/* Compile-time backend interface over SEAL, HElib and PALISADE */
+/* Author: Majdi Maalej                                         */
+/* A backend wraps the profiled operations of one library for   */
+/* one scheme behind the same member functions, so a workload   */
+/* (workloads.h) is written once as a template and instantiated */
+/* for every library. There are no virtual functions: every     */
+/* call resolves to the library call at compile time.           */
+/*                                                              */
+/* A backend provides:                                          */
+/*   Ciphertext                   the library's ciphertext type */
+/*   levelled                     true when rescale() and       */
+/*                                align() do something, plans   */
+/*                                for the others leave them out */
+/*   add(a, b, destination)       destination = a + b           */
+/*   add_inplace(a, b)            a += b                        */
+/*   add_many(terms, destination) destination = the sum of      */
+/*                                the terms, all at one level,  */
+/*                                with the library's n-ary      */
+/*                                addition when it has one      */
+/*   multiply(a, b, destination)  destination = a * b           */
+/*   square(a, destination)       destination = a * a           */
+/*   relinearize(a)               after a product, when the     */
+/*                                library does not do it itself */
+/*   rescale(a)                   after a product: rescales     */
+/*                                CKKS, mod-switches BGV when   */
+/*                                the library leaves it to the  */
+/*                                caller, otherwise nothing     */
+/*   align(a, b)                  switches the operand at the   */
+/*                                higher level down to the      */
+/*                                other, when the library does  */
+/*                                not do it itself              */
+/* The backends are SealBackend (seal_ops.h), HElibBackend      */
+/* (helib_ops.h) and PalisadeBackend (palisade_ops.h).          */
+/****************************************************************/
+#ifndef FHE_BACKEND_H
+#define FHE_BACKEND_H
+
+#include "scheme_traits.h"
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template<typename Backend>
+using BackendCiphertext = typename Backend::Ciphertext;
+
+//True when Backend has every member listed above, checked by the workloads
+//with static_assert so a missing one fails with a readable message
+template<typename Backend, typename = void>
+struct is_fhe_backend : std::false_type{};
+
+template<typename Backend>
+struct is_fhe_backend<Backend, std::void_t<
+	BackendCiphertext<Backend>,
+	decltype(Backend::levelled),
+	decltype(std::declval<Backend&>().add(std::declval<const BackendCiphertext<Backend>&>(),
+	                                      std::declval<const BackendCiphertext<Backend>&>(),
+	                                      std::declval<BackendCiphertext<Backend>&>())),
+	decltype(std::declval<Backend&>().add_inplace(std::declval<BackendCiphertext<Backend>&>(),
+	                                              std::declval<const BackendCiphertext<Backend>&>())),
+	decltype(std::declval<Backend&>().add_many(std::declval<const std::vector<const BackendCiphertext<Backend>*>&>(),
+	                                           std::declval<BackendCiphertext<Backend>&>())),
+	decltype(std::declval<Backend&>().multiply(std::declval<const BackendCiphertext<Backend>&>(),
+	                                           std::declval<const BackendCiphertext<Backend>&>(),
+	                                           std::declval<BackendCiphertext<Backend>&>())),
+	decltype(std::declval<Backend&>().square(std::declval<const BackendCiphertext<Backend>&>(),
+	                                         std::declval<BackendCiphertext<Backend>&>())),
+	decltype(std::declval<Backend&>().relinearize(std::declval<BackendCiphertext<Backend>&>())),
+	decltype(std::declval<Backend&>().rescale(std::declval<BackendCiphertext<Backend>&>())),
+	decltype(std::declval<Backend&>().align(std::declval<BackendCiphertext<Backend>&>(),
+	                                        std::declval<BackendCiphertext<Backend>&>()))>> : std::true_type{};
+
+#endif
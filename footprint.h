@@ -0,0 +1,257 @@
+/****************************************************************/
+/* Serialized key and ciphertext footprint of a calculator      */
+/* Author: Majdi Maalej                                         */
+/* Set FHE_FOOTPRINT=1 to serialize every key and ciphertext    */
+/* the calculator produced and report the raw and zlib          */
+/* compressed sizes, the bytes per record, the expansion over   */
+/* the plaintext records at every modulus level, and what a     */
+/* client uploads and downloads per record. Serializing the     */
+/* keys of large rings takes a while, hence the switch.         */
+/* Set FHE_FOOTPRINT_CSV=<file> to append the results as CSV.   */
+/* Link with -lz.                                               */
+/****************************************************************/
+#ifndef FOOTPRINT_H
+#define FOOTPRINT_H
+
+#include "phase_profiler.h"
+#include <zlib.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+//The calculators keep every field of a record as a 64-bit value
+const int FOOTPRINT_RECORD_BYTES = 8;
+
+//Input: encrypted by the client, Result: decrypted by the client,
+//Level: a fresh ciphertext switched down the modulus chain for the report
+enum class FootprintRole { Input, Intermediate, Result, Level };
+
+inline const char* footprint_role_key(FootprintRole role){
+	switch(role){
+		case FootprintRole::Input:        return "input";
+		case FootprintRole::Intermediate: return "intermediate";
+		case FootprintRole::Result:       return "result";
+		case FootprintRole::Level:        return "level";
+	}
+	return "unknown";
+}
+
+inline int64_t compressed_bytes(const std::string& data){
+	uLongf size = compressBound((uLong)data.size());
+	std::vector<Bytef> buffer(size);
+	if(compress2(buffer.data(), &size, (const Bytef*)data.data(), (uLong)data.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+		return -1;
+	return (int64_t)size;
+}
+
+struct FootprintEntry{
+	std::string kind;  //key kind, or the role of a ciphertext
+	bool sent = true;  //false for the secret key, which never leaves the client
+	int primes = -1;   //RNS primes left in a ciphertext
+	long records = 0;  //records packed into a ciphertext
+	int64_t raw_bytes = 0;
+	int64_t compressed_bytes = 0;
+};
+
+class Footprint{
+public:
+	explicit Footprint(const PhaseProfiler& profiler) : profiler_(profiler){
+		const char* enabled = getenv("FHE_FOOTPRINT");
+		const char* csv_path = getenv("FHE_FOOTPRINT_CSV");
+		enabled_ = (enabled != nullptr && atoi(enabled) != 0) || (csv_path != nullptr && *csv_path != '\0');
+	}
+
+	//The calculators skip serializing when this is false
+	bool enabled() const{
+		return enabled_;
+	}
+
+	void set_ring_dimension(long ring_dimension){
+		ring_dimension_ = ring_dimension;
+	}
+
+	void add_key(const std::string& kind, const std::string& serialized, bool sent = true){
+		FootprintEntry e;
+		e.kind = kind;
+		e.sent = sent;
+		e.raw_bytes = (int64_t)serialized.size();
+		e.compressed_bytes = compressed_bytes(serialized);
+		entries_.push_back(e);
+	}
+
+	void add_ciphertext(FootprintRole role, int primes, long records, const std::string& serialized){
+		FootprintEntry e;
+		e.kind = footprint_role_key(role);
+		e.primes = primes;
+		e.records = records;
+		e.raw_bytes = (int64_t)serialized.size();
+		e.compressed_bytes = compressed_bytes(serialized);
+		entries_.push_back(e);
+	}
+
+	const std::vector<FootprintEntry>& entries() const{
+		return entries_;
+	}
+
+	void report(std::ostream& out) const{
+		if(!enabled_ || entries_.empty())
+			return;
+
+		out << "Serialized footprint";
+		if(ring_dimension_ > 0)
+			out << " at ring dimension " << ring_dimension_;
+		out << ":" << std::endl;
+		out << "                        " << std::setw(6) << "Count" << std::setw(8) << "Primes"
+		    << std::setw(14) << "Raw (KB)" << std::setw(14) << "Zlib (KB)" << std::setw(14) << "Bytes/record"
+		    << std::setw(11) << "Expansion" << std::endl;
+		out << std::fixed;
+
+		int64_t keys_raw = 0, keys_compressed = 0;
+		for(const FootprintEntry& e : entries_){
+			if(e.primes >= 0)
+				continue;
+			std::string label = e.sent ? e.kind : e.kind + " (kept)";
+			out << std::left << std::setw(22) << label << std::right << ": " << std::setw(6) << 1
+			    << std::setw(8) << "-" << std::setprecision(1) << std::setw(14) << e.raw_bytes / 1024.0
+			    << std::setw(14) << e.compressed_bytes / 1024.0 << std::endl;
+			if(e.sent){
+				keys_raw += e.raw_bytes;
+				keys_compressed += e.compressed_bytes;
+			}
+		}
+
+		//Ciphertexts grouped by role and level, sizes are per ciphertext
+		const char* labels[] = { "Inputs", "Intermediates", "Results" };
+		for(FootprintRole role : { FootprintRole::Input, FootprintRole::Intermediate, FootprintRole::Result }){
+			for(const auto& group : group_by_primes(footprint_role_key(role))){
+				const Group& g = group.second;
+				print_ciphertext_row(out, labels[(int)role], g.count, group.first, g.raw / g.count,
+				                     g.compressed / g.count, g.records / g.count);
+			}
+		}
+
+		//Smallest ciphertext seen at every level: fresh or relinearized ones
+		std::map<int, FootprintEntry> levels;
+		for(const FootprintEntry& e : entries_){
+			if(e.primes < 0)
+				continue;
+			auto level = levels.find(e.primes);
+			if(level == levels.end() || e.raw_bytes < level->second.raw_bytes)
+				levels[e.primes] = e;
+		}
+		if(!levels.empty()){
+			out << "By modulus level:" << std::endl;
+			for(auto level = levels.rbegin(); level != levels.rend(); ++level){
+				const FootprintEntry& e = level->second;
+				std::string label = std::to_string(level->first) + " primes";
+				print_ciphertext_row(out, label.c_str(), 1, level->first, e.raw_bytes, e.compressed_bytes, e.records);
+			}
+		}
+
+		//What crosses the network: evaluation keys once, then inputs and results
+		Group inputs = total(footprint_role_key(FootprintRole::Input));
+		Group results = total(footprint_role_key(FootprintRole::Result));
+		out << std::setprecision(1);
+		out << std::left << std::setw(22) << "Keys sent once (KB)" << std::right << ": "
+		    << std::setw(14) << keys_raw / 1024.0 << " raw" << std::setw(14) << keys_compressed / 1024.0
+		    << " zlib" << std::endl;
+		if(inputs.count > 0)
+			out << std::left << std::setw(22) << "Upload per record" << std::right << ": "
+			    << std::setw(14) << (double)inputs.raw / (inputs.records / inputs.count) << " raw"
+			    << std::setw(14) << (double)inputs.compressed / (inputs.records / inputs.count) << " zlib" << std::endl;
+		if(results.count > 0)
+			out << std::left << std::setw(22) << "Download per record" << std::right << ": "
+			    << std::setw(14) << (double)results.raw / (results.records / results.count) << " raw"
+			    << std::setw(14) << (double)results.compressed / (results.records / results.count) << " zlib" << std::endl;
+		out << std::defaultfloat;
+
+		const char* csv_path = getenv("FHE_FOOTPRINT_CSV");
+		if(csv_path != nullptr && *csv_path != '\0')
+			append_csv(csv_path);
+	}
+
+	static void write_csv_header(std::ostream& out){
+		out << "program,ring_dimension,kind,sent,primes,records,raw_bytes,compressed_bytes" << std::endl;
+	}
+
+	void write_csv(std::ostream& out) const{
+		for(const FootprintEntry& e : entries_){
+			out << profiler_.program() << "," << ring_dimension_ << "," << e.kind << "," << (e.sent ? 1 : 0) << ",";
+			if(e.primes >= 0)
+				out << e.primes;
+			out << "," << e.records << "," << e.raw_bytes << "," << e.compressed_bytes << std::endl;
+		}
+	}
+
+	void append_csv(const std::string& path) const{
+		bool empty;
+		{
+			std::ifstream in(path);
+			empty = !in.good() || in.peek() == std::ifstream::traits_type::eof();
+		}
+		std::ofstream out(path, std::ios::app);
+		if(!out){
+			std::cerr << "Could not open " << path << " for writing" << std::endl;
+			return;
+		}
+		if(empty)
+			write_csv_header(out);
+		write_csv(out);
+	}
+
+private:
+	struct Group{
+		long count = 0;
+		long records = 0;
+		int64_t raw = 0;
+		int64_t compressed = 0;
+	};
+
+	std::map<int, Group> group_by_primes(const std::string& kind) const{
+		std::map<int, Group> groups;
+		for(const FootprintEntry& e : entries_){
+			if(e.kind != kind)
+				continue;
+			Group& g = groups[e.primes];
+			g.count++;
+			g.records += e.records;
+			g.raw += e.raw_bytes;
+			g.compressed += e.compressed_bytes;
+		}
+		return groups;
+	}
+
+	Group total(const std::string& kind) const{
+		Group sum;
+		for(const auto& group : group_by_primes(kind)){
+			sum.count += group.second.count;
+			sum.records += group.second.records;
+			sum.raw += group.second.raw;
+			sum.compressed += group.second.compressed;
+		}
+		return sum;
+	}
+
+	void print_ciphertext_row(std::ostream& out, const char* label, long count, int primes, int64_t raw,
+	                          int64_t compressed, long records) const{
+		out << std::left << std::setw(22) << label << std::right << ": " << std::setw(6) << count
+		    << std::setw(8) << primes << std::setprecision(1) << std::setw(14) << raw / 1024.0
+		    << std::setw(14) << compressed / 1024.0;
+		if(records > 0)
+			out << std::setw(14) << (double)raw / records << std::setprecision(2) << std::setw(11)
+			    << (double)raw / ((double)records * FOOTPRINT_RECORD_BYTES);
+		out << std::endl;
+	}
+
+	const PhaseProfiler& profiler_;
+	bool enabled_ = false;
+	long ring_dimension_ = 0;
+	std::vector<FootprintEntry> entries_;
+};
+
+#endif
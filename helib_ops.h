@@ -0,0 +1,288 @@
+/****************************************************************/
+/* Profiled HElib operations                                    */
+/* Author: Majdi Maalej                                         */
+/* HElib evaluates through Ctxt operators, so the calculators   */
+/* call these functions instead and each one is recorded in the */
+/* OpProfiler. The level is the number of primes left in the    */
+/* input ciphertext. Ctxt multiplication relinearizes and       */
+/* mod-switches internally, that time is part of multiply.      */
+/* Also provides the byte sizes used by the memory profiler and */
+/* the serialized forms used by the footprint report, and the   */
+/* HElibBackend the workloads are instantiated with.            */
+/* The batch overloads encode or encrypt independent columns,   */
+/* or decrypt and decode many results into one buffer, in       */
+/* parallel on a thread pool (thread_pool.h), which needs NTL   */
+/* built with NTL_THREADS (its default).                        */
+/* helib_set_threads() is the library side of FHE_THREADS: the  */
+/* size of NTL's thread pool, which HElib operations split      */
+/* their work over. NTL keeps one per thread, so the calling    */
+/* thread and every pool thread (thread_setup()) set theirs.    */
+/* helib_generate_keys() lends the pool's threads to NTL for    */
+/* key generation.                                              */
+/****************************************************************/
+#ifndef HELIB_OPS_H
+#define HELIB_OPS_H
+
+#include <helib/helib.h>
+#include <NTL/BasicThreadPool.h>
+#include "op_profiler.h"
+#include "footprint.h"
+#include "fhe_backend.h"
+#include "thread_pool.h"
+#include <stdint.h>
+#include <algorithm>
+#include <complex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+//Returns the threads each operation uses
+inline int helib_set_threads(int threads){
+	threads = std::max(1, threads);
+	NTL::SetNumThreads(threads);
+	thread_setup() = [threads](){ NTL::SetNumThreads(threads); };
+	return (int)NTL::AvailableThreads();
+}
+
+//GenSecKey() and, with one_d_matrices, addSome1DMatrices(), with NTL's pool
+//widened to every thread of the thread pool while they run. HElib has no
+//call generating key-switching matrices apart from the secret key they are
+//added to, but spreads the work of each over NTL's threads.
+inline void helib_generate_keys(helib::SecKey& secret_key, bool one_d_matrices, ThreadPool& pool){
+	long threads = NTL::AvailableThreads();
+	NTL::SetNumThreads(threads * pool.size());
+	try{
+		secret_key.GenSecKey();
+		if(one_d_matrices)
+			helib::addSome1DMatrices(secret_key);
+	}
+	catch(...){
+		NTL::SetNumThreads(threads);
+		throw;
+	}
+	NTL::SetNumThreads(threads);
+}
+
+inline int helib_level(const helib::Ctxt& ciphertext){
+	return (int)ciphertext.getPrimeSet().card();
+}
+
+//Binary serialized form of a ciphertext, public key or Ptxt<BGV>. The public
+//key carries the key-switching matrices used for relinearization.
+template<typename Object>
+inline std::string helib_serialize(const Object& object){
+	std::ostringstream out;
+	object.writeTo(out);
+	return out.str();
+}
+
+//Only the secret part, without the public key it extends
+inline std::string helib_serialize(const helib::SecKey& secret_key){
+	std::ostringstream out;
+	secret_key.writeTo(out, true);
+	return out.str();
+}
+
+template<typename Object>
+inline int64_t helib_bytes(const Object& object){
+	return (int64_t)helib_serialize(object).size();
+}
+
+inline int64_t helib_bytes(const helib::SecKey& secret_key){
+	return (int64_t)helib_serialize(secret_key).size();
+}
+
+//PtxtArray has no serialization, count its CKKS slots
+inline int64_t helib_bytes(const helib::PtxtArray& plain){
+	return (int64_t)(plain.size() * sizeof(std::complex<double>));
+}
+
+inline void helib_footprint(Footprint& footprint, FootprintRole role, const helib::Ctxt& ciphertext, long records){
+	footprint.add_ciphertext(role, helib_level(ciphertext), records, helib_serialize(ciphertext));
+}
+
+class HElibOps{
+public:
+	explicit HElibOps(OpProfiler& ops) : ops_(ops){}
+
+	//Ptxt<BGV> encryption and decryption through the keys
+	template<typename Plaintext>
+	void Encrypt(const helib::PubKey& public_key, helib::Ctxt& ciphertext, const Plaintext& plain){
+		ops_.time(HeOp::Encrypt, NO_LEVEL, [&](){ public_key.Encrypt(ciphertext, plain); });
+	}
+
+	//One ciphertext per plaintext, the ciphertexts built beforehand
+	template<typename Plaintext>
+	void Encrypt(const helib::PubKey& public_key, std::vector<helib::Ctxt>& ciphertexts, const std::vector<Plaintext>& plains,
+	             ThreadPool& pool){
+		check_batch(ciphertexts.size(), plains.size());
+		pool.parallel_for(plains.size(), [&](size_t i){ Encrypt(public_key, ciphertexts[i], plains[i]); });
+	}
+
+	template<typename Plaintext>
+	void Decrypt(const helib::SecKey& secret_key, Plaintext& plain, const helib::Ctxt& ciphertext){
+		ops_.time(HeOp::Decrypt, helib_level(ciphertext), [&](){ secret_key.Decrypt(plain, ciphertext); });
+	}
+
+	//PtxtArray encoding, encryption, decryption and decoding
+	template<typename Values>
+	void load(helib::PtxtArray& plain, const Values& values){
+		ops_.time(HeOp::Encode, NO_LEVEL, [&](){ plain.load(values); });
+	}
+
+	void encrypt(const helib::PtxtArray& plain, helib::Ctxt& ciphertext){
+		ops_.time(HeOp::Encrypt, NO_LEVEL, [&](){ plain.encrypt(ciphertext); });
+	}
+
+	//One plaintext per column and one ciphertext per plaintext, both built
+	//beforehand
+	template<typename Values>
+	void load(std::vector<helib::PtxtArray>& plains, const std::vector<Values>& columns, ThreadPool& pool){
+		check_batch(plains.size(), columns.size());
+		pool.parallel_for(columns.size(), [&](size_t i){ load(plains[i], columns[i]); });
+	}
+
+	void encrypt(const std::vector<helib::PtxtArray>& plains, std::vector<helib::Ctxt>& ciphertexts, ThreadPool& pool){
+		check_batch(ciphertexts.size(), plains.size());
+		pool.parallel_for(plains.size(), [&](size_t i){ encrypt(plains[i], ciphertexts[i]); });
+	}
+
+	void decrypt(helib::PtxtArray& plain, const helib::Ctxt& ciphertext, const helib::SecKey& secret_key){
+		ops_.time(HeOp::Decrypt, helib_level(ciphertext), [&](){ plain.decrypt(ciphertext, secret_key); });
+	}
+
+	template<typename Values>
+	void store(const helib::PtxtArray& plain, Values& values){
+		ops_.time(HeOp::Decode, NO_LEVEL, [&](){ plain.store(values); });
+	}
+
+	//Decrypts and decodes the first count slots into values, through a
+	//Ptxt<BGV> for BGV and a PtxtArray for CKKS. CKKS slots are stored in a
+	//buffer each thread keeps from call to call.
+	template<typename Scheme>
+	void decrypt(const helib::Context& context, const helib::SecKey& secret_key, const helib::Ctxt& ciphertext,
+	             double* values, size_t count){
+		if constexpr(std::is_same<Scheme, helib::BGV>::value){
+			helib::Ptxt<helib::BGV> plain(context);
+			Decrypt(secret_key, plain, ciphertext);
+			check_values(count, plain.size());
+			for(size_t i = 0; i < count; i++)
+				values[i] = (double)(long)plain[i];
+		}
+		else{
+			thread_local std::vector<double> slots;
+			helib::PtxtArray plain(context);
+			decrypt(plain, ciphertext, secret_key);
+			store(plain, slots);
+			check_values(count, slots.size());
+			std::copy(slots.begin(), slots.begin() + count, values);
+		}
+	}
+
+	//Ciphertext i fills values[i * stride] on, count values in all
+	template<typename Scheme>
+	void decrypt(const helib::Context& context, const helib::SecKey& secret_key,
+	             const std::vector<const helib::Ctxt*>& ciphertexts, double* values, size_t count, size_t stride,
+	             ThreadPool& pool){
+		check_values(count, ciphertexts.size() * stride);
+		pool.parallel_for(ciphertexts.size(), [&](size_t i){
+			size_t first = i * stride;
+			if(first < count)
+				decrypt<Scheme>(context, secret_key, *ciphertexts[i], values + first, std::min(stride, count - first));
+		});
+	}
+
+	//a += b
+	void add(helib::Ctxt& a, const helib::Ctxt& b){
+		ops_.time(HeOp::Add, helib_level(a), [&](){ a += b; });
+	}
+
+	template<typename Plaintext>
+	void add(helib::Ctxt& a, const Plaintext& b){
+		ops_.time(HeOp::AddPlain, helib_level(a), [&](){ a += b; });
+	}
+
+	//a *= b
+	void multiply(helib::Ctxt& a, const helib::Ctxt& b){
+		ops_.time(HeOp::Multiply, helib_level(a), [&](){ a *= b; });
+	}
+
+	template<typename Plaintext>
+	void multiply(helib::Ctxt& a, const Plaintext& b){
+		ops_.time(HeOp::MultiplyPlain, helib_level(a), [&](){ a *= b; });
+	}
+
+	void multiplyBy(helib::Ctxt& a, const helib::Ctxt& b){
+		ops_.time(HeOp::Multiply, helib_level(a), [&](){ a.multiplyBy(b); });
+	}
+
+	void square(helib::Ctxt& a){
+		ops_.time(HeOp::Square, helib_level(a), [&](){ a.square(); });
+	}
+
+private:
+	//HElib objects need their context, so the batches fill what the caller built
+	static void check_batch(size_t destinations, size_t sources){
+		if(destinations != sources)
+			throw std::invalid_argument("batch of " + std::to_string(sources) + " into " + std::to_string(destinations));
+	}
+
+	static void check_values(size_t count, size_t slots){
+		if(count > slots)
+			throw std::invalid_argument(std::to_string(count) + " values from " + std::to_string(slots) + " slots");
+	}
+
+	OpProfiler& ops_;
+};
+
+//Workload backend (fhe_backend.h) over the profiled operations. HElib
+//works in place, so the out-of-place calls copy the first operand, and
+//it relinearizes every product, mod-switches and matches levels itself
+//for both schemes.
+class HElibBackend{
+public:
+	typedef helib::Ctxt Ciphertext;
+	static constexpr bool levelled = false;
+
+	explicit HElibBackend(HElibOps& he) : he_(he){}
+
+	void add(const Ciphertext& a, const Ciphertext& b, Ciphertext& destination){
+		destination = a;
+		he_.add(destination, b);
+	}
+
+	void add_inplace(Ciphertext& a, const Ciphertext& b){
+		he_.add(a, b);
+	}
+
+	//HElib has no n-ary addition, the terms are added one by one
+	void add_many(const std::vector<const Ciphertext*>& terms, Ciphertext& destination){
+		destination = *terms.front();
+		for(size_t i = 1; i < terms.size(); i++)
+			he_.add(destination, *terms[i]);
+	}
+
+	void multiply(const Ciphertext& a, const Ciphertext& b, Ciphertext& destination){
+		destination = a;
+		he_.multiplyBy(destination, b);
+	}
+
+	void square(const Ciphertext& a, Ciphertext& destination){
+		destination = a;
+		he_.square(destination);
+	}
+
+	//HElib relinearizes, switches moduli and matches levels itself
+	void relinearize(Ciphertext&){}
+
+	void rescale(Ciphertext&){}
+
+	void align(Ciphertext&, Ciphertext&){}
+
+private:
+	HElibOps& he_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,179 @@
+/****************************************************************/
+/* HElib runtime for the registered workloads                   */
+/* Author: Majdi Maalej                                         */
+/* One HElib context and key set for BGV or CKKS and a          */
+/* parameter table (scheme_traits.h), shared by every workload  */
+/* served with it (workload_runtime.h). GenSecKey() creates the */
+/* relinearization matrix with the secret key, so there are no  */
+/* other keys to generate for the declared ones.                */
+/* A worker of a sharded run builds the same context from the   */
+/* table and loads the public key, matrices included, from      */
+/* public_keys() of the coordinator; it cannot decrypt.         */
+/****************************************************************/
+#ifndef HELIB_RUNTIME_H
+#define HELIB_RUNTIME_H
+
+#include <helib/helib.h>
+#include "helib_ops.h"
+#include "workload_runtime.h"
+#include <stdint.h>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+template<Scheme S, typename Parameters>
+class HElibRuntime{
+public:
+	typedef HElibBackend Backend;
+	typedef helib::Ctxt Ciphertext;
+
+	//ring_dimension 0 keeps the table's. The keys are generated with the
+	//pool's threads.
+	HElibRuntime(PhaseProfiler& profiler, OpProfiler& ops, const std::vector<WorkloadDefinition>&, ThreadPool& pool,
+	             long ring_dimension = 0) : profiler_(profiler), he_(ops), backend_(he_){
+		build_context(ring_dimension);
+		profiler_.start(Phase::KeyGeneration);
+		secret_key_.reset(new helib::SecKey(*context_));
+		helib_generate_keys(*secret_key_, false, pool);
+		profiler_.stop();
+	}
+
+	//A worker with the key from public_keys()
+	HElibRuntime(PhaseProfiler& profiler, OpProfiler& ops, const std::vector<std::string>& public_keys,
+	             long ring_dimension = 0) : profiler_(profiler), he_(ops), backend_(he_){
+		build_context(ring_dimension);
+		if(public_keys.size() != 1)
+			throw std::invalid_argument("expected a public key");
+		std::istringstream in(public_keys[0]);
+		public_key_.reset(new helib::PubKey(helib::PubKey::readFrom(in, *context_)));
+	}
+
+	//For each operation, returns the threads it uses
+	static int set_library_threads(int threads){
+		return helib_set_threads(threads);
+	}
+
+	Backend& backend(){
+		return backend_;
+	}
+
+	PhaseProfiler& profiler(){
+		return profiler_;
+	}
+
+	long slot_count() const{
+		return SchemeTraits<S>::exact ? context_->getEA().size() : context_->getNSlots();
+	}
+
+	uint64_t plain_modulus() const{
+		return Parameters::plain_modulus;
+	}
+
+	int depth() const{
+		return Parameters::depth;
+	}
+
+	Ciphertext ciphertext() const{
+		return Ciphertext(public_key());
+	}
+
+	void encrypt(const std::vector<double>& values, Ciphertext& destination){
+		if constexpr(SchemeTraits<S>::exact){
+			helib::Ptxt<helib::BGV> plain(*context_);
+			for(size_t i = 0; i < values.size(); i++)
+				plain[i] = (long)values[i];
+			he_.Encrypt(public_key(), destination, plain);
+		}
+		else{
+			std::vector<double> slots(values);
+			slots.resize(slot_count(), 0.0);
+			helib::PtxtArray plain(*context_);
+			he_.load(plain, slots);
+			he_.encrypt(plain, destination);
+		}
+	}
+
+	void decrypt(const Ciphertext& ciphertext, std::vector<double>& values){
+		check_secret_key();
+		if constexpr(SchemeTraits<S>::exact){
+			helib::Ptxt<helib::BGV> plain(*context_);
+			he_.Decrypt(*secret_key_, plain, ciphertext);
+			values.resize(plain.size());
+			for(long i = 0; i < plain.size(); i++)
+				values[i] = (double)(long)plain[i];
+		}
+		else{
+			helib::PtxtArray plain(*context_);
+			he_.decrypt(plain, ciphertext, *secret_key_);
+			he_.store(plain, values);
+		}
+	}
+
+	//The first count slots
+	void decrypt(const Ciphertext& ciphertext, double* values, size_t count){
+		check_secret_key();
+		he_.template decrypt<HElibScheme>(*context_, *secret_key_, ciphertext, values, count);
+	}
+
+	//Ciphertext i into values[i * stride] on, count values in all
+	void decrypt(const std::vector<const Ciphertext*>& ciphertexts, double* values, size_t count, size_t stride,
+	             ThreadPool& pool){
+		check_secret_key();
+		he_.template decrypt<HElibScheme>(*context_, *secret_key_, ciphertexts, values, count, stride, pool);
+	}
+
+	//The public key with its key-switching matrices
+	std::vector<std::string> public_keys() const{
+		return { helib_serialize(public_key()) };
+	}
+
+	std::string save(const Ciphertext& ciphertext) const{
+		return helib_serialize(ciphertext);
+	}
+
+	void load(const std::string& saved, Ciphertext& ciphertext) const{
+		std::istringstream in(saved);
+		ciphertext = helib::Ctxt::readFrom(in, public_key());
+	}
+
+private:
+	typedef typename std::conditional<SchemeTraits<S>::exact, helib::BGV, helib::CKKS>::type HElibScheme;
+
+	void build_context(long ring_dimension){
+		static_assert(S != Scheme::BFV, "HElib has no BFV");
+		profiler_.start(Phase::ParameterGeneration);
+		long m = 2 * (ring_dimension > 0 ? ring_dimension : (long)Parameters::ring_dimension);
+		helib::ContextBuilder<HElibScheme> builder;
+		builder.m(m).bits(Parameters::modulus_bits).c(Parameters::key_switching_columns);
+		if constexpr(SchemeTraits<S>::exact)
+			builder.p(Parameters::plain_modulus).r(Parameters::hensel_lifting);
+		else
+			builder.precision(Parameters::scale_bits);
+		context_.reset(builder.buildPtr());
+		profiler_.stop();
+	}
+
+	//The secret key extends the public one
+	const helib::PubKey& public_key() const{
+		if(secret_key_)
+			return *secret_key_;
+		return *public_key_;
+	}
+
+	void check_secret_key() const{
+		if(!secret_key_)
+			throw std::logic_error("a sharded worker has no secret key");
+	}
+
+	PhaseProfiler& profiler_;
+	HElibOps he_;
+	Backend backend_;
+	std::unique_ptr<helib::Context> context_;
+	std::unique_ptr<helib::SecKey> secret_key_;
+	std::unique_ptr<helib::PubKey> public_key_;
+};
+
+#endif
@@ -0,0 +1,233 @@
+/****************************************************************/
+/* Phase-resolved memory accounting shared by all calculators   */
+/* Author: Majdi Maalej                                         */
+/* Takes a snapshot of the current resident set size, the heap  */
+/* in use and, when the library has one, its memory pool before */
+/* and after every phase, and sums the byte sizes of the live   */
+/* keys, plaintexts and ciphertexts the calculator reports.     */
+/* Set FHE_MEMORY_CSV=<file> to append the results as CSV.      */
+/****************************************************************/
+#ifndef MEMORY_PROFILER_H
+#define MEMORY_PROFILER_H
+
+#include "phase_profiler.h"
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+
+//Resident set size right now, unlike ru_maxrss which only ever grows
+inline int64_t current_rss_bytes(){
+	long pages = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if(statm == nullptr)
+		return 0;
+	if(fscanf(statm, "%*d %ld", &pages) != 1)
+		pages = 0;
+	fclose(statm);
+	return (int64_t)pages * sysconf(_SC_PAGESIZE);
+}
+
+inline int64_t peak_rss_bytes(){
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (int64_t)usage.ru_maxrss * 1024;
+}
+
+//Bytes handed out by malloc and not freed yet
+inline int64_t heap_in_use_bytes(){
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	struct mallinfo2 info = mallinfo2();
+	return (int64_t)info.uordblks + (int64_t)info.hblkhd;
+#else
+	struct mallinfo info = mallinfo();
+	return (int64_t)(unsigned)info.uordblks + (int64_t)(unsigned)info.hblkhd;
+#endif
+}
+
+struct MemorySnapshot{
+	int64_t rss_bytes = 0;
+	int64_t heap_bytes = 0;
+	int64_t pool_bytes = 0;
+};
+
+struct PhaseMemory{
+	bool seen = false;
+	MemorySnapshot before; //at the first start of the phase
+	MemorySnapshot after;  //at the last stop of the phase
+};
+
+struct ObjectMemory{
+	std::string kind;
+	long count = 0;
+	int64_t bytes = 0;
+};
+
+class MemoryProfiler : public PhaseListener{
+public:
+	explicit MemoryProfiler(PhaseProfiler& profiler) : profiler_(profiler){
+		profiler_.add_listener(this);
+		baseline_ = snapshot();
+	}
+
+	//Bytes held by the library's own allocator, e.g. the SEAL memory pool
+	void set_pool_probe(std::function<int64_t()> probe){
+		pool_probe_ = probe;
+		baseline_ = snapshot();
+	}
+
+	MemorySnapshot snapshot() const{
+		MemorySnapshot s;
+		s.rss_bytes = current_rss_bytes();
+		s.heap_bytes = heap_in_use_bytes();
+		if(pool_probe_)
+			s.pool_bytes = pool_probe_();
+		return s;
+	}
+
+	const MemorySnapshot& baseline() const{
+		return baseline_;
+	}
+
+	const PhaseMemory& phase(Phase phase) const{
+		return phases_[(int)phase];
+	}
+
+	const std::vector<ObjectMemory>& objects() const{
+		return objects_;
+	}
+
+	void phase_started(Phase phase) override{
+		PhaseMemory& m = phases_[(int)phase];
+		if(!m.seen){
+			m.before = snapshot();
+			m.seen = true;
+		}
+	}
+
+	void phase_stopped(Phase phase) override{
+		phases_[(int)phase].after = snapshot();
+	}
+
+	//Adds one live object of the given kind ("public key", "ciphertext", ...)
+	void track(const std::string& kind, int64_t bytes){
+		for(ObjectMemory& o : objects_){
+			if(o.kind == kind){
+				o.count++;
+				o.bytes += bytes;
+				return;
+			}
+		}
+		ObjectMemory o;
+		o.kind = kind;
+		o.count = 1;
+		o.bytes = bytes;
+		objects_.push_back(o);
+	}
+
+	void report(std::ostream& out) const{
+		out << "Memory (MB):" << std::endl;
+		out << "                        " << std::setw(12) << "RSS" << std::setw(12) << "RSS delta"
+		    << std::setw(12) << "Heap" << std::setw(12) << "Heap delta";
+		if(pool_probe_)
+			out << std::setw(12) << "Pool";
+		out << std::endl;
+		out << std::fixed << std::setprecision(3);
+		print_row(out, "Start", baseline_, baseline_);
+		for(int p = 0; p < PHASE_COUNT; p++){
+			if(phases_[p].seen)
+				print_row(out, phase_name((Phase)p), phases_[p].before, phases_[p].after);
+		}
+		out << std::left << std::setw(22) << "Peak RSS" << std::right << ": " << std::setw(12)
+		    << peak_rss_bytes() / 1048576.0 << std::endl;
+
+		if(!objects_.empty()){
+			int64_t total = 0;
+			out << "Live objects:           " << std::setw(8) << "Count" << std::setw(14) << "Bytes each"
+			    << std::setw(14) << "Total (MB)" << std::endl;
+			for(const ObjectMemory& o : objects_){
+				out << std::left << std::setw(22) << o.kind << std::right << ": " << std::setw(8) << o.count
+				    << std::setw(14) << o.bytes / o.count << std::setw(14) << o.bytes / 1048576.0 << std::endl;
+				total += o.bytes;
+			}
+			out << std::left << std::setw(22) << "Total" << std::right << ": " << std::setw(8) << ""
+			    << std::setw(14) << "" << std::setw(14) << total / 1048576.0 << std::endl;
+		}
+		out << std::defaultfloat;
+
+		const char* csv_path = getenv("FHE_MEMORY_CSV");
+		if(csv_path != nullptr && *csv_path != '\0')
+			append_csv(csv_path);
+	}
+
+	static void write_csv_header(std::ostream& out){
+		out << "program,scope,metric,count,bytes" << std::endl;
+	}
+
+	void write_csv(std::ostream& out) const{
+		const std::string& program = profiler_.program();
+		write_snapshot(out, "start", "", baseline_);
+		for(int p = 0; p < PHASE_COUNT; p++){
+			if(!phases_[p].seen)
+				continue;
+			write_snapshot(out, phase_key((Phase)p), "_before", phases_[p].before);
+			write_snapshot(out, phase_key((Phase)p), "_after", phases_[p].after);
+		}
+		out << program << ",process,peak_rss,1," << peak_rss_bytes() << std::endl;
+		for(const ObjectMemory& o : objects_)
+			out << program << ",objects," << o.kind << "," << o.count << "," << o.bytes << std::endl;
+	}
+
+	void append_csv(const std::string& path) const{
+		bool empty;
+		{
+			std::ifstream in(path);
+			empty = !in.good() || in.peek() == std::ifstream::traits_type::eof();
+		}
+		std::ofstream out(path, std::ios::app);
+		if(!out){
+			std::cerr << "Could not open " << path << " for writing" << std::endl;
+			return;
+		}
+		if(empty)
+			write_csv_header(out);
+		write_csv(out);
+	}
+
+private:
+	void print_row(std::ostream& out, const char* label, const MemorySnapshot& before,
+	               const MemorySnapshot& after) const{
+		out << std::left << std::setw(22) << label << std::right << ": "
+		    << std::setw(12) << after.rss_bytes / 1048576.0
+		    << std::setw(12) << (after.rss_bytes - before.rss_bytes) / 1048576.0
+		    << std::setw(12) << after.heap_bytes / 1048576.0
+		    << std::setw(12) << (after.heap_bytes - before.heap_bytes) / 1048576.0;
+		if(pool_probe_)
+			out << std::setw(12) << after.pool_bytes / 1048576.0;
+		out << std::endl;
+	}
+
+	void write_snapshot(std::ostream& out, const char* scope, const char* suffix, const MemorySnapshot& s) const{
+		const std::string& program = profiler_.program();
+		out << program << "," << scope << ",rss" << suffix << ",1," << s.rss_bytes << std::endl;
+		out << program << "," << scope << ",heap" << suffix << ",1," << s.heap_bytes << std::endl;
+		if(pool_probe_)
+			out << program << "," << scope << ",pool" << suffix << ",1," << s.pool_bytes << std::endl;
+	}
+
+	PhaseProfiler& profiler_;
+	std::function<int64_t()> pool_probe_;
+	MemorySnapshot baseline_;
+	PhaseMemory phases_[PHASE_COUNT];
+	std::vector<ObjectMemory> objects_;
+};
+
+#endif
@@ -0,0 +1,226 @@
+/****************************************************************/
+/* Per-operation profiler shared by all calculators             */
+/* Author: Majdi Maalej                                         */
+/* Counts and times every homomorphic operation by type and by  */
+/* the level of its input ciphertext, attributed to the phase   */
+/* the phase profiler is running. Operations executed outside a */
+/* timed phase (warmup runs) are not recorded.                  */
+/* Operations may run on several threads at once                */
+/* (thread_pool.h), the listeners only see the ones on the      */
+/* thread that created the profiler.                            */
+/* Set FHE_OPS_CSV=<file> to append the results as CSV.         */
+/****************************************************************/
+#ifndef OP_PROFILER_H
+#define OP_PROFILER_H
+
+#include "phase_profiler.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+enum class HeOp { Encode, Encrypt, Add, AddPlain, AddMany, Multiply, MultiplyPlain, MultiplyMany, Square,
+                  Relinearize, Rescale, ModSwitch, Rotate, Sum, Decrypt, Decode };
+const int HE_OP_COUNT = 16;
+
+inline const char* op_name(HeOp op){
+	switch(op){
+		case HeOp::Encode:        return "encode";
+		case HeOp::Encrypt:       return "encrypt";
+		case HeOp::Add:           return "add";
+		case HeOp::AddPlain:      return "add_plain";
+		case HeOp::AddMany:       return "add_many";
+		case HeOp::Multiply:      return "multiply";
+		case HeOp::MultiplyPlain: return "multiply_plain";
+		case HeOp::MultiplyMany:  return "multiply_many";
+		case HeOp::Square:        return "square";
+		case HeOp::Relinearize:   return "relinearize";
+		case HeOp::Rescale:       return "rescale";
+		case HeOp::ModSwitch:     return "mod_switch";
+		case HeOp::Rotate:        return "rotate";
+		case HeOp::Sum:           return "sum";
+		case HeOp::Decrypt:       return "decrypt";
+		case HeOp::Decode:        return "decode";
+	}
+	return "unknown";
+}
+
+//Level reported for operations that have no ciphertext input, like encoding
+const int NO_LEVEL = -1;
+
+struct OpStats{
+	long count = 0;
+	int64_t wall_ns = 0;
+
+	OpStats& operator+=(const OpStats& other){
+		count += other.count;
+		wall_ns += other.wall_ns;
+		return *this;
+	}
+
+	//What was recorded since an earlier reading
+	OpStats operator-(const OpStats& earlier) const{
+		OpStats since;
+		since.count = count - earlier.count;
+		since.wall_ns = wall_ns - earlier.wall_ns;
+		return since;
+	}
+};
+
+//Notified around every recorded operation, outside of the measured interval
+class OpListener{
+public:
+	virtual ~OpListener(){}
+	virtual void op_started(HeOp op) = 0;
+	virtual void op_stopped(HeOp op) = 0;
+};
+
+//The library wrappers (seal_ops.h, helib_ops.h, palisade_ops.h) call time()
+//around every primitive with the level of its input, as the library defines it.
+class OpProfiler{
+public:
+	explicit OpProfiler(const PhaseProfiler& profiler) : profiler_(profiler), owner_(std::this_thread::get_id()){}
+
+	template<typename Function>
+	void time(HeOp op, int level, Function&& body){
+		if(!profiler_.running()){
+			body();
+			return;
+		}
+		Phase phase = profiler_.current();
+		bool notify = std::this_thread::get_id() == owner_;
+		if(notify){
+			for(OpListener* listener : listeners_)
+				listener->op_started(op);
+		}
+		int64_t start = read_clock_ns(CLOCK_MONOTONIC);
+		body();
+		int64_t wall_ns = read_clock_ns(CLOCK_MONOTONIC) - start;
+		if(notify){
+			for(OpListener* listener : listeners_)
+				listener->op_stopped(op);
+		}
+		std::lock_guard<std::mutex> lock(mutex_);
+		OpStats& stats = stats_[std::make_tuple((int)phase, (int)op, level)];
+		stats.count++;
+		stats.wall_ns += wall_ns;
+	}
+
+	void add_listener(OpListener* listener){
+		listeners_.push_back(listener);
+	}
+
+	//All operations recorded in a phase
+	long count(Phase phase) const{
+		long sum = 0;
+		for(const auto& entry : stats_){
+			if(std::get<0>(entry.first) == (int)phase)
+				sum += entry.second.count;
+		}
+		return sum;
+	}
+
+	//All levels of one operation within a phase
+	OpStats stats(Phase phase, HeOp op) const{
+		OpStats sum;
+		for(const auto& entry : stats_){
+			if(std::get<0>(entry.first) == (int)phase && std::get<1>(entry.first) == (int)op)
+				sum += entry.second;
+		}
+		return sum;
+	}
+
+	//One table per phase, operations sorted as declared and split by level when
+	//they ran at more than one. The share is relative to the phase wall time.
+	void report(std::ostream& out) const{
+		for(int p = 0; p < PHASE_COUNT; p++){
+			Phase phase = (Phase)p;
+			int64_t phase_ns = profiler_.total(phase).wall_ns;
+			bool header = false;
+			for(int o = 0; o < HE_OP_COUNT; o++){
+				OpStats total = stats(phase, (HeOp)o);
+				if(total.count == 0)
+					continue;
+				if(!header){
+					out << "Operations in " << phase_name(phase) << " (" << profiler_.samples(phase).size()
+					    << " trials, totals over all trials):" << std::endl;
+					out << "                        " << std::setw(8) << "Count" << std::setw(14) << "Total (ms)"
+					    << std::setw(14) << "Mean (ms)" << std::setw(10) << "Share" << std::endl;
+					header = true;
+				}
+				print_row(out, op_name((HeOp)o), total, phase_ns);
+
+				int levels = 0;
+				for(const auto& entry : stats_){
+					if(std::get<0>(entry.first) == p && std::get<1>(entry.first) == o)
+						levels++;
+				}
+				if(levels < 2)
+					continue;
+				for(const auto& entry : stats_){
+					if(std::get<0>(entry.first) != p || std::get<1>(entry.first) != o)
+						continue;
+					print_row(out, "  level " + std::to_string(std::get<2>(entry.first)), entry.second, phase_ns);
+				}
+			}
+		}
+
+		const char* csv_path = getenv("FHE_OPS_CSV");
+		if(csv_path != nullptr && *csv_path != '\0')
+			append_csv(csv_path);
+	}
+
+	static void write_csv_header(std::ostream& out){
+		out << "program,phase,operation,level,count,wall_ns" << std::endl;
+	}
+
+	void write_csv(std::ostream& out) const{
+		for(const auto& entry : stats_){
+			out << profiler_.program() << "," << phase_key((Phase)std::get<0>(entry.first)) << ","
+			    << op_name((HeOp)std::get<1>(entry.first)) << "," << std::get<2>(entry.first) << ","
+			    << entry.second.count << "," << entry.second.wall_ns << std::endl;
+		}
+	}
+
+	void append_csv(const std::string& path) const{
+		bool empty;
+		{
+			std::ifstream in(path);
+			empty = !in.good() || in.peek() == std::ifstream::traits_type::eof();
+		}
+		std::ofstream out(path, std::ios::app);
+		if(!out){
+			std::cerr << "Could not open " << path << " for writing" << std::endl;
+			return;
+		}
+		if(empty)
+			write_csv_header(out);
+		write_csv(out);
+	}
+
+private:
+	static void print_row(std::ostream& out, const std::string& label, const OpStats& s, int64_t phase_ns){
+		out << std::left << std::setw(22) << label << std::right << ": "
+		    << std::setw(8) << s.count << std::fixed << std::setprecision(3)
+		    << std::setw(14) << s.wall_ns / 1e6
+		    << std::setw(14) << s.wall_ns / 1e6 / s.count
+		    << std::setprecision(1) << std::setw(9) << (phase_ns > 0 ? 100.0 * s.wall_ns / phase_ns : 0.0) << "%"
+		    << std::defaultfloat << std::endl;
+	}
+
+	const PhaseProfiler& profiler_;
+	std::thread::id owner_;
+	std::vector<OpListener*> listeners_;
+	std::mutex mutex_;
+	//(phase, operation, level) -> stats
+	std::map<std::tuple<int, int, int>, OpStats> stats_;
+};
+
+#endif
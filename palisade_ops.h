@@ -0,0 +1,399 @@
+/****************************************************************/
+/* Profiled PALISADE crypto context                             */
+/* Author: Majdi Maalej                                         */
+/* Forwards the encoding, encryption and evaluation calls used  */
+/* by the calculators to the crypto context and records each of */
+/* them in the OpProfiler, with GetLevel() of the first input   */
+/* ciphertext as the level. Decrypt() also decodes the result.  */
+/* Also provides the byte sizes used by the memory profiler and */
+/* the serialized forms used by the footprint report, and the   */
+/* PalisadeBackend the workloads are instantiated with.         */
+/* The batch overloads encode or encrypt independent columns,   */
+/* or decrypt and decode many results into one buffer, in       */
+/* parallel on a thread pool (thread_pool.h).                   */
+/* palisade_set_threads() is the library side of FHE_THREADS:   */
+/* the OpenMP team size of PALISADE's parallel loops. OpenMP    */
+/* keeps it per thread, so the calling thread and every pool    */
+/* thread (thread_setup()) set theirs. Without OpenMP each      */
+/* operation runs on one thread.                                */
+/* palisade_generate_keys() generates the evaluation keys side  */
+/* by side on the pool.                                         */
+/****************************************************************/
+#ifndef PALISADE_OPS_H
+#define PALISADE_OPS_H
+
+#include "palisade.h"
+#include "ciphertext-ser.h"
+#include "pubkeylp-ser.h"
+#include "scheme/bfvrns/bfvrns-ser.h"
+#include "scheme/bgvrns/bgvrns-ser.h"
+#include "scheme/ckks/ckks-ser.h"
+#include "op_profiler.h"
+#include "footprint.h"
+#include "fhe_backend.h"
+#include "thread_pool.h"
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <algorithm>
+#include <complex>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//Returns the threads each operation uses
+inline int palisade_set_threads(int threads){
+#ifdef _OPENMP
+	threads = std::max(1, threads);
+	omp_set_num_threads(threads);
+	thread_setup() = [threads](){ omp_set_num_threads(threads); };
+	return threads;
+#else
+	(void)threads;
+	return 1;
+#endif
+}
+
+//Binary serialized form of a ciphertext or key
+template<typename Object>
+inline std::string palisade_serialize(const Object& object){
+	std::stringstream out;
+	lbcrypto::Serial::Serialize(object, out, lbcrypto::SerType::BINARY);
+	return out.str();
+}
+
+//The evaluation keys are held by the crypto context
+template<typename Element>
+inline std::string palisade_relin_keys_serialized(){
+	std::stringstream out;
+	lbcrypto::CryptoContextImpl<Element>::SerializeEvalMultKey(out, lbcrypto::SerType::BINARY);
+	return out.str();
+}
+
+//Sum keys and EvalAtIndex keys
+template<typename Element>
+inline std::string palisade_rotation_keys_serialized(){
+	std::stringstream out;
+	lbcrypto::CryptoContextImpl<Element>::SerializeEvalSumKey(out, lbcrypto::SerType::BINARY);
+	lbcrypto::CryptoContextImpl<Element>::SerializeEvalAutomorphismKey(out, lbcrypto::SerType::BINARY);
+	return out.str();
+}
+
+//Serialized size of a ciphertext or key
+template<typename Object>
+inline int64_t palisade_bytes(const Object& object){
+	return (int64_t)palisade_serialize(object).size();
+}
+
+//Plaintexts cannot be serialized: one 64-bit coefficient per ring element,
+//a lower bound for CKKS plaintexts, which keep one per RNS tower
+inline int64_t palisade_bytes(const lbcrypto::Plaintext& plain){
+	return (int64_t)(plain->GetElementRingDimension() * sizeof(int64_t));
+}
+
+template<typename Element>
+inline int64_t palisade_relin_key_bytes(){
+	return (int64_t)palisade_relin_keys_serialized<Element>().size();
+}
+
+template<typename Element>
+inline int64_t palisade_rotation_key_bytes(){
+	return (int64_t)palisade_rotation_keys_serialized<Element>().size();
+}
+
+//EvalMultKeyGen() with mult, EvalSumKeyGen() with sum and EvalAtIndexKeyGen()
+//of each index, as tasks of their own on the pool. The scheme generates the
+//keys without touching the context's key maps, they are inserted once all
+//are done.
+template<typename Element>
+void palisade_generate_keys(const lbcrypto::CryptoContext<Element>& cc, const lbcrypto::LPKeyPair<Element>& keys,
+                            bool mult, bool sum, const std::vector<int32_t>& indexes, ThreadPool& pool){
+	typedef std::shared_ptr<std::map<uint32_t, lbcrypto::LPEvalKey<Element>>> EvalKeyMap;
+	auto scheme = cc->GetEncryptionAlgorithm();
+	lbcrypto::LPEvalKey<Element> mult_key;
+	EvalKeyMap sum_keys;
+	std::vector<EvalKeyMap> index_keys(indexes.size());
+	pool.parallel_for(2 + indexes.size(), [&](size_t task){
+		if(task == 0 && mult)
+			mult_key = scheme->EvalMultKeyGen(keys.secretKey);
+		else if(task == 1 && sum)
+			sum_keys = scheme->EvalSumKeyGen(keys.secretKey, keys.publicKey);
+		else if(task >= 2)
+			index_keys[task - 2] = scheme->EvalAtIndexKeyGen(keys.publicKey, keys.secretKey, { indexes[task - 2] });
+	});
+	if(mult)
+		lbcrypto::CryptoContextImpl<Element>::InsertEvalMultKey({ mult_key });
+	if(sum)
+		lbcrypto::CryptoContextImpl<Element>::InsertEvalSumKey(sum_keys);
+	if(!indexes.empty()){
+		EvalKeyMap automorphism_keys = std::make_shared<std::map<uint32_t, lbcrypto::LPEvalKey<Element>>>();
+		for(const EvalKeyMap& part : index_keys)
+			automorphism_keys->insert(part->begin(), part->end());
+		lbcrypto::CryptoContextImpl<Element>::InsertEvalAutomorphismKey(automorphism_keys);
+	}
+}
+
+//The level is the number of RNS towers left in the ciphertext
+template<typename Element>
+inline void palisade_footprint(Footprint& footprint, FootprintRole role,
+                               const lbcrypto::Ciphertext<Element>& ciphertext, long records){
+	footprint.add_ciphertext(role, (int)ciphertext->GetElements()[0].GetNumOfElements(), records,
+	                         palisade_serialize(ciphertext));
+}
+
+template<typename Element>
+class ProfiledCryptoContext{
+public:
+	ProfiledCryptoContext(lbcrypto::CryptoContext<Element> cc, OpProfiler& ops) : cc_(cc), ops_(ops){}
+
+	template<typename T>
+	lbcrypto::Plaintext MakePackedPlaintext(const std::vector<T>& values){
+		lbcrypto::Plaintext plain;
+		ops_.time(HeOp::Encode, NO_LEVEL, [&](){ plain = cc_->MakePackedPlaintext(values); });
+		return plain;
+	}
+
+	template<typename T>
+	lbcrypto::Plaintext MakeCKKSPackedPlaintext(const std::vector<T>& values){
+		lbcrypto::Plaintext plain;
+		ops_.time(HeOp::Encode, NO_LEVEL, [&](){ plain = cc_->MakeCKKSPackedPlaintext(values); });
+		return plain;
+	}
+
+	lbcrypto::Ciphertext<Element> Encrypt(const lbcrypto::LPPublicKey<Element>& public_key, lbcrypto::Plaintext plain){
+		lbcrypto::Ciphertext<Element> result;
+		ops_.time(HeOp::Encrypt, NO_LEVEL, [&](){ result = cc_->Encrypt(public_key, plain); });
+		return result;
+	}
+
+	//One plaintext per column
+	template<typename T>
+	std::vector<lbcrypto::Plaintext> MakePackedPlaintexts(const std::vector<std::vector<T>>& columns, ThreadPool& pool){
+		std::vector<lbcrypto::Plaintext> plains(columns.size());
+		pool.parallel_for(columns.size(), [&](size_t i){ plains[i] = MakePackedPlaintext(columns[i]); });
+		return plains;
+	}
+
+	template<typename T>
+	std::vector<lbcrypto::Plaintext> MakeCKKSPackedPlaintexts(const std::vector<std::vector<T>>& columns, ThreadPool& pool){
+		std::vector<lbcrypto::Plaintext> plains(columns.size());
+		pool.parallel_for(columns.size(), [&](size_t i){ plains[i] = MakeCKKSPackedPlaintext(columns[i]); });
+		return plains;
+	}
+
+	//One ciphertext per plaintext
+	std::vector<lbcrypto::Ciphertext<Element>> Encrypt(const lbcrypto::LPPublicKey<Element>& public_key,
+	                                                   const std::vector<lbcrypto::Plaintext>& plains, ThreadPool& pool){
+		std::vector<lbcrypto::Ciphertext<Element>> ciphertexts(plains.size());
+		pool.parallel_for(plains.size(), [&](size_t i){ ciphertexts[i] = Encrypt(public_key, plains[i]); });
+		return ciphertexts;
+	}
+
+	void Decrypt(const lbcrypto::LPPrivateKey<Element>& secret_key, lbcrypto::Ciphertext<Element> ciphertext,
+	             lbcrypto::Plaintext* plain){
+		ops_.time(HeOp::Decrypt, level(ciphertext), [&](){ cc_->Decrypt(secret_key, ciphertext, plain); });
+	}
+
+	//Decrypt() and decoding of the first count slots into values, straight
+	//from the plaintext's packed slots
+	void DecryptPacked(const lbcrypto::LPPrivateKey<Element>& secret_key, lbcrypto::Ciphertext<Element> ciphertext,
+	                   double* values, size_t count){
+		lbcrypto::Plaintext plain;
+		Decrypt(secret_key, ciphertext, &plain);
+		const std::vector<int64_t>& slots = plain->GetPackedValue();
+		check_values(count, slots.size());
+		std::copy(slots.begin(), slots.begin() + count, values);
+	}
+
+	void DecryptCKKSPacked(const lbcrypto::LPPrivateKey<Element>& secret_key, lbcrypto::Ciphertext<Element> ciphertext,
+	                       double* values, size_t count){
+		lbcrypto::Plaintext plain;
+		Decrypt(secret_key, ciphertext, &plain);
+		const std::vector<std::complex<double>>& slots = plain->GetCKKSPackedValue();
+		check_values(count, slots.size());
+		for(size_t i = 0; i < count; i++)
+			values[i] = slots[i].real();
+	}
+
+	//Ciphertext i fills values[i * stride] on, count values in all
+	void DecryptPacked(const lbcrypto::LPPrivateKey<Element>& secret_key,
+	                   const std::vector<const lbcrypto::Ciphertext<Element>*>& ciphertexts, double* values, size_t count,
+	                   size_t stride, ThreadPool& pool){
+		check_values(count, ciphertexts.size() * stride);
+		pool.parallel_for(ciphertexts.size(), [&](size_t i){
+			size_t first = i * stride;
+			if(first < count)
+				DecryptPacked(secret_key, *ciphertexts[i], values + first, std::min(stride, count - first));
+		});
+	}
+
+	void DecryptCKKSPacked(const lbcrypto::LPPrivateKey<Element>& secret_key,
+	                       const std::vector<const lbcrypto::Ciphertext<Element>*>& ciphertexts, double* values,
+	                       size_t count, size_t stride, ThreadPool& pool){
+		check_values(count, ciphertexts.size() * stride);
+		pool.parallel_for(ciphertexts.size(), [&](size_t i){
+			size_t first = i * stride;
+			if(first < count)
+				DecryptCKKSPacked(secret_key, *ciphertexts[i], values + first, std::min(stride, count - first));
+		});
+	}
+
+	lbcrypto::Ciphertext<Element> EvalAdd(lbcrypto::Ciphertext<Element> a, lbcrypto::Ciphertext<Element> b){
+		lbcrypto::Ciphertext<Element> result;
+		ops_.time(HeOp::Add, level(a), [&](){ result = cc_->EvalAdd(a, b); });
+		return result;
+	}
+
+	lbcrypto::Ciphertext<Element> EvalAdd(lbcrypto::Ciphertext<Element> a, lbcrypto::Plaintext b){
+		lbcrypto::Ciphertext<Element> result;
+		ops_.time(HeOp::AddPlain, level(a), [&](){ result = cc_->EvalAdd(a, b); });
+		return result;
+	}
+
+	lbcrypto::Ciphertext<Element> EvalMult(lbcrypto::Ciphertext<Element> a, lbcrypto::Ciphertext<Element> b){
+		lbcrypto::Ciphertext<Element> result;
+		ops_.time(HeOp::Multiply, level(a), [&](){ result = cc_->EvalMult(a, b); });
+		return result;
+	}
+
+	lbcrypto::Ciphertext<Element> EvalMult(lbcrypto::Ciphertext<Element> a, lbcrypto::Plaintext b){
+		lbcrypto::Ciphertext<Element> result;
+		ops_.time(HeOp::MultiplyPlain, level(a), [&](){ result = cc_->EvalMult(a, b); });
+		return result;
+	}
+
+	lbcrypto::Ciphertext<Element> EvalMultNoRelin(lbcrypto::Ciphertext<Element> a, lbcrypto::Ciphertext<Element> b){
+		lbcrypto::Ciphertext<Element> result;
+		ops_.time(HeOp::Multiply, level(a), [&](){ result = cc_->EvalMultNoRelin(a, b); });
+		return result;
+	}
+
+	lbcrypto::Ciphertext<Element> Relinearize(lbcrypto::Ciphertext<Element> a){
+		lbcrypto::Ciphertext<Element> result;
+		ops_.time(HeOp::Relinearize, level(a), [&](){ result = cc_->Relinearize(a); });
+		return result;
+	}
+
+	lbcrypto::Ciphertext<Element> EvalAddMany(const std::vector<lbcrypto::Ciphertext<Element>>& ciphertexts){
+		lbcrypto::Ciphertext<Element> result;
+		int lvl = ciphertexts.empty() ? NO_LEVEL : level(ciphertexts.front());
+		ops_.time(HeOp::AddMany, lvl, [&](){ result = cc_->EvalAddMany(ciphertexts); });
+		return result;
+	}
+
+	lbcrypto::Ciphertext<Element> EvalMultMany(const std::vector<lbcrypto::Ciphertext<Element>>& ciphertexts){
+		lbcrypto::Ciphertext<Element> result;
+		int lvl = ciphertexts.empty() ? NO_LEVEL : level(ciphertexts.front());
+		ops_.time(HeOp::MultiplyMany, lvl, [&](){ result = cc_->EvalMultMany(ciphertexts); });
+		return result;
+	}
+
+	lbcrypto::Ciphertext<Element> Rescale(lbcrypto::Ciphertext<Element> a){
+		lbcrypto::Ciphertext<Element> result;
+		ops_.time(HeOp::Rescale, level(a), [&](){ result = cc_->Rescale(a); });
+		return result;
+	}
+
+	lbcrypto::Ciphertext<Element> LevelReduce(lbcrypto::Ciphertext<Element> a, size_t levels){
+		lbcrypto::Ciphertext<Element> result;
+		ops_.time(HeOp::ModSwitch, level(a), [&](){ result = cc_->LevelReduce(a, nullptr, levels); });
+		return result;
+	}
+
+	lbcrypto::Ciphertext<Element> EvalAtIndex(lbcrypto::Ciphertext<Element> a, int32_t index){
+		lbcrypto::Ciphertext<Element> result;
+		ops_.time(HeOp::Rotate, level(a), [&](){ result = cc_->EvalAtIndex(a, index); });
+		return result;
+	}
+
+	lbcrypto::Ciphertext<Element> EvalSum(lbcrypto::Ciphertext<Element> a, lbcrypto::usint batch_size){
+		lbcrypto::Ciphertext<Element> result;
+		ops_.time(HeOp::Sum, level(a), [&](){ result = cc_->EvalSum(a, batch_size); });
+		return result;
+	}
+
+	lbcrypto::CryptoContext<Element> unwrapped() const{
+		return cc_;
+	}
+
+	static int level(const lbcrypto::Ciphertext<Element>& ciphertext){
+		return (int)ciphertext->GetLevel();
+	}
+
+private:
+	static void check_values(size_t count, size_t slots){
+		if(count > slots)
+			throw std::invalid_argument(std::to_string(count) + " values from " + std::to_string(slots) + " slots");
+	}
+
+	lbcrypto::CryptoContext<Element> cc_;
+	OpProfiler& ops_;
+};
+
+//Workload backend (fhe_backend.h) over the profiled crypto context. Products
+//are relinearized with the EvalMultKeyGen keys when asked. BGVrns runs with
+//AUTO modulus switching, while the CKKS contexts use APPROXRESCALE, which
+//leaves rescaling and level matching to the caller.
+template<Scheme S, typename Element = lbcrypto::DCRTPoly>
+class PalisadeBackend{
+public:
+	typedef lbcrypto::Ciphertext<Element> Ciphertext;
+	static constexpr bool levelled = SchemeTraits<S>::rescales;
+
+	explicit PalisadeBackend(ProfiledCryptoContext<Element>& he) : he_(he){}
+
+	void add(const Ciphertext& a, const Ciphertext& b, Ciphertext& destination){
+		destination = he_.EvalAdd(a, b);
+	}
+
+	void add_inplace(Ciphertext& a, const Ciphertext& b){
+		a = he_.EvalAdd(a, b);
+	}
+
+	//EvalAddMany() adds the terms pairwise into one list it allocates once
+	void add_many(const std::vector<const Ciphertext*>& terms, Ciphertext& destination){
+		std::vector<Ciphertext> list;
+		list.reserve(terms.size());
+		for(const Ciphertext* term : terms)
+			list.push_back(*term);
+		destination = he_.EvalAddMany(list);
+	}
+
+	void multiply(const Ciphertext& a, const Ciphertext& b, Ciphertext& destination){
+		destination = he_.EvalMultNoRelin(a, b);
+	}
+
+	void square(const Ciphertext& a, Ciphertext& destination){
+		destination = he_.EvalMultNoRelin(a, a);
+	}
+
+	void relinearize(Ciphertext& a){
+		a = he_.Relinearize(a);
+	}
+
+	void rescale(Ciphertext& a){
+		if constexpr(SchemeTraits<S>::rescales)
+			a = he_.Rescale(a);
+	}
+
+	//GetLevel() counts the towers dropped so far
+	void align(Ciphertext& a, Ciphertext& b){
+		if constexpr(SchemeTraits<S>::rescales){
+			int level_a = ProfiledCryptoContext<Element>::level(a);
+			int level_b = ProfiledCryptoContext<Element>::level(b);
+			if(level_a < level_b)
+				a = he_.LevelReduce(a, level_b - level_a);
+			else if(level_b < level_a)
+				b = he_.LevelReduce(b, level_a - level_b);
+		}
+	}
+
+private:
+	ProfiledCryptoContext<Element>& he_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,197 @@
+/****************************************************************/
+/* PALISADE runtime for the registered workloads                */
+/* Author: Majdi Maalej                                         */
+/* One PALISADE crypto context and key pair for a scheme and a  */
+/* parameter table (scheme_traits.h), shared by every workload  */
+/* served with it (workload_runtime.h). The EvalMult keys are   */
+/* only generated when one of the workloads declares them.      */
+/* A worker of a sharded run builds the same context from the   */
+/* table and loads the public key and EvalMult keys the         */
+/* coordinator serialized with public_keys(). It cannot         */
+/* decrypt.                                                     */
+/****************************************************************/
+#ifndef PALISADE_RUNTIME_H
+#define PALISADE_RUNTIME_H
+
+#include "palisade.h"
+#include "palisade_ops.h"
+#include "workload_runtime.h"
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+template<Scheme S, typename Parameters>
+class PalisadeRuntime{
+public:
+	typedef PalisadeBackend<S> Backend;
+	typedef lbcrypto::Ciphertext<lbcrypto::DCRTPoly> Ciphertext;
+
+	//ring_dimension 0 keeps the table's. The keys are generated on the pool.
+	PalisadeRuntime(PhaseProfiler& profiler, OpProfiler& ops, const std::vector<WorkloadDefinition>& workloads,
+	                ThreadPool& pool, long ring_dimension = 0) : profiler_(profiler){
+		build_context(ops, ring_dimension);
+		profiler_.start(Phase::KeyGeneration);
+		keys_ = cc_->KeyGen();
+		has_relin_keys_ = needs_relin_keys(workloads);
+		palisade_generate_keys(cc_, keys_, has_relin_keys_, false, {}, pool);
+		profiler_.stop();
+	}
+
+	//A worker with the keys from public_keys()
+	PalisadeRuntime(PhaseProfiler& profiler, OpProfiler& ops, const std::vector<std::string>& public_keys,
+	                long ring_dimension = 0) : profiler_(profiler){
+		build_context(ops, ring_dimension);
+		if(public_keys.size() != 2)
+			throw std::invalid_argument("expected a public key and EvalMult keys");
+		std::istringstream public_key(public_keys[0]);
+		lbcrypto::Serial::Deserialize(keys_.publicKey, public_key, lbcrypto::SerType::BINARY);
+		has_relin_keys_ = !public_keys[1].empty();
+		if(has_relin_keys_){
+			std::istringstream relin_keys(public_keys[1]);
+			if(!lbcrypto::CryptoContextImpl<lbcrypto::DCRTPoly>::DeserializeEvalMultKey(relin_keys,
+			                                                                           lbcrypto::SerType::BINARY))
+				throw std::runtime_error("could not load the EvalMult keys");
+		}
+	}
+
+	//For each operation, returns the threads it uses
+	static int set_library_threads(int threads){
+		return palisade_set_threads(threads);
+	}
+
+	Backend& backend(){
+		return *backend_;
+	}
+
+	PhaseProfiler& profiler(){
+		return profiler_;
+	}
+
+	long slot_count() const{
+		return slot_count_;
+	}
+
+	uint64_t plain_modulus() const{
+		return Parameters::plain_modulus;
+	}
+
+	int depth() const{
+		return Parameters::depth;
+	}
+
+	Ciphertext ciphertext() const{
+		return Ciphertext();
+	}
+
+	void encrypt(const std::vector<double>& values, Ciphertext& destination){
+		lbcrypto::Plaintext plain;
+		if constexpr(SchemeTraits<S>::exact)
+			plain = he_->MakePackedPlaintext(std::vector<int64_t>(values.begin(), values.end()));
+		else
+			plain = he_->MakeCKKSPackedPlaintext(values);
+		destination = he_->Encrypt(keys_.publicKey, plain);
+	}
+
+	void decrypt(const Ciphertext& ciphertext, std::vector<double>& values){
+		check_secret_key();
+		lbcrypto::Plaintext plain;
+		he_->Decrypt(keys_.secretKey, ciphertext, &plain);
+		if constexpr(SchemeTraits<S>::exact){
+			const std::vector<int64_t>& slots = plain->GetPackedValue();
+			values.assign(slots.begin(), slots.end());
+		}
+		else{
+			values = plain->GetRealPackedValue();
+		}
+	}
+
+	//The first count slots
+	void decrypt(const Ciphertext& ciphertext, double* values, size_t count){
+		check_secret_key();
+		if constexpr(SchemeTraits<S>::exact)
+			he_->DecryptPacked(keys_.secretKey, ciphertext, values, count);
+		else
+			he_->DecryptCKKSPacked(keys_.secretKey, ciphertext, values, count);
+	}
+
+	//Ciphertext i into values[i * stride] on, count values in all
+	void decrypt(const std::vector<const Ciphertext*>& ciphertexts, double* values, size_t count, size_t stride,
+	             ThreadPool& pool){
+		check_secret_key();
+		if constexpr(SchemeTraits<S>::exact)
+			he_->DecryptPacked(keys_.secretKey, ciphertexts, values, count, stride, pool);
+		else
+			he_->DecryptCKKSPacked(keys_.secretKey, ciphertexts, values, count, stride, pool);
+	}
+
+	//The public key and the EvalMult keys, empty when there are none
+	std::vector<std::string> public_keys() const{
+		return { palisade_serialize(keys_.publicKey),
+		         has_relin_keys_ ? palisade_relin_keys_serialized<lbcrypto::DCRTPoly>() : std::string() };
+	}
+
+	std::string save(const Ciphertext& ciphertext) const{
+		return palisade_serialize(ciphertext);
+	}
+
+	void load(const std::string& saved, Ciphertext& ciphertext) const{
+		std::istringstream in(saved);
+		lbcrypto::Serial::Deserialize(ciphertext, in, lbcrypto::SerType::BINARY);
+	}
+
+private:
+	void build_context(OpProfiler& ops, long ring_dimension){
+		using namespace lbcrypto;
+		profiler_.start(Phase::ParameterGeneration);
+		usint ringDim = ring_dimension > 0 ? (usint)ring_dimension : (usint)Parameters::ring_dimension;
+		uint32_t batchSize = std::min<uint32_t>(Parameters::batch_size, ringDim / 2);
+		if constexpr(S == Scheme::BFV){
+			cc_ = CryptoContextFactory<DCRTPoly>::genCryptoContextBFVrns(Parameters::plain_modulus, HEStd_128_classic,
+			                                                             Parameters::sigma, 0, Parameters::depth, 0,
+			                                                             OPTIMIZED, Parameters::key_depth, 0,
+			                                                             Parameters::dcrt_bits, ringDim);
+		}
+		else if constexpr(S == Scheme::BGV){
+			cc_ = CryptoContextFactory<DCRTPoly>::genCryptoContextBGVrns(Parameters::depth, Parameters::plain_modulus,
+			                                                             HEStd_128_classic, Parameters::sigma,
+			                                                             Parameters::depth, OPTIMIZED, BV, ringDim,
+			                                                             Parameters::large_digits,
+			                                                             Parameters::first_modulus_bits,
+			                                                             Parameters::dcrt_bits, 0, batchSize, AUTO);
+		}
+		else{
+			cc_ = CryptoContextFactory<DCRTPoly>::genCryptoContextCKKS(Parameters::depth, Parameters::scale_bits,
+			                                                           batchSize, HEStd_128_classic, ringDim,
+			                                                           APPROXRESCALE, BV, Parameters::large_digits,
+			                                                           Parameters::key_depth,
+			                                                           Parameters::first_modulus_bits, 0, OPTIMIZED);
+		}
+		cc_->Enable(ENCRYPTION);
+		cc_->Enable(SHE);
+		if constexpr(SchemeTraits<S>::levelled)
+			cc_->Enable(LEVELEDSHE);
+		he_.reset(new ProfiledCryptoContext<DCRTPoly>(cc_, ops));
+		backend_.reset(new Backend(*he_));
+		slot_count_ = S == Scheme::BFV ? (long)cc_->GetRingDimension() : (long)batchSize;
+		profiler_.stop();
+	}
+
+	void check_secret_key() const{
+		if(!keys_.secretKey)
+			throw std::logic_error("a sharded worker has no secret key");
+	}
+
+	PhaseProfiler& profiler_;
+	lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cc_;
+	lbcrypto::LPKeyPair<lbcrypto::DCRTPoly> keys_;
+	std::unique_ptr<ProfiledCryptoContext<lbcrypto::DCRTPoly>> he_;
+	std::unique_ptr<Backend> backend_;
+	long slot_count_ = 0;
+	bool has_relin_keys_ = false;
+};
+
+#endif
@@ -0,0 +1,285 @@
+/****************************************************************/
+/* Hardware performance counters shared by all calculators      */
+/* Author: Majdi Maalej                                         */
+/* Set FHE_PERF_COUNTERS=1 to count cycles, instructions, last  */
+/* level cache misses, branch misses and dTLB misses with       */
+/* perf_event_open around every phase and every homomorphic     */
+/* operation, including the threads the libraries start. The    */
+/* report gives IPC and events per operation. Counters the host */
+/* or the perf_event_paranoid setting does not allow are shown  */
+/* as n/a and the run continues without them.                   */
+/* Set FHE_PERF_CSV=<file> to append the results as CSV.        */
+/****************************************************************/
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include "phase_profiler.h"
+#include "op_profiler.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+enum class PerfEvent { Cycles, Instructions, LLCMisses, BranchMisses, DTLBMisses };
+const int PERF_EVENT_COUNT = 5;
+
+inline const char* perf_event_key(PerfEvent event){
+	switch(event){
+		case PerfEvent::Cycles:       return "cycles";
+		case PerfEvent::Instructions: return "instructions";
+		case PerfEvent::LLCMisses:    return "llc_misses";
+		case PerfEvent::BranchMisses: return "branch_misses";
+		case PerfEvent::DTLBMisses:   return "dtlb_misses";
+	}
+	return "unknown";
+}
+
+struct PerfSample{
+	uint64_t values[PERF_EVENT_COUNT] = {};
+
+	PerfSample& operator+=(const PerfSample& other){
+		for(int e = 0; e < PERF_EVENT_COUNT; e++)
+			values[e] += other.values[e];
+		return *this;
+	}
+
+	PerfSample operator-(const PerfSample& other) const{
+		PerfSample s;
+		for(int e = 0; e < PERF_EVENT_COUNT; e++)
+			s.values[e] = values[e] - other.values[e];
+		return s;
+	}
+
+	uint64_t operator[](PerfEvent event) const{
+		return values[(int)event];
+	}
+};
+
+class PerfCounters : public PhaseListener, public OpListener{
+public:
+	PerfCounters(PhaseProfiler& profiler, OpProfiler& ops) : profiler_(profiler), ops_(ops){
+		for(int e = 0; e < PERF_EVENT_COUNT; e++)
+			fds_[e] = -1;
+		const char* enabled = getenv("FHE_PERF_COUNTERS");
+		enabled_ = enabled != nullptr && atoi(enabled) != 0;
+		if(!enabled_)
+			return;
+		open_all();
+		if(available_ == 0)
+			return;
+		profiler_.add_listener(this);
+		ops_.add_listener(this);
+	}
+
+	~PerfCounters(){
+		for(int e = 0; e < PERF_EVENT_COUNT; e++){
+			if(fds_[e] >= 0)
+				close(fds_[e]);
+		}
+	}
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	bool available(PerfEvent event) const{
+		return fds_[(int)event] >= 0;
+	}
+
+	//Counter values so far, scaled up when the kernel had to multiplex them
+	PerfSample read_all() const{
+		PerfSample s;
+#ifdef __linux__
+		for(int e = 0; e < PERF_EVENT_COUNT; e++){
+			if(fds_[e] < 0)
+				continue;
+			uint64_t data[3]; //value, time enabled, time running
+			if(read(fds_[e], data, sizeof(data)) != (ssize_t)sizeof(data))
+				continue;
+			s.values[e] = data[2] > 0 && data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+		}
+#endif
+		return s;
+	}
+
+	void phase_started(Phase) override{
+		phase_start_ = read_all();
+	}
+
+	void phase_stopped(Phase phase) override{
+		phases_[(int)phase] += read_all() - phase_start_;
+	}
+
+	void op_started(HeOp) override{
+		op_start_ = read_all();
+	}
+
+	void op_stopped(HeOp op) override{
+		ops_samples_[(int)op] += read_all() - op_start_;
+		op_counts_[(int)op]++;
+	}
+
+	void report(std::ostream& out) const{
+		if(!enabled_)
+			return;
+		if(available_ == 0){
+			out << "Hardware counters unavailable: " << error_ << std::endl;
+			return;
+		}
+
+		out << "Hardware counters per phase:" << std::endl;
+		out << "                        " << std::setw(16) << "Cycles" << std::setw(16) << "Instructions"
+		    << std::setw(8) << "IPC" << std::setw(14) << "LLC miss/op" << std::setw(14) << "Branch miss/op"
+		    << std::setw(14) << "dTLB miss/op" << std::endl;
+		for(int p = 0; p < PHASE_COUNT; p++){
+			if(profiler_.samples((Phase)p).empty())
+				continue;
+			print_row(out, phase_name((Phase)p), phases_[p], ops_.count((Phase)p));
+		}
+
+		out << "Hardware counters per operation:" << std::endl;
+		out << "                        " << std::setw(16) << "Cycles/op" << std::setw(16) << "Instr/op"
+		    << std::setw(8) << "IPC" << std::setw(14) << "LLC miss/op" << std::setw(14) << "Branch miss/op"
+		    << std::setw(14) << "dTLB miss/op" << std::endl;
+		for(int o = 0; o < HE_OP_COUNT; o++){
+			if(op_counts_[o] == 0)
+				continue;
+			print_row(out, op_name((HeOp)o), ops_samples_[o], op_counts_[o], true);
+		}
+		if(available_ < PERF_EVENT_COUNT)
+			out << "Some counters are unavailable (" << error_ << ")" << std::endl;
+
+		const char* csv_path = getenv("FHE_PERF_CSV");
+		if(csv_path != nullptr && *csv_path != '\0')
+			append_csv(csv_path);
+	}
+
+	static void write_csv_header(std::ostream& out){
+		out << "program,scope,name,count";
+		for(int e = 0; e < PERF_EVENT_COUNT; e++)
+			out << "," << perf_event_key((PerfEvent)e);
+		out << std::endl;
+	}
+
+	//Unavailable counters are left empty
+	void write_csv(std::ostream& out) const{
+		for(int p = 0; p < PHASE_COUNT; p++){
+			if(profiler_.samples((Phase)p).empty())
+				continue;
+			write_csv_row(out, "phase", phase_key((Phase)p), ops_.count((Phase)p), phases_[p]);
+		}
+		for(int o = 0; o < HE_OP_COUNT; o++){
+			if(op_counts_[o] > 0)
+				write_csv_row(out, "operation", op_name((HeOp)o), op_counts_[o], ops_samples_[o]);
+		}
+	}
+
+	void append_csv(const std::string& path) const{
+		bool empty;
+		{
+			std::ifstream in(path);
+			empty = !in.good() || in.peek() == std::ifstream::traits_type::eof();
+		}
+		std::ofstream out(path, std::ios::app);
+		if(!out){
+			std::cerr << "Could not open " << path << " for writing" << std::endl;
+			return;
+		}
+		if(empty)
+			write_csv_header(out);
+		write_csv(out);
+	}
+
+private:
+	void open_all(){
+#ifdef __linux__
+		const uint32_t types[PERF_EVENT_COUNT] = {
+			PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE };
+		const uint64_t configs[PERF_EVENT_COUNT] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES,
+			PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) };
+		for(int e = 0; e < PERF_EVENT_COUNT; e++){
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[e];
+			attr.config = configs[e];
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.inherit = 1; //threads started later by the libraries
+			fds_[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+			if(fds_[e] < 0){
+				error_ = std::string(perf_event_key((PerfEvent)e)) + ": " + strerror(errno);
+				continue;
+			}
+			available_++;
+		}
+#else
+		error_ = "perf_event_open is only available on Linux";
+#endif
+	}
+
+	void print_row(std::ostream& out, const char* label, const PerfSample& s, long ops, bool per_op = false) const{
+		double divisor = per_op && ops > 0 ? (double)ops : 1.0;
+		out << std::left << std::setw(22) << label << std::right << ": " << std::fixed << std::setprecision(0);
+		print_value(out, 16, PerfEvent::Cycles, s[PerfEvent::Cycles] / divisor);
+		print_value(out, 16, PerfEvent::Instructions, s[PerfEvent::Instructions] / divisor);
+		out << std::setprecision(2);
+		if(available(PerfEvent::Cycles) && available(PerfEvent::Instructions) && s[PerfEvent::Cycles] > 0)
+			out << std::setw(8) << (double)s[PerfEvent::Instructions] / s[PerfEvent::Cycles];
+		else
+			out << std::setw(8) << "n/a";
+		out << std::setprecision(1);
+		for(PerfEvent e : { PerfEvent::LLCMisses, PerfEvent::BranchMisses, PerfEvent::DTLBMisses }){
+			if(ops > 0)
+				print_value(out, 14, e, (double)s[e] / ops);
+			else
+				out << std::setw(14) << "-";
+		}
+		out << std::defaultfloat << std::endl;
+	}
+
+	void print_value(std::ostream& out, int width, PerfEvent event, double value) const{
+		if(available(event))
+			out << std::setw(width) << value;
+		else
+			out << std::setw(width) << "n/a";
+	}
+
+	void write_csv_row(std::ostream& out, const char* scope, const char* name, long count, const PerfSample& s) const{
+		out << profiler_.program() << "," << scope << "," << name << "," << count;
+		for(int e = 0; e < PERF_EVENT_COUNT; e++){
+			out << ",";
+			if(available((PerfEvent)e))
+				out << s.values[e];
+		}
+		out << std::endl;
+	}
+
+	PhaseProfiler& profiler_;
+	OpProfiler& ops_;
+	bool enabled_ = false;
+	int available_ = 0;
+	std::string error_;
+	int fds_[PERF_EVENT_COUNT];
+	PerfSample phase_start_;
+	PerfSample op_start_;
+	PerfSample phases_[PHASE_COUNT];
+	PerfSample ops_samples_[HE_OP_COUNT];
+	long op_counts_[HE_OP_COUNT] = {};
+};
+
+#endif
@@ -0,0 +1,243 @@
+/****************************************************************/
+/* Phase profiler shared by all calculators                     */
+/* Author: Majdi Maalej                                         */
+/* Records monotonic wall time, process CPU time and the CPU    */
+/* time of the calling thread for every phase, in nanoseconds.  */
+/* Set FHE_PROFILE_CSV=<file> to append the results as CSV,     */
+/* each row tagged with the ring dimension, records and threads */
+/* the run used so the configurations of a sweep stay apart.    */
+/****************************************************************/
+#ifndef PHASE_PROFILER_H
+#define PHASE_PROFILER_H
+
+#include <time.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+
+enum class Phase { ParameterGeneration, KeyGeneration, Encryption, Evaluation, Decryption };
+const int PHASE_COUNT = 5;
+
+inline const char* phase_name(Phase phase){
+	switch(phase){
+		case Phase::ParameterGeneration: return "Parameter Generation";
+		case Phase::KeyGeneration:       return "Key Generation";
+		case Phase::Encryption:          return "Encryption";
+		case Phase::Evaluation:          return "Evaluation";
+		case Phase::Decryption:          return "Decryption";
+	}
+	return "Unknown";
+}
+
+//Identifier used in the machine-readable output
+inline const char* phase_key(Phase phase){
+	switch(phase){
+		case Phase::ParameterGeneration: return "parameter_generation";
+		case Phase::KeyGeneration:       return "key_generation";
+		case Phase::Encryption:          return "encryption";
+		case Phase::Evaluation:          return "evaluation";
+		case Phase::Decryption:          return "decryption";
+	}
+	return "unknown";
+}
+
+inline int64_t read_clock_ns(clockid_t clock_id){
+	struct timespec ts;
+	clock_gettime(clock_id, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct PhaseTimes{
+	int64_t wall_ns = 0;        //CLOCK_MONOTONIC
+	int64_t process_cpu_ns = 0; //CLOCK_PROCESS_CPUTIME_ID, all threads
+	int64_t thread_cpu_ns = 0;  //CLOCK_THREAD_CPUTIME_ID, calling thread only
+
+	static PhaseTimes now(){
+		PhaseTimes t;
+		t.wall_ns = read_clock_ns(CLOCK_MONOTONIC);
+		t.process_cpu_ns = read_clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+		t.thread_cpu_ns = read_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+		return t;
+	}
+
+	PhaseTimes& operator+=(const PhaseTimes& other){
+		wall_ns += other.wall_ns;
+		process_cpu_ns += other.process_cpu_ns;
+		thread_cpu_ns += other.thread_cpu_ns;
+		return *this;
+	}
+
+	PhaseTimes operator-(const PhaseTimes& other) const{
+		PhaseTimes t;
+		t.wall_ns = wall_ns - other.wall_ns;
+		t.process_cpu_ns = process_cpu_ns - other.process_cpu_ns;
+		t.thread_cpu_ns = thread_cpu_ns - other.thread_cpu_ns;
+		return t;
+	}
+};
+
+//What a run was configured with, 0 where it is not known
+struct ProfileConfiguration{
+	long ring_dimension = 0;
+	long records = 0;
+	int threads = 0;         //thread pool size
+	int library_threads = 0; //inside each library operation
+};
+
+//Notified around every timed phase, outside of the measured interval
+class PhaseListener{
+public:
+	virtual ~PhaseListener(){}
+	virtual void phase_started(Phase phase) = 0;
+	virtual void phase_stopped(Phase phase) = 0;
+};
+
+//Phases are timed with start()/stop(). Every phase keeps one sample per
+//trial; starting a phase again adds to its current sample, so a phase may be
+//split around another one. new_trial() opens a fresh sample (see benchmark.h).
+class PhaseProfiler{
+public:
+	explicit PhaseProfiler(const std::string& program) : program_(program){}
+
+	void start(Phase phase){
+		if(running_)
+			stop();
+		if(samples_[(int)phase].empty())
+			samples_[(int)phase].push_back(PhaseTimes());
+		for(PhaseListener* listener : listeners_)
+			listener->phase_started(phase);
+		current_ = phase;
+		running_ = true;
+		started_ = PhaseTimes::now();
+	}
+
+	void stop(){
+		if(!running_)
+			return;
+		samples_[(int)current_].back() += PhaseTimes::now() - started_;
+		running_ = false;
+		for(PhaseListener* listener : listeners_)
+			listener->phase_stopped(current_);
+	}
+
+	void add_listener(PhaseListener* listener){
+		listeners_.push_back(listener);
+	}
+
+	void new_trial(Phase phase){
+		if(running_ && current_ == phase)
+			stop();
+		samples_[(int)phase].push_back(PhaseTimes());
+	}
+
+	bool running() const{
+		return running_;
+	}
+
+	Phase current() const{
+		return current_;
+	}
+
+	const std::vector<PhaseTimes>& samples(Phase phase) const{
+		return samples_[(int)phase];
+	}
+
+	//Sum over all trials of the phase
+	PhaseTimes total(Phase phase) const{
+		PhaseTimes sum;
+		for(const PhaseTimes& t : samples_[(int)phase])
+			sum += t;
+		return sum;
+	}
+
+	//Mean over all trials of the phase
+	PhaseTimes times(Phase phase) const{
+		const std::vector<PhaseTimes>& s = samples_[(int)phase];
+		PhaseTimes mean = total(phase);
+		if(s.size() > 1){
+			mean.wall_ns /= (int64_t)s.size();
+			mean.process_cpu_ns /= (int64_t)s.size();
+			mean.thread_cpu_ns /= (int64_t)s.size();
+		}
+		return mean;
+	}
+
+	const std::string& program() const{
+		return program_;
+	}
+
+	void set_configuration(const ProfileConfiguration& configuration){
+		configuration_ = configuration;
+	}
+
+	//Human-readable table, followed by the CSV dump when FHE_PROFILE_CSV is set
+	void report(std::ostream& out) const{
+		out << "Times (seconds):" << std::endl;
+		out << "                        " << std::setw(14) << "Wall" << std::setw(14) << "Process CPU"
+		    << std::setw(14) << "Thread CPU" << std::endl;
+		for(int p = 0; p < PHASE_COUNT; p++){
+			PhaseTimes t = times((Phase)p);
+			out << std::left << std::setw(22) << phase_name((Phase)p) << std::right << ": "
+			    << std::fixed << std::setprecision(9)
+			    << std::setw(14) << t.wall_ns / 1e9
+			    << std::setw(14) << t.process_cpu_ns / 1e9
+			    << std::setw(14) << t.thread_cpu_ns / 1e9;
+			if(samples_[p].size() > 1)
+				out << "  (mean of " << samples_[p].size() << " trials)";
+			out << std::endl;
+		}
+		out << std::defaultfloat;
+
+		const char* csv_path = getenv("FHE_PROFILE_CSV");
+		if(csv_path != nullptr && *csv_path != '\0')
+			append_csv(csv_path);
+	}
+
+	static void write_csv_header(std::ostream& out){
+		out << "program,ring_dimension,records,threads,library_threads,phase,trial,wall_ns,process_cpu_ns,thread_cpu_ns"
+		    << std::endl;
+	}
+
+	void write_csv(std::ostream& out) const{
+		for(int p = 0; p < PHASE_COUNT; p++){
+			for(size_t trial = 0; trial < samples_[p].size(); trial++){
+				const PhaseTimes& t = samples_[p][trial];
+				out << program_ << "," << configuration_.ring_dimension << "," << configuration_.records << ","
+				    << configuration_.threads << "," << configuration_.library_threads << "," << phase_key((Phase)p)
+				    << "," << trial << "," << t.wall_ns << "," << t.process_cpu_ns << "," << t.thread_cpu_ns << std::endl;
+			}
+		}
+	}
+
+	//Appends to the file, writing the header only when the file is new or empty
+	void append_csv(const std::string& path) const{
+		bool empty;
+		{
+			std::ifstream in(path);
+			empty = !in.good() || in.peek() == std::ifstream::traits_type::eof();
+		}
+		std::ofstream out(path, std::ios::app);
+		if(!out){
+			std::cerr << "Could not open " << path << " for writing" << std::endl;
+			return;
+		}
+		if(empty)
+			write_csv_header(out);
+		write_csv(out);
+	}
+
+private:
+	std::string program_;
+	ProfileConfiguration configuration_;
+	std::vector<PhaseTimes> samples_[PHASE_COUNT];
+	PhaseTimes started_;
+	Phase current_ = Phase::ParameterGeneration;
+	bool running_ = false;
+	std::vector<PhaseListener*> listeners_;
+};
+
+#endif
@@ -0,0 +1,241 @@
+/****************************************************************/
+/* Streaming pipeline of chunk-sized work items                 */
+/* Author: Majdi Maalej                                         */
+/* run_pipeline() passes count items through a list of stages,  */
+/* each with its own worker threads, connected by bounded       */
+/* lock-free queues (BoundedQueue, Vyukov's array queue). The   */
+/* first stage creates item i, the later ones take items from   */
+/* the queue before them, so while a stage works on item k the  */
+/* one before it can already work on item k + 1. A full queue   */
+/* blocks the stage feeding it, which bounds the items alive.   */
+/* For every stage it returns the busy time, the time its       */
+/* workers waited on a full queue after them (backpressure) and */
+/* on an empty queue before them (starvation); occupancy() is   */
+/* the busy share of the stage's workers over the pipeline.     */
+/* Workers run thread_setup() (thread_pool.h) first. The first  */
+/* exception a stage throws stops the pipeline and is rethrown. */
+/****************************************************************/
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "thread_pool.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//Multi-producer multi-consumer queue of a fixed capacity. push() and pop()
+//never block, they fail when the queue is full or empty.
+template<typename T>
+class BoundedQueue{
+public:
+	explicit BoundedQueue(size_t capacity) : capacity_(capacity), cells_(capacity){
+		if(capacity == 0)
+			throw std::invalid_argument("a queue needs room for one item");
+		for(size_t i = 0; i < capacity; i++)
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	//Moves from value only when there was room
+	bool push(T& value){
+		size_t position = tail_.load(std::memory_order_relaxed);
+		for(;;){
+			Cell& cell = cells_[position % capacity_];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			if(sequence == position){
+				if(tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+					cell.value = std::move(value);
+					cell.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if(sequence < position){
+				return false;
+			}
+			else{
+				position = tail_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool pop(T& value){
+		size_t position = head_.load(std::memory_order_relaxed);
+		for(;;){
+			Cell& cell = cells_[position % capacity_];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			if(sequence == position + 1){
+				if(head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+					value = std::move(cell.value);
+					cell.sequence.store(position + capacity_, std::memory_order_release);
+					return true;
+				}
+			}
+			else if(sequence < position + 1){
+				return false;
+			}
+			else{
+				position = head_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	struct Cell{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	size_t capacity_;
+	std::vector<Cell> cells_;
+	alignas(64) std::atomic<size_t> tail_{0};
+	alignas(64) std::atomic<size_t> head_{0};
+};
+
+template<typename Item>
+struct PipelineStage{
+	std::string name;
+	int workers = 1;
+	std::function<void(long index, Item& item)> body;
+};
+
+struct StageStats{
+	std::string name;
+	int workers = 0;
+	long items = 0;
+	int64_t busy_ns = 0;
+	int64_t blocked_ns = 0; //waiting on a full queue after the stage
+	int64_t starved_ns = 0; //waiting on an empty queue before the stage
+	int64_t wall_ns = 0;    //of the whole pipeline
+
+	double occupancy() const{
+		return workers > 0 && wall_ns > 0 ? (double)busy_ns / ((double)workers * wall_ns) : 0;
+	}
+};
+
+//depth is the capacity of every queue between two stages
+template<typename Item>
+std::vector<StageStats> run_pipeline(long count, size_t depth, const std::vector<PipelineStage<Item>>& stages){
+	typedef std::chrono::steady_clock Clock;
+	typedef std::pair<long, std::unique_ptr<Item>> Work;
+	auto elapsed_ns = [](Clock::time_point started){
+		return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count();
+	};
+
+	size_t n = stages.size();
+	std::vector<std::unique_ptr<BoundedQueue<Work>>> queues;
+	for(size_t s = 0; s + 1 < n; s++)
+		queues.emplace_back(new BoundedQueue<Work>(depth));
+	std::vector<std::atomic<long>> claimed(n);
+	for(std::atomic<long>& c : claimed)
+		c.store(0);
+	std::vector<StageStats> stats(n);
+	std::mutex mutex;
+	std::atomic<bool> failed{false};
+	std::exception_ptr error;
+
+	//Spins, then yields, then sleeps while the other stages catch up
+	auto wait = [&](int& spins){
+		if(++spins < 64)
+			return;
+		if(spins < 128)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+	};
+
+	auto worker = [&](size_t s, std::function<void()> setup){
+		StageStats mine;
+		try{
+			if(setup)
+				setup();
+			//Every stage handles count items, whichever of its workers takes them
+			long index;
+			while(!failed && (index = claimed[s].fetch_add(1)) < count){
+				Work work;
+				if(s == 0){
+					work.first = index;
+					work.second.reset(new Item());
+				}
+				else{
+					Clock::time_point started = Clock::now();
+					int spins = 0;
+					while(!queues[s - 1]->pop(work) && !failed)
+						wait(spins);
+					mine.starved_ns += elapsed_ns(started);
+					if(!work.second)
+						break;
+				}
+
+				Clock::time_point started = Clock::now();
+				stages[s].body(work.first, *work.second);
+				mine.busy_ns += elapsed_ns(started);
+				mine.items++;
+
+				if(s + 1 < n){
+					started = Clock::now();
+					int spins = 0;
+					while(!queues[s]->push(work) && !failed)
+						wait(spins);
+					mine.blocked_ns += elapsed_ns(started);
+				}
+			}
+		}
+		catch(...){
+			std::lock_guard<std::mutex> lock(mutex);
+			if(!error)
+				error = std::current_exception();
+			failed = true;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		stats[s].items += mine.items;
+		stats[s].busy_ns += mine.busy_ns;
+		stats[s].blocked_ns += mine.blocked_ns;
+		stats[s].starved_ns += mine.starved_ns;
+	};
+
+	Clock::time_point started = Clock::now();
+	std::vector<std::thread> threads;
+	for(size_t s = 0; s < n; s++){
+		stats[s].name = stages[s].name;
+		stats[s].workers = std::max(1, stages[s].workers);
+		for(int w = 0; w < stats[s].workers; w++)
+			threads.emplace_back(worker, s, thread_setup());
+	}
+	for(std::thread& thread : threads)
+		thread.join();
+	int64_t wall_ns = elapsed_ns(started);
+	for(StageStats& stage : stats)
+		stage.wall_ns = wall_ns;
+	if(error)
+		std::rethrow_exception(error);
+	return stats;
+}
+
+inline void report_stages(std::ostream& out, const std::vector<StageStats>& stages){
+	out << "                        " << std::setw(9) << "Workers" << std::setw(9) << "Items" << std::setw(14) << "Busy (s)"
+	    << std::setw(14) << "Blocked (s)" << std::setw(14) << "Starved (s)" << std::setw(12) << "Occupancy" << std::endl;
+	for(const StageStats& stage : stages){
+		out << std::left << std::setw(22) << stage.name << std::right << ": " << std::setw(9) << stage.workers
+		    << std::setw(9) << stage.items << std::fixed << std::setprecision(6) << std::setw(14) << stage.busy_ns / 1e9
+		    << std::setw(14) << stage.blocked_ns / 1e9 << std::setw(14) << stage.starved_ns / 1e9
+		    << std::setprecision(1) << std::setw(11) << stage.occupancy() * 100 << "%" << std::endl;
+	}
+	out << std::defaultfloat << std::setprecision(6);
+}
+
+#endif
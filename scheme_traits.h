@@ -0,0 +1,172 @@
+/****************************************************************/
+/* Compile-time scheme traits and parameter tables              */
+/* Author: Majdi Maalej                                         */
+/* SchemeTraits<S> holds what follows from the scheme alone:    */
+/* exact or approximate arithmetic, whether products move down  */
+/* the modulus chain, and the slots of a ring. The parameter    */
+/* tables hold the values every calculator of a library passes  */
+/* to it for a scheme and a workload (workloads.h): ring        */
+/* dimension, modulus chain, plaintext modulus, scale and depth */
+/* budget. They are checked when instantiated:                  */
+/*  - the modulus chain is within the 128-bit bound of the      */
+/*    homomorphic encryption standard at the default ring       */
+/*  - the plaintext modulus is a prime that allows batching     */
+/*  - the workload's largest value fits the plaintext modulus   */
+/*    and its depth fits the budget                             */
+/* FHE_RING_DIM still overrides the ring at run time, the       */
+/* libraries check the bound again for it.                      */
+/****************************************************************/
+#ifndef SCHEME_TRAITS_H
+#define SCHEME_TRAITS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+
+enum class Scheme { BFV, BGV, CKKS };
+
+inline const char* scheme_name(Scheme scheme){
+	switch(scheme){
+		case Scheme::BFV:  return "BFV";
+		case Scheme::BGV:  return "BGV";
+		case Scheme::CKKS: return "CKKS";
+	}
+	return "unknown";
+}
+
+//Largest total modulus for 128-bit classical security with a ternary
+//secret, 0 for a ring dimension the standard does not list
+constexpr int he_standard_max_bits(size_t ring_dimension){
+	switch(ring_dimension){
+		case 1024:  return 27;
+		case 2048:  return 54;
+		case 4096:  return 109;
+		case 8192:  return 218;
+		case 16384: return 438;
+		case 32768: return 881;
+	}
+	return 0;
+}
+
+constexpr bool is_prime(uint64_t n){
+	if(n < 2)
+		return false;
+	for(uint64_t d = 2; d * d <= n; d++){
+		if(n % d == 0)
+			return false;
+	}
+	return true;
+}
+
+//Batching needs a prime congruent to 1 modulo twice the ring dimension
+constexpr bool batching_modulus(uint64_t plain_modulus, size_t ring_dimension){
+	return is_prime(plain_modulus) && plain_modulus % (2 * ring_dimension) == 1;
+}
+
+template<size_t N>
+constexpr int total_bits(const std::array<int, N>& bit_sizes){
+	int total = 0;
+	for(int bits : bit_sizes)
+		total += bits;
+	return total;
+}
+
+//Batching primes for every ring dimension up to 32768
+const uint64_t PLAIN_MODULUS_17_BITS = 65537;      //2^16 + 1
+const uint64_t PLAIN_MODULUS_31_BITS = 2147352577; //2^31 - 2^17 + 1
+
+template<Scheme S>
+struct SchemeTraits{
+	static constexpr Scheme scheme = S;
+	//Integer arithmetic modulo the plaintext modulus, CKKS is approximate
+	static constexpr bool exact = S != Scheme::CKKS;
+	//A product moves down the modulus chain: CKKS rescales, BGV switches
+	//modulus. BFV keeps its whole modulus.
+	static constexpr bool levelled = S != Scheme::BFV;
+	static constexpr bool rescales = S == Scheme::CKKS;
+
+	//CKKS packs complex numbers, BFV and BGV a 2 x n/2 matrix
+	static constexpr size_t slot_count(size_t ring_dimension){
+		return S == Scheme::CKKS ? ring_dimension / 2 : ring_dimension;
+	}
+};
+
+//What the tables check against a workload: its largest result below the
+//plaintext modulus (0 for CKKS) and its depth within the budget (0 when
+//the library derives the levels itself)
+constexpr bool fits_plain_modulus(uint64_t largest_value, uint64_t plain_modulus){
+	return plain_modulus == 0 || largest_value < plain_modulus;
+}
+
+constexpr bool fits_depth(int depth, int depth_budget){
+	return depth_budget == 0 || depth <= depth_budget;
+}
+
+//SEAL: the first prime keeps the result, the last one is the special
+//prime of key switching and each one between is a level
+template<Scheme S, typename Workload>
+struct SealParameters : SchemeTraits<S>{
+	static constexpr size_t ring_dimension = 32768;
+	static constexpr std::array<int, 6> coeff_modulus_bits = {{ 55, 46, 46, 46, 46, 60 }};
+	static constexpr int modulus_bits = total_bits(coeff_modulus_bits);
+	static constexpr int depth = (int)coeff_modulus_bits.size() - 2;
+	static constexpr uint64_t plain_modulus = SchemeTraits<S>::exact ? Workload::plain_modulus : 0;
+	static constexpr int scale_bits = 40;
+	static constexpr size_t slot_count = SchemeTraits<S>::slot_count(ring_dimension);
+	static constexpr long batch_size = 8192; //records per ciphertext
+
+	static_assert(!SchemeTraits<S>::exact || batching_modulus(plain_modulus, ring_dimension),
+	              "SEAL batching needs a prime plaintext modulus equal to 1 modulo 2n");
+	static_assert(batch_size <= (long)slot_count, "more records than slots");
+	static_assert(modulus_bits <= he_standard_max_bits(ring_dimension), "over the 128-bit security bound");
+	static_assert(fits_plain_modulus(Workload::largest_value, plain_modulus), "the results do not fit the plaintext modulus");
+	static_assert(fits_depth(Workload::depth, depth), "the workload is deeper than the depth budget");
+};
+
+//HElib derives the levels from the bits of the chain, so there is no
+//depth budget to check (0). The slots of BGV depend on how the
+//plaintext modulus splits the cyclotomic polynomial.
+template<Scheme S, typename Workload>
+struct HElibParameters : SchemeTraits<S>{
+	static_assert(S != Scheme::BFV, "HElib has no BFV");
+	static constexpr size_t ring_dimension = 16384; //phi(m) for m = 2n
+	static constexpr int modulus_bits = 299;
+	static constexpr int key_switching_columns = 3;
+	static constexpr int hensel_lifting = 1;
+	static constexpr int depth = 0;
+	static constexpr uint64_t plain_modulus = SchemeTraits<S>::exact ? Workload::plain_modulus : 0;
+	static constexpr int scale_bits = 40; //precision
+
+	static_assert(!SchemeTraits<S>::exact || is_prime(plain_modulus), "HElib needs a prime plaintext modulus");
+	static_assert(modulus_bits <= he_standard_max_bits(ring_dimension), "over the 128-bit security bound");
+	static_assert(fits_plain_modulus(Workload::largest_value, plain_modulus), "the results do not fit the plaintext modulus");
+	static_assert(fits_depth(Workload::depth, depth), "the workload is deeper than the depth budget");
+};
+
+//PALISADE sizes the chain from the depth: a first tower and one per
+//level, all dcrt_bits wide for BFV, scale_bits wide for CKKS
+template<Scheme S, typename Workload, int Depth = 3>
+struct PalisadeParameters : SchemeTraits<S>{
+	static constexpr size_t ring_dimension = 32768;
+	static constexpr int depth = Depth;
+	static constexpr int key_depth = 3; //highest power of the secret key with keys
+	static constexpr double sigma = 3.2;
+	static constexpr int first_modulus_bits = 55;
+	static constexpr int dcrt_bits = 60;
+	static constexpr int scale_bits = 40;
+	static constexpr int large_digits = 6;
+	static constexpr int modulus_bits = S == Scheme::BFV ? (depth + 1) * dcrt_bits
+	                                  : first_modulus_bits + depth * (S == Scheme::CKKS ? scale_bits : dcrt_bits);
+	static constexpr uint64_t plain_modulus = SchemeTraits<S>::exact ? Workload::plain_modulus : 0;
+	static constexpr size_t slot_count = SchemeTraits<S>::slot_count(ring_dimension);
+	static constexpr long batch_size = 8192; //records per ciphertext
+
+	static_assert(!SchemeTraits<S>::exact || batching_modulus(plain_modulus, ring_dimension),
+	              "PALISADE batching needs a prime plaintext modulus equal to 1 modulo 2n");
+	static_assert(batch_size <= (long)slot_count, "more records than slots");
+	static_assert(modulus_bits <= he_standard_max_bits(ring_dimension), "over the 128-bit security bound");
+	static_assert(fits_plain_modulus(Workload::largest_value, plain_modulus), "the results do not fit the plaintext modulus");
+	static_assert(fits_depth(Workload::depth, depth), "the workload is deeper than the depth budget");
+};
+
+#endif
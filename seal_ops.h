@@ -0,0 +1,396 @@
+/****************************************************************/
+/* Profiled SEAL evaluator, encryptor, decryptor and encoders   */
+/* Author: Majdi Maalej                                         */
+/* Drop-in replacements for the SEAL classes used by the        */
+/* calculators: every call is recorded in the OpProfiler with   */
+/* the chain index of its input ciphertext as the level.        */
+/* Also provides the byte sizes used by the memory profiler and */
+/* the serialized forms used by the footprint report, and the   */
+/* SealBackend the workloads are instantiated with.             */
+/* The batch overloads encode or encrypt independent columns in */
+/* parallel on a thread pool (thread_pool.h); seal_decrypt()    */
+/* decrypts and decodes many results at once into one buffer.   */
+/* seal_create_keys() generates the independent keys side by    */
+/* side on the pool.                                            */
+/* seal_set_threads() is the library side of FHE_THREADS: SEAL  */
+/* runs each operation on the calling thread.                   */
+/****************************************************************/
+#ifndef SEAL_OPS_H
+#define SEAL_OPS_H
+
+#include "seal/seal.h"
+#include "op_profiler.h"
+#include "footprint.h"
+#include "fhe_backend.h"
+#include "thread_pool.h"
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//Returns the threads each operation uses
+inline int seal_set_threads(int){
+	return 1;
+}
+
+inline int seal_level(const seal::SEALContext& context, const seal::Ciphertext& ciphertext){
+	return (int)context.get_context_data(ciphertext.parms_id())->chain_index();
+}
+
+//In-memory size of the polynomial data
+inline int64_t seal_bytes(const seal::Ciphertext& ciphertext){
+	return (int64_t)(ciphertext.size() * ciphertext.poly_modulus_degree() * ciphertext.coeff_modulus_size()
+	                 * sizeof(std::uint64_t));
+}
+
+inline int64_t seal_bytes(const seal::Plaintext& plain){
+	return (int64_t)(plain.coeff_count() * sizeof(std::uint64_t));
+}
+
+//Keys, measured by their uncompressed serialized size
+template<typename Key>
+inline int64_t seal_bytes(const Key& key){
+	return (int64_t)key.save_size(seal::compr_mode_type::none);
+}
+
+//Uncompressed serialized form of a key or ciphertext
+template<typename Object>
+inline std::string seal_serialize(const Object& object){
+	std::stringstream out;
+	object.save(out, seal::compr_mode_type::none);
+	return out.str();
+}
+
+inline void seal_footprint(Footprint& footprint, FootprintRole role, const seal::Ciphertext& ciphertext, long records){
+	footprint.add_ciphertext(role, (int)ciphertext.coeff_modulus_size(), records, seal_serialize(ciphertext));
+}
+
+//Copies of the ciphertext switched down to every lower level of the chain
+inline void seal_footprint_chain(Footprint& footprint, const seal::SEALContext& context, seal::Evaluator& evaluator,
+                                 seal::Ciphertext ciphertext, long records){
+	while(context.get_context_data(ciphertext.parms_id())->next_context_data()){
+		evaluator.mod_switch_to_next_inplace(ciphertext);
+		seal_footprint(footprint, FootprintRole::Level, ciphertext, records);
+	}
+}
+
+//Bytes currently allocated from the global memory pool
+inline int64_t seal_pool_bytes(){
+	return (int64_t)seal::MemoryManager::GetPool().alloc_byte_count();
+}
+
+//Drops primes from the middle of the coefficient modulus chain until it
+//fits the 128-bit security bound of the ring, so the same chain can be
+//swept down to smaller rings. The first and the special last prime stay.
+inline std::vector<int> seal_fit_bit_sizes(size_t poly_modulus_degree, std::vector<int> bit_sizes){
+	int max_bits = seal::CoeffModulus::MaxBitCount(poly_modulus_degree);
+	int total = 0;
+	for(int bits : bit_sizes)
+		total += bits;
+	while(total > max_bits && bit_sizes.size() > 2){
+		total -= bit_sizes[bit_sizes.size() - 2];
+		bit_sizes.erase(bit_sizes.end() - 2);
+	}
+	return bit_sizes;
+}
+
+template<size_t N>
+inline std::vector<int> seal_fit_bit_sizes(size_t poly_modulus_degree, const std::array<int, N>& bit_sizes){
+	return seal_fit_bit_sizes(poly_modulus_degree, std::vector<int>(bit_sizes.begin(), bit_sizes.end()));
+}
+
+class ProfiledEvaluator{
+public:
+	ProfiledEvaluator(const seal::SEALContext& context, OpProfiler& ops)
+		: context_(context), evaluator_(context), ops_(ops){}
+
+	void add(const seal::Ciphertext& a, const seal::Ciphertext& b, seal::Ciphertext& destination){
+		ops_.time(HeOp::Add, seal_level(context_, a), [&](){ evaluator_.add(a, b, destination); });
+	}
+
+	void add_inplace(seal::Ciphertext& a, const seal::Ciphertext& b){
+		ops_.time(HeOp::Add, seal_level(context_, a), [&](){ evaluator_.add_inplace(a, b); });
+	}
+
+	//seal::Evaluator::add_many() only adds a vector of ciphertexts one by one,
+	//so the same additions run on the terms where they are, without copying
+	//them into one
+	void add_many(const std::vector<const seal::Ciphertext*>& terms, seal::Ciphertext& destination){
+		if(terms.empty())
+			throw std::invalid_argument("add_many needs at least one term");
+		ops_.time(HeOp::AddMany, seal_level(context_, *terms.front()), [&](){
+			if(terms.size() == 1){
+				destination = *terms.front();
+				return;
+			}
+			evaluator_.add(*terms[0], *terms[1], destination);
+			for(size_t i = 2; i < terms.size(); i++)
+				evaluator_.add_inplace(destination, *terms[i]);
+		});
+	}
+
+	void add_plain_inplace(seal::Ciphertext& a, const seal::Plaintext& b){
+		ops_.time(HeOp::AddPlain, seal_level(context_, a), [&](){ evaluator_.add_plain_inplace(a, b); });
+	}
+
+	void multiply(const seal::Ciphertext& a, const seal::Ciphertext& b, seal::Ciphertext& destination){
+		ops_.time(HeOp::Multiply, seal_level(context_, a), [&](){ evaluator_.multiply(a, b, destination); });
+	}
+
+	void multiply_inplace(seal::Ciphertext& a, const seal::Ciphertext& b){
+		ops_.time(HeOp::Multiply, seal_level(context_, a), [&](){ evaluator_.multiply_inplace(a, b); });
+	}
+
+	void multiply_plain(const seal::Ciphertext& a, const seal::Plaintext& b, seal::Ciphertext& destination){
+		ops_.time(HeOp::MultiplyPlain, seal_level(context_, a), [&](){ evaluator_.multiply_plain(a, b, destination); });
+	}
+
+	void multiply_plain_inplace(seal::Ciphertext& a, const seal::Plaintext& b){
+		ops_.time(HeOp::MultiplyPlain, seal_level(context_, a), [&](){ evaluator_.multiply_plain_inplace(a, b); });
+	}
+
+	void square(const seal::Ciphertext& a, seal::Ciphertext& destination){
+		ops_.time(HeOp::Square, seal_level(context_, a), [&](){ evaluator_.square(a, destination); });
+	}
+
+	void square_inplace(seal::Ciphertext& a){
+		ops_.time(HeOp::Square, seal_level(context_, a), [&](){ evaluator_.square_inplace(a); });
+	}
+
+	void relinearize_inplace(seal::Ciphertext& a, const seal::RelinKeys& relin_keys){
+		ops_.time(HeOp::Relinearize, seal_level(context_, a), [&](){ evaluator_.relinearize_inplace(a, relin_keys); });
+	}
+
+	void rescale_to_next_inplace(seal::Ciphertext& a){
+		ops_.time(HeOp::Rescale, seal_level(context_, a), [&](){ evaluator_.rescale_to_next_inplace(a); });
+	}
+
+	void mod_switch_to_next_inplace(seal::Ciphertext& a){
+		ops_.time(HeOp::ModSwitch, seal_level(context_, a), [&](){ evaluator_.mod_switch_to_next_inplace(a); });
+	}
+
+	void mod_switch_to_inplace(seal::Ciphertext& a, seal::parms_id_type parms_id){
+		ops_.time(HeOp::ModSwitch, seal_level(context_, a), [&](){ evaluator_.mod_switch_to_inplace(a, parms_id); });
+	}
+
+	seal::Evaluator& unwrapped(){
+		return evaluator_;
+	}
+
+	const seal::SEALContext& context() const{
+		return context_;
+	}
+
+private:
+	seal::SEALContext context_;
+	seal::Evaluator evaluator_;
+	OpProfiler& ops_;
+};
+
+class ProfiledEncryptor{
+public:
+	ProfiledEncryptor(const seal::SEALContext& context, const seal::PublicKey& public_key, OpProfiler& ops)
+		: encryptor_(context, public_key), ops_(ops){}
+
+	void encrypt(const seal::Plaintext& plain, seal::Ciphertext& destination){
+		ops_.time(HeOp::Encrypt, NO_LEVEL, [&](){ encryptor_.encrypt(plain, destination); });
+	}
+
+	//One ciphertext per plaintext
+	void encrypt(const std::vector<seal::Plaintext>& plains, std::vector<seal::Ciphertext>& destination, ThreadPool& pool){
+		destination.resize(plains.size());
+		pool.parallel_for(plains.size(), [&](size_t i){ encrypt(plains[i], destination[i]); });
+	}
+
+private:
+	seal::Encryptor encryptor_;
+	OpProfiler& ops_;
+};
+
+class ProfiledDecryptor{
+public:
+	ProfiledDecryptor(const seal::SEALContext& context, const seal::SecretKey& secret_key, OpProfiler& ops)
+		: context_(context), decryptor_(context, secret_key), ops_(ops){}
+
+	void decrypt(const seal::Ciphertext& encrypted, seal::Plaintext& destination){
+		ops_.time(HeOp::Decrypt, seal_level(context_, encrypted), [&](){ decryptor_.decrypt(encrypted, destination); });
+	}
+
+	seal::Decryptor& unwrapped(){
+		return decryptor_;
+	}
+
+private:
+	seal::SEALContext context_;
+	seal::Decryptor decryptor_;
+	OpProfiler& ops_;
+};
+
+class ProfiledBatchEncoder{
+public:
+	typedef std::uint64_t Slot;
+
+	ProfiledBatchEncoder(const seal::SEALContext& context, OpProfiler& ops) : encoder_(context), ops_(ops){}
+
+	size_t slot_count() const{
+		return encoder_.slot_count();
+	}
+
+	template<typename T>
+	void encode(const std::vector<T>& values, seal::Plaintext& destination){
+		ops_.time(HeOp::Encode, NO_LEVEL, [&](){ encoder_.encode(values, destination); });
+	}
+
+	//One plaintext per column
+	template<typename T>
+	void encode(const std::vector<std::vector<T>>& columns, std::vector<seal::Plaintext>& destination, ThreadPool& pool){
+		destination.resize(columns.size());
+		pool.parallel_for(columns.size(), [&](size_t i){ encode(columns[i], destination[i]); });
+	}
+
+	template<typename T>
+	void decode(const seal::Plaintext& plain, std::vector<T>& destination){
+		ops_.time(HeOp::Decode, NO_LEVEL, [&](){ encoder_.decode(plain, destination); });
+	}
+
+private:
+	seal::BatchEncoder encoder_;
+	OpProfiler& ops_;
+};
+
+class ProfiledCKKSEncoder{
+public:
+	typedef double Slot;
+
+	ProfiledCKKSEncoder(const seal::SEALContext& context, OpProfiler& ops) : encoder_(context), ops_(ops){}
+
+	size_t slot_count() const{
+		return encoder_.slot_count();
+	}
+
+	template<typename T>
+	void encode(const std::vector<T>& values, double scale, seal::Plaintext& destination){
+		ops_.time(HeOp::Encode, NO_LEVEL, [&](){ encoder_.encode(values, scale, destination); });
+	}
+
+	//One plaintext per column
+	template<typename T>
+	void encode(const std::vector<std::vector<T>>& columns, double scale, std::vector<seal::Plaintext>& destination,
+	            ThreadPool& pool){
+		destination.resize(columns.size());
+		pool.parallel_for(columns.size(), [&](size_t i){ encode(columns[i], scale, destination[i]); });
+	}
+
+	template<typename T>
+	void decode(const seal::Plaintext& plain, std::vector<T>& destination){
+		ops_.time(HeOp::Decode, NO_LEVEL, [&](){ encoder_.decode(plain, destination); });
+	}
+
+private:
+	seal::CKKSEncoder encoder_;
+	OpProfiler& ops_;
+};
+
+//The public key and, when asked, the relinearization keys are independent
+//tasks on the pool. The key generator guards the secret key powers they
+//share. No calculator rotates, so there are no Galois keys to generate.
+inline void seal_create_keys(seal::KeyGenerator& keygen, seal::PublicKey& public_key, seal::RelinKeys* relin_keys,
+                             ThreadPool& pool){
+	pool.parallel_for(relin_keys != nullptr ? 2 : 1, [&](size_t task){
+		if(task == 0)
+			keygen.create_public_key(public_key);
+		else
+			keygen.create_relin_keys(*relin_keys);
+	});
+}
+
+//Decrypts and decodes the first count slots into values. The plaintext and
+//the decoded slots are buffers each thread keeps from call to call.
+template<typename Encoder>
+void seal_decrypt(ProfiledDecryptor& decryptor, Encoder& encoder, const seal::Ciphertext& ciphertext, double* values,
+                  size_t count){
+	thread_local seal::Plaintext plain;
+	thread_local std::vector<typename Encoder::Slot> slots;
+	decryptor.decrypt(ciphertext, plain);
+	encoder.decode(plain, slots);
+	if(count > slots.size())
+		throw std::invalid_argument("more values than slots");
+	std::copy(slots.begin(), slots.begin() + count, values);
+}
+
+//Ciphertext i fills values[i * stride] on, count values in all, as many
+//ciphertexts at a time as the pool has threads
+template<typename Encoder>
+void seal_decrypt(ProfiledDecryptor& decryptor, Encoder& encoder, const std::vector<const seal::Ciphertext*>& ciphertexts,
+                  double* values, size_t count, size_t stride, ThreadPool& pool){
+	if(count > ciphertexts.size() * stride)
+		throw std::invalid_argument("more values than the ciphertexts hold");
+	pool.parallel_for(ciphertexts.size(), [&](size_t i){
+		size_t first = i * stride;
+		if(first < count)
+			seal_decrypt(decryptor, encoder, *ciphertexts[i], values + first, std::min(stride, count - first));
+	});
+}
+
+//Workload backend (fhe_backend.h) over the profiled evaluator
+template<Scheme S>
+class SealBackend{
+public:
+	typedef seal::Ciphertext Ciphertext;
+	static constexpr bool levelled = SchemeTraits<S>::levelled;
+
+	SealBackend(ProfiledEvaluator& evaluator, const seal::RelinKeys& relin_keys)
+		: evaluator_(evaluator), relin_keys_(relin_keys){}
+
+	void add(const Ciphertext& a, const Ciphertext& b, Ciphertext& destination){
+		evaluator_.add(a, b, destination);
+	}
+
+	void add_inplace(Ciphertext& a, const Ciphertext& b){
+		evaluator_.add_inplace(a, b);
+	}
+
+	void add_many(const std::vector<const Ciphertext*>& terms, Ciphertext& destination){
+		evaluator_.add_many(terms, destination);
+	}
+
+	void multiply(const Ciphertext& a, const Ciphertext& b, Ciphertext& destination){
+		evaluator_.multiply(a, b, destination);
+	}
+
+	void square(const Ciphertext& a, Ciphertext& destination){
+		evaluator_.square(a, destination);
+	}
+
+	void relinearize(Ciphertext& a){
+		evaluator_.relinearize_inplace(a, relin_keys_);
+	}
+
+	//BGV switches to the next modulus to keep the noise down, BFV has one level
+	void rescale(Ciphertext& a){
+		if constexpr(SchemeTraits<S>::rescales)
+			evaluator_.rescale_to_next_inplace(a);
+		else if constexpr(SchemeTraits<S>::levelled)
+			evaluator_.mod_switch_to_next_inplace(a);
+	}
+
+	void align(Ciphertext& a, Ciphertext& b){
+		if constexpr(SchemeTraits<S>::levelled){
+			int level_a = seal_level(evaluator_.context(), a);
+			int level_b = seal_level(evaluator_.context(), b);
+			if(level_a > level_b)
+				evaluator_.mod_switch_to_inplace(a, b.parms_id());
+			else if(level_b > level_a)
+				evaluator_.mod_switch_to_inplace(b, a.parms_id());
+		}
+	}
+
+private:
+	ProfiledEvaluator& evaluator_;
+	const seal::RelinKeys& relin_keys_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,196 @@
+/****************************************************************/
+/* SEAL runtime for the registered workloads                    */
+/* Author: Majdi Maalej                                         */
+/* One SEAL context and key set for a scheme and a parameter    */
+/* table (scheme_traits.h), shared by every workload served     */
+/* with it (workload_runtime.h). Relinearization keys are only  */
+/* generated when one of the workloads declares them.           */
+/* A worker of a sharded run builds the same context from the   */
+/* table and loads the public keys the coordinator serialized   */
+/* with public_keys(); it has no secret key and cannot decrypt. */
+/****************************************************************/
+#ifndef SEAL_RUNTIME_H
+#define SEAL_RUNTIME_H
+
+#include "seal/seal.h"
+#include "seal_ops.h"
+#include "workload_runtime.h"
+#include <stdint.h>
+#include <math.h>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+template<Scheme S, typename Parameters>
+class SealRuntime{
+public:
+	typedef SealBackend<S> Backend;
+	typedef seal::Ciphertext Ciphertext;
+
+	//ring_dimension 0 keeps the table's. The keys are generated on the pool.
+	SealRuntime(PhaseProfiler& profiler, OpProfiler& ops, const std::vector<WorkloadDefinition>& workloads,
+	            ThreadPool& pool, long ring_dimension = 0) : profiler_(profiler){
+		build_context(ring_dimension);
+
+		profiler_.start(Phase::KeyGeneration);
+		seal::KeyGenerator keygen(*context_);
+		secret_key_ = keygen.secret_key();
+		has_relin_keys_ = needs_relin_keys(workloads);
+		seal_create_keys(keygen, public_key_, has_relin_keys_ ? &relin_keys_ : nullptr, pool);
+		profiler_.stop();
+
+		build_tools(ops, true);
+	}
+
+	//A worker with the keys from public_keys()
+	SealRuntime(PhaseProfiler& profiler, OpProfiler& ops, const std::vector<std::string>& public_keys,
+	            long ring_dimension = 0) : profiler_(profiler){
+		build_context(ring_dimension);
+		if(public_keys.size() != 2)
+			throw std::invalid_argument("expected a public key and relinearization keys");
+		std::istringstream public_key(public_keys[0]);
+		public_key_.load(*context_, public_key);
+		has_relin_keys_ = !public_keys[1].empty();
+		if(has_relin_keys_){
+			std::istringstream relin_keys(public_keys[1]);
+			relin_keys_.load(*context_, relin_keys);
+		}
+		build_tools(ops, false);
+	}
+
+	//For each operation, returns the threads it uses
+	static int set_library_threads(int threads){
+		return seal_set_threads(threads);
+	}
+
+	Backend& backend(){
+		return *backend_;
+	}
+
+	PhaseProfiler& profiler(){
+		return profiler_;
+	}
+
+	long slot_count() const{
+		return (long)encoder_->slot_count();
+	}
+
+	uint64_t plain_modulus() const{
+		return Parameters::plain_modulus;
+	}
+
+	int depth() const{
+		return Parameters::depth;
+	}
+
+	Ciphertext ciphertext() const{
+		return Ciphertext();
+	}
+
+	void encrypt(const std::vector<double>& values, Ciphertext& destination){
+		seal::Plaintext plain;
+		if constexpr(SchemeTraits<S>::exact){
+			std::vector<uint64_t> slots(slot_count(), 0ULL);
+			for(size_t i = 0; i < values.size(); i++)
+				slots[i] = (uint64_t)values[i];
+			encoder_->encode(slots, plain);
+		}
+		else{
+			std::vector<double> slots(values);
+			slots.resize(slot_count(), 0.0);
+			encoder_->encode(slots, pow(2.0, Parameters::scale_bits), plain);
+		}
+		encryptor_->encrypt(plain, destination);
+	}
+
+	void decrypt(const Ciphertext& ciphertext, std::vector<double>& values){
+		check_secret_key();
+		seal::Plaintext plain;
+		decryptor_->decrypt(ciphertext, plain);
+		if constexpr(SchemeTraits<S>::exact){
+			std::vector<uint64_t> slots;
+			encoder_->decode(plain, slots);
+			values.assign(slots.begin(), slots.end());
+		}
+		else{
+			encoder_->decode(plain, values);
+		}
+	}
+
+	//The first count slots
+	void decrypt(const Ciphertext& ciphertext, double* values, size_t count){
+		check_secret_key();
+		seal_decrypt(*decryptor_, *encoder_, ciphertext, values, count);
+	}
+
+	//Ciphertext i into values[i * stride] on, count values in all
+	void decrypt(const std::vector<const Ciphertext*>& ciphertexts, double* values, size_t count, size_t stride,
+	             ThreadPool& pool){
+		check_secret_key();
+		seal_decrypt(*decryptor_, *encoder_, ciphertexts, values, count, stride, pool);
+	}
+
+	//The public key and the relinearization keys, empty when there are none
+	std::vector<std::string> public_keys() const{
+		return { seal_serialize(public_key_), has_relin_keys_ ? seal_serialize(relin_keys_) : std::string() };
+	}
+
+	std::string save(const Ciphertext& ciphertext) const{
+		return seal_serialize(ciphertext);
+	}
+
+	void load(const std::string& saved, Ciphertext& ciphertext) const{
+		std::istringstream in(saved);
+		ciphertext.load(*context_, in);
+	}
+
+private:
+	typedef typename std::conditional<SchemeTraits<S>::exact, ProfiledBatchEncoder, ProfiledCKKSEncoder>::type Encoder;
+
+	void build_context(long ring_dimension){
+		profiler_.start(Phase::ParameterGeneration);
+		seal::EncryptionParameters parms(S == Scheme::BFV ? seal::scheme_type::bfv
+		                                 : S == Scheme::BGV ? seal::scheme_type::bgv : seal::scheme_type::ckks);
+		size_t poly_modulus_degree = ring_dimension > 0 ? (size_t)ring_dimension : Parameters::ring_dimension;
+		parms.set_poly_modulus_degree(poly_modulus_degree);
+		parms.set_coeff_modulus(seal::CoeffModulus::Create(poly_modulus_degree,
+		                        seal_fit_bit_sizes(poly_modulus_degree, Parameters::coeff_modulus_bits)));
+		if constexpr(SchemeTraits<S>::exact)
+			parms.set_plain_modulus(Parameters::plain_modulus);
+		context_.reset(new seal::SEALContext(parms));
+		profiler_.stop();
+	}
+
+	void build_tools(OpProfiler& ops, bool decrypts){
+		profiler_.start(Phase::ParameterGeneration);
+		encryptor_.reset(new ProfiledEncryptor(*context_, public_key_, ops));
+		evaluator_.reset(new ProfiledEvaluator(*context_, ops));
+		if(decrypts)
+			decryptor_.reset(new ProfiledDecryptor(*context_, secret_key_, ops));
+		encoder_.reset(new Encoder(*context_, ops));
+		backend_.reset(new Backend(*evaluator_, relin_keys_));
+		profiler_.stop();
+	}
+
+	void check_secret_key() const{
+		if(!decryptor_)
+			throw std::logic_error("a sharded worker has no secret key");
+	}
+
+	PhaseProfiler& profiler_;
+	std::unique_ptr<seal::SEALContext> context_;
+	seal::SecretKey secret_key_;
+	seal::PublicKey public_key_;
+	seal::RelinKeys relin_keys_;
+	bool has_relin_keys_ = false;
+	std::unique_ptr<ProfiledEncryptor> encryptor_;
+	std::unique_ptr<ProfiledEvaluator> evaluator_;
+	std::unique_ptr<ProfiledDecryptor> decryptor_;
+	std::unique_ptr<Encoder> encoder_;
+	std::unique_ptr<Backend> backend_;
+};
+
+#endif
@@ -0,0 +1,217 @@
+/****************************************************************/
+/* Worker processes for sharded runs                            */
+/* Author: Majdi Maalej                                         */
+/* WorkerProcesses forks worker processes on the same machine,  */
+/* each connected to the coordinator by a Unix domain socket    */
+/* pair, so the ciphertexts of a large run are spread over      */
+/* several address spaces. Fork before any thread pool or       */
+/* library thread is started: a child only keeps the thread     */
+/* that forked it.                                              */
+/* Messages are length-prefixed byte strings; pack() and        */
+/* unpack() put several of them, like serialized keys or        */
+/* ciphertexts, in one. A closed or broken socket throws.       */
+/* serve_sharded() (workload_runtime.h) is the protocol run on  */
+/* top of them; abort() kills the workers once it can no longer */
+/* tell which message answers what.                             */
+/****************************************************************/
+#ifndef SHARDING_H
+#define SHARDING_H
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//A worker that died makes the write fail instead of raising SIGPIPE
+inline void write_bytes(int fd, const char* data, size_t size){
+	while(size > 0){
+		ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+		if(written < 0 && errno == EINTR)
+			continue;
+		if(written <= 0)
+			throw std::runtime_error(std::string("socket write failed: ") + strerror(errno));
+		data += written;
+		size -= (size_t)written;
+	}
+}
+
+inline void read_bytes(int fd, char* data, size_t size){
+	while(size > 0){
+		ssize_t got = read(fd, data, size);
+		if(got < 0 && errno == EINTR)
+			continue;
+		if(got == 0)
+			throw std::runtime_error("socket closed by the other process");
+		if(got < 0)
+			throw std::runtime_error(std::string("socket read failed: ") + strerror(errno));
+		data += got;
+		size -= (size_t)got;
+	}
+}
+
+inline void send_message(int fd, const std::string& message){
+	uint64_t size = message.size();
+	write_bytes(fd, (const char*)&size, sizeof(size));
+	write_bytes(fd, message.data(), message.size());
+}
+
+inline std::string receive_message(int fd){
+	uint64_t size = 0;
+	read_bytes(fd, (char*)&size, sizeof(size));
+	std::string message(size, '\0');
+	read_bytes(fd, &message[0], size);
+	return message;
+}
+
+//False when the other process closed the socket between two messages
+inline bool receive_message(int fd, std::string& message){
+	char first;
+	ssize_t got;
+	while((got = recv(fd, &first, 1, MSG_PEEK)) < 0 && errno == EINTR);
+	if(got == 0)
+		return false;
+	message = receive_message(fd);
+	return true;
+}
+
+inline std::string pack(const std::vector<std::string>& parts){
+	std::string packed;
+	for(const std::string& part : parts){
+		uint64_t size = part.size();
+		packed.append((const char*)&size, sizeof(size));
+		packed += part;
+	}
+	return packed;
+}
+
+inline std::vector<std::string> unpack(const std::string& packed){
+	std::vector<std::string> parts;
+	size_t at = 0;
+	while(at < packed.size()){
+		uint64_t size = 0;
+		if(packed.size() - at < sizeof(size))
+			throw std::runtime_error("truncated message");
+		memcpy(&size, packed.data() + at, sizeof(size));
+		at += sizeof(size);
+		if(packed.size() - at < size)
+			throw std::runtime_error("truncated message");
+		parts.push_back(packed.substr(at, size));
+		at += size;
+	}
+	return parts;
+}
+
+//Raw bytes of a column of values, for processes of the same build
+template<typename T>
+std::string column_bytes(const std::vector<T>& values){
+	return std::string((const char*)values.data(), values.size() * sizeof(T));
+}
+
+template<typename T>
+std::vector<T> column_values(const std::string& bytes){
+	std::vector<T> values(bytes.size() / sizeof(T));
+	memcpy(values.data(), bytes.data(), values.size() * sizeof(T));
+	return values;
+}
+
+class WorkerProcesses{
+public:
+	//Each worker runs body with its end of the socket and exits with the
+	//status it returns, 1 when it throws
+	WorkerProcesses(int count, const std::function<int(int fd)>& body){
+		for(int i = 0; i < count; i++){
+			int fds[2];
+			if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0){
+				std::string error = std::string("socketpair failed: ") + strerror(errno);
+				abort();
+				throw std::runtime_error(error);
+			}
+			std::cout.flush();
+			std::cerr.flush();
+			pid_t pid = fork();
+			if(pid < 0){
+				std::string error = std::string("fork failed: ") + strerror(errno);
+				close(fds[0]);
+				close(fds[1]);
+				abort();
+				throw std::runtime_error(error);
+			}
+			if(pid == 0){
+				close(fds[0]);
+				for(int fd : fds_)
+					close(fd);
+				int status = 1;
+				try{
+					status = body(fds[1]);
+				}
+				catch(const std::exception& e){
+					std::cerr << "worker " << i << ": " << e.what() << std::endl;
+				}
+				std::cout.flush();
+				_exit(status);
+			}
+			close(fds[1]);
+			fds_.push_back(fds[0]);
+			pids_.push_back(pid);
+		}
+	}
+
+	~WorkerProcesses(){
+		try{
+			wait();
+		}
+		catch(...){
+		}
+	}
+
+	WorkerProcesses(const WorkerProcesses&) = delete;
+	WorkerProcesses& operator=(const WorkerProcesses&) = delete;
+
+	int size() const{
+		return (int)fds_.size();
+	}
+
+	int fd(int worker) const{
+		return fds_[worker];
+	}
+
+	//Kills the workers and reaps them, for when the exchange with them broke
+	//off halfway or the later ones could not be started
+	void abort(){
+		for(pid_t pid : pids_)
+			kill(pid, SIGKILL);
+		wait();
+	}
+
+	//Closes the sockets, which ends the workers waiting for work, and
+	//returns true when all of them exited with 0
+	bool wait(){
+		for(int fd : fds_)
+			close(fd);
+		fds_.clear();
+		bool ok = true;
+		for(pid_t pid : pids_){
+			int status = 0;
+			while(waitpid(pid, &status, 0) < 0 && errno == EINTR);
+			ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		}
+		pids_.clear();
+		return ok;
+	}
+
+private:
+	std::vector<int> fds_;
+	std::vector<pid_t> pids_;
+};
+
+#endif
@@ -0,0 +1,316 @@
+/****************************************************************/
+/* Thread pool for independent homomorphic operations           */
+/* Author: Majdi Maalej                                         */
+/* parallel_for() runs body(i) for every i below count on the   */
+/* pool's threads, the calling thread included, and returns     */
+/* once all of them are done. The first exception a body throws */
+/* is rethrown to the caller after the others finished. One     */
+/* parallel_for() at a time: a body must not call the pool it   */
+/* runs on.                                                     */
+/* Every thread owns a deque of indexes, a contiguous range cut */
+/* from the loop. It takes indexes from the front of its own    */
+/* and, once it is empty, steals the back half of another's, so */
+/* cheap and costly bodies and short tail chunks still keep all */
+/* threads busy. stats() counts the tasks, the steals and the   */
+/* time each thread spent in bodies; report() prints them with  */
+/* the utilization, the share of the parallel_for() wall time   */
+/* a thread was busy.                                           */
+/* The size comes from FHE_THREADS and FHE_POOL_THREADS         */
+/* (benchmark.h), by default one thread per core. With pinning  */
+/* (FHE_PIN) thread i runs on core i only and allocates from    */
+/* its own NUMA node. Every pool thread runs thread_setup()     */
+/* first, where the libraries put their per-thread thread       */
+/* counts (seal_ops.h, helib_ops.h, palisade_ops.h).            */
+/****************************************************************/
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+inline int hardware_threads(){
+	unsigned cores = std::thread::hardware_concurrency();
+	return cores > 0 ? (int)cores : 1;
+}
+
+//Binds the calling thread to core % cores and makes its allocations come
+//from that core's NUMA node. False where it is not supported.
+inline bool pin_current_thread(int core){
+#ifdef __linux__
+	cpu_set_t cores;
+	CPU_ZERO(&cores);
+	CPU_SET(core % hardware_threads(), &cores);
+	if(pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores) != 0)
+		return false;
+#ifdef SYS_set_mempolicy
+	const int MPOL_LOCAL_POLICY = 4; //MPOL_LOCAL of linux/mempolicy.h
+	syscall(SYS_set_mempolicy, MPOL_LOCAL_POLICY, nullptr, 0);
+#endif
+	return true;
+#else
+	(void)core;
+	return false;
+#endif
+}
+
+//Per-thread settings every pool thread applies before its first task
+inline std::function<void()>& thread_setup(){
+	static std::function<void()> setup;
+	return setup;
+}
+
+struct WorkerStats{
+	long tasks = 0;
+	long steals = 0;
+	int64_t busy_ns = 0;
+};
+
+class ThreadPool{
+public:
+	//threads <= 0 starts one per core. pin binds the calling thread to core 0
+	//and worker i to core i.
+	explicit ThreadPool(int threads = 0, bool pin = false)
+		: threads_(threads > 0 ? threads : hardware_threads()), queues_(threads_), stats_(threads_){
+		pinned_ = pin && pin_current_thread(0);
+		for(int i = 1; i < threads_; i++){
+			workers_.emplace_back([this, i, pin, setup = thread_setup()](){
+				if(pin)
+					pin_current_thread(i);
+				if(setup)
+					setup();
+				work(i);
+			});
+		}
+	}
+
+	~ThreadPool(){
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		wake_.notify_all();
+		for(std::thread& worker : workers_)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	//Including the calling thread
+	int size() const{
+		return threads_;
+	}
+
+	bool pinned() const{
+		return pinned_;
+	}
+
+	template<typename Function>
+	void parallel_for(size_t count, Function&& body){
+		Clock::time_point started = Clock::now();
+		if(workers_.empty() || count < 2){
+			for(size_t i = 0; i < count; i++){
+				Clock::time_point task_started = Clock::now();
+				body(i);
+				stats_[0].tasks++;
+				stats_[0].busy_ns += elapsed_ns(task_started);
+			}
+			parallel_ns_ += elapsed_ns(started);
+			return;
+		}
+
+		std::function<void(size_t)> task = [&body](size_t i){ body(i); };
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			task_ = &task;
+			for(int t = 0; t < threads_; t++){
+				std::lock_guard<std::mutex> queue_lock(queues_[t].mutex);
+				queues_[t].begin = count * t / threads_;
+				queues_[t].end = count * (t + 1) / threads_;
+			}
+			busy_ = workers_.size();
+			error_ = nullptr;
+			generation_++;
+		}
+		wake_.notify_all();
+		run_tasks(0);
+
+		std::exception_ptr error;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			done_.wait(lock, [this](){ return busy_ == 0; });
+			task_ = nullptr;
+			error = error_;
+		}
+		parallel_ns_ += elapsed_ns(started);
+		if(error)
+			std::rethrow_exception(error);
+	}
+
+	//Per thread, the calling thread first. Only read between parallel_for()
+	//calls.
+	const std::vector<WorkerStats>& stats() const{
+		return stats_;
+	}
+
+	long steals() const{
+		long steals = 0;
+		for(const WorkerStats& worker : stats_)
+			steals += worker.steals;
+		return steals;
+	}
+
+	//Busy time of the thread over the wall time of all parallel_for() calls
+	double utilization(int thread) const{
+		return parallel_ns_ > 0 ? (double)stats_[thread].busy_ns / parallel_ns_ : 0;
+	}
+
+	//Of the least busy thread
+	double min_utilization() const{
+		double least = threads_ > 0 ? utilization(0) : 0;
+		for(int t = 1; t < threads_; t++)
+			least = std::min(least, utilization(t));
+		return least;
+	}
+
+	void reset_stats(){
+		stats_.assign(threads_, WorkerStats());
+		parallel_ns_ = 0;
+	}
+
+	//Prints nothing when the pool never ran a task
+	void report(std::ostream& out) const{
+		if(parallel_ns_ == 0)
+			return;
+		out << "Thread pool, " << threads_ << (pinned_ ? " pinned" : "") << " threads, " << steals() << " steals, "
+		    << std::fixed << std::setprecision(6) << parallel_ns_ / 1e9 << " s in parallel loops:" << std::endl;
+		out << "                        " << std::setw(10) << "Tasks" << std::setw(10) << "Steals"
+		    << std::setw(14) << "Busy (s)" << std::setw(14) << "Utilization" << std::endl;
+		for(int t = 0; t < threads_; t++){
+			std::string name = t == 0 ? "Caller" : "Worker " + std::to_string(t);
+			out << std::left << std::setw(22) << name << std::right << ": " << std::setw(10) << stats_[t].tasks
+			    << std::setw(10) << stats_[t].steals << std::setprecision(6) << std::setw(14) << stats_[t].busy_ns / 1e9
+			    << std::setprecision(1) << std::setw(13) << utilization(t) * 100 << "%" << std::endl;
+		}
+		out << std::defaultfloat << std::setprecision(6);
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	//The indexes a thread has left, taken from the front by its owner and
+	//from the back by thieves
+	struct Queue{
+		std::mutex mutex;
+		size_t begin = 0;
+		size_t end = 0;
+	};
+
+	static int64_t elapsed_ns(Clock::time_point started){
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count();
+	}
+
+	bool pop(int self, size_t& index){
+		Queue& queue = queues_[self];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if(queue.begin == queue.end)
+			return false;
+		index = queue.begin++;
+		return true;
+	}
+
+	//Moves the back half of the first non-empty queue after self's into
+	//self's, which is empty
+	bool steal(int self){
+		for(int offset = 1; offset < threads_; offset++){
+			Queue& victim = queues_[(self + offset) % threads_];
+			size_t begin, end;
+			{
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if(victim.begin == victim.end)
+					continue;
+				begin = victim.begin + (victim.end - victim.begin) / 2;
+				end = victim.end;
+				victim.end = begin;
+			}
+			{
+				std::lock_guard<std::mutex> lock(queues_[self].mutex);
+				queues_[self].begin = begin;
+				queues_[self].end = end;
+			}
+			stats_[self].steals++;
+			return true;
+		}
+		return false;
+	}
+
+	//Runs the thread's own indexes, then stolen ones until none is left
+	void run_tasks(int self){
+		size_t i;
+		while(pop(self, i) || (steal(self) && pop(self, i))){
+			Clock::time_point started = Clock::now();
+			try{
+				(*task_)(i);
+			}
+			catch(...){
+				std::lock_guard<std::mutex> lock(mutex_);
+				if(!error_)
+					error_ = std::current_exception();
+			}
+			stats_[self].tasks++;
+			stats_[self].busy_ns += elapsed_ns(started);
+		}
+	}
+
+	void work(int self){
+		uint64_t seen = 0;
+		for(;;){
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				wake_.wait(lock, [&](){ return stopping_ || generation_ != seen; });
+				if(stopping_)
+					return;
+				seen = generation_;
+			}
+			run_tasks(self);
+			std::lock_guard<std::mutex> lock(mutex_);
+			if(--busy_ == 0)
+				done_.notify_one();
+		}
+	}
+
+	int threads_;
+	bool pinned_ = false;
+	std::vector<Queue> queues_;
+	std::vector<WorkerStats> stats_;  //each entry written by its thread only
+	int64_t parallel_ns_ = 0;
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable done_;
+	bool stopping_ = false;
+	uint64_t generation_ = 0;
+	//The running parallel_for(), set under the mutex before generation_ moves
+	const std::function<void(size_t)>* task_ = nullptr;
+	size_t busy_ = 0;
+	std::exception_ptr error_;
+};
+
+#endif
@@ -0,0 +1,145 @@
+/****************************************************************/
+/* Registry of the encrypted workloads                          */
+/* Author: Majdi Maalej                                         */
+/* A workload is declared once: its named inputs with the range */
+/* of their values, its named outputs, its formula              */
+/* (expression.h), the largest value and the depth it needs,    */
+/* and the evaluation keys its plan uses. An aggregate workload */
+/* only needs its outputs summed over the records, which lets a */
+/* sharded run (workload_runtime.h) return one sum per worker.  */
+/* A runtime (workload_runtime.h) builds one context and key    */
+/* set for a parameter set and serves every registered workload */
+/* that fits it, so adding a workload does not mean another     */
+/* context, another key generation or another calculator.       */
+/* The three calculator workloads are registered here, with     */
+/* AllCovidDeaths, TotalCovidDeaths as an aggregate. Other      */
+/* files add theirs with REGISTER_WORKLOAD.                     */
+/****************************************************************/
+#ifndef WORKLOAD_REGISTRY_H
+#define WORKLOAD_REGISTRY_H
+
+#include "workloads.h"
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct WorkloadInput{
+	std::string name;
+	int64_t min;
+	int64_t max;
+};
+
+struct WorkloadDefinition{
+	std::string name;
+	std::vector<WorkloadInput> inputs;
+	std::vector<std::string> outputs; //by slot
+	std::function<void(ExpressionGraph&)> formula;
+	uint64_t largest_value = 0;
+	int depth = 0;
+	bool relin_keys = false;          //evaluation keys: relinearization
+	bool aggregate = false;           //only the sum over all records is needed
+
+	ExpressionGraph graph() const{
+		ExpressionGraph g;
+		formula(g);
+		return g;
+	}
+
+	bool fits(uint64_t plain_modulus, int depth_budget) const{
+		return fits_plain_modulus(largest_value, plain_modulus) && fits_depth(depth, depth_budget);
+	}
+
+	//Checks the declaration against the compiled formula
+	Plan compile(bool levelled) const{
+		ExpressionGraph g = graph();
+		if(g.inputs() != (int)inputs.size() || g.outputs() != (int)outputs.size())
+			throw std::logic_error(name + ": the formula does not match the declared inputs and outputs");
+		Plan plan = ::compile(g, levelled);
+		if(plan.relinearizations > 0 && !relin_keys)
+			throw std::logic_error(name + ": the plan relinearizes but the workload declares no relinearization keys");
+		if(plan.depth > depth)
+			throw std::logic_error(name + ": the plan is deeper than the declared depth");
+		return plan;
+	}
+};
+
+inline std::vector<WorkloadDefinition> builtin_workloads(){
+	WorkloadDefinition gross_pay;
+	gross_pay.name = "Gross_Pay";
+	gross_pay.inputs = { { "NumberOfRegularHours", GrossPayWorkload::min_regular_hours,
+	                       GrossPayWorkload::max_regular_hours },
+	                     { "RegularHourlyRate", GrossPayWorkload::min_regular_rate, GrossPayWorkload::max_regular_rate },
+	                     { "NumberOfOvertimeHours", GrossPayWorkload::min_overtime_hours,
+	                       GrossPayWorkload::max_overtime_hours },
+	                     { "OvertimeHourlyRate", GrossPayWorkload::min_overtime_rate, GrossPayWorkload::max_overtime_rate } };
+	gross_pay.outputs = { "StandardPay", "GrossPay" };
+	gross_pay.formula = gross_pay_formula;
+	gross_pay.largest_value = GrossPayWorkload::largest_value;
+	gross_pay.depth = GrossPayWorkload::depth;
+	gross_pay.relin_keys = true;
+
+	WorkloadDefinition luminousity;
+	luminousity.name = "Luminousity";
+	luminousity.inputs = { { "Radius", LuminousityWorkload::min_radius, LuminousityWorkload::max_radius },
+	                       { "SurfaceTemperature", LuminousityWorkload::min_temperature,
+	                         LuminousityWorkload::max_temperature } };
+	luminousity.outputs = { "RadiusSquared", "TemperatureSquared", "TemperatureQuadruple", "Result" };
+	luminousity.formula = luminousity_formula;
+	luminousity.largest_value = LuminousityWorkload::largest_value;
+	luminousity.depth = LuminousityWorkload::depth;
+	luminousity.relin_keys = true;
+
+	WorkloadDefinition total_covid_deaths;
+	total_covid_deaths.name = "TotalCovidDeaths";
+	for(const char* region : COVID_REGION_CODES)
+		total_covid_deaths.inputs.push_back(WorkloadInput{ region, 0, 50 });
+	total_covid_deaths.outputs = { "TotalDeaths" };
+	total_covid_deaths.formula = [](ExpressionGraph& g){ add_all_formula(g, TotalCovidDeathsWorkload::regions); };
+	total_covid_deaths.largest_value = TotalCovidDeathsWorkload::largest_value;
+	total_covid_deaths.depth = TotalCovidDeathsWorkload::depth;
+
+	//The deaths of every region over all the records
+	WorkloadDefinition all_covid_deaths = total_covid_deaths;
+	all_covid_deaths.name = "AllCovidDeaths";
+	all_covid_deaths.aggregate = true;
+
+	return { gross_pay, luminousity, total_covid_deaths, all_covid_deaths };
+}
+
+//The built-in workloads together, the parameter set a shared runtime is
+//sized for (scheme_traits.h)
+struct BuiltinWorkloads{
+	static constexpr uint64_t plain_modulus = LuminousityWorkload::plain_modulus;
+	static constexpr uint64_t largest_value = std::max({ GrossPayWorkload::largest_value,
+	                                                     LuminousityWorkload::largest_value,
+	                                                     TotalCovidDeathsWorkload::largest_value });
+	static constexpr int depth = std::max({ GrossPayWorkload::depth, LuminousityWorkload::depth,
+	                                        TotalCovidDeathsWorkload::depth });
+};
+
+inline std::vector<WorkloadDefinition>& workload_registry(){
+	static std::vector<WorkloadDefinition> registry = builtin_workloads();
+	return registry;
+}
+
+inline const WorkloadDefinition* find_workload(const std::string& name){
+	for(const WorkloadDefinition& w : workload_registry()){
+		if(w.name == name)
+			return &w;
+	}
+	return nullptr;
+}
+
+struct WorkloadRegistrar{
+	explicit WorkloadRegistrar(const WorkloadDefinition& definition){
+		workload_registry().push_back(definition);
+	}
+};
+
+#define REGISTER_WORKLOAD(definition) \
+	static WorkloadRegistrar workload_registrar(definition);
+
+#endif
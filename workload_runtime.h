@@ -0,0 +1,791 @@
+/****************************************************************/
+/* Shared runtime serving the registered workloads              */
+/* Author: Majdi Maalej                                         */
+/* A runtime (SealRuntime, HElibRuntime, PalisadeRuntime) owns  */
+/* the context, the keys, the profiled encryptor, evaluator and */
+/* decryptor of one parameter set. The keys are the union of    */
+/* what the workloads it serves declare (workload_registry.h).  */
+/* serve() runs one workload on it: random records in the       */
+/* declared ranges, encrypted, evaluated with the compiled plan */
+/* and decrypted, each step timed as its phase, and the results */
+/* checked against the formula on the plain records. More       */
+/* records than slots are split into chunks (chunking.h), as    */
+/* many chunks at a time as the pool has threads; a single      */
+/* chunk runs the independent steps of its plan on the pool     */
+/* instead. The report gives the records per second and, for    */
+/* a plan with folded constants (expression.h), an estimate     */
+/* of the evaluation time the folded operations would take.     */
+/* serve_workloads() does it for a list of workloads with one   */
+/* runtime, as the *_Shared_Runtime programs do.                */
+/* With FHE_SHARDS it forks that many worker processes          */
+/* (sharding.h) and sends each the public keys once. Per        */
+/* workload every worker gets a range of chunks, encrypts and   */
+/* evaluates them one at a time and returns each chunk's        */
+/* results, which the coordinator decrypts into place while the */
+/* worker goes on with the next one. An aggregate workload's    */
+/* workers return the sum of their results instead; the         */
+/* coordinator adds the partial sums, decrypts once and adds up */
+/* the slots into the totals over all records. A worker that    */
+/* fails stops all of them, the workloads after it get errors.  */
+/* With FHE_PIPELINE serve_pipelined() streams the chunks       */
+/* through encryption, evaluation and decryption stages of      */
+/* their own threads (pipeline.h) instead of running the phases */
+/* in turn; the phase columns then hold each stage's busy time  */
+/* and the records per second come from the pipeline's wall.    */
+/* Decryption writes straight into the output columns, a batch  */
+/* of chunks at a time on the pool. FHE_DECRYPT_BENCH=N times   */
+/* it on N ciphertexts against decrypting them one at a time    */
+/* into vectors (benchmark_decryption()).                       */
+/*                                                              */
+/* A runtime provides:                                          */
+/*   Backend, Ciphertext          as in fhe_backend.h           */
+/*   backend()                    the backend the plans run on  */
+/*   profiler()                   its PhaseProfiler             */
+/*   ciphertext()                 an empty ciphertext           */
+/*   encrypt(values, destination) values in the first slots     */
+/*   decrypt(ciphertext, values)  every slot                    */
+/*   decrypt(ciphertext, values, count) the first count slots   */
+/*   decrypt(ciphertexts, values, count, stride, pool)          */
+/*                                the same for many at once,    */
+/*                                from values[i * stride] on    */
+/*   slot_count(), plain_modulus() (0 for CKKS) and depth()     */
+/*   (0 when the library derives the levels itself)             */
+/* and for sharded runs:                                        */
+/*   a constructor (profiler, ops, public_keys, ring_dimension) */
+/*   for workers, without a secret key                          */
+/*   public_keys()                serialized for the workers    */
+/*   save(ciphertext)             serialized                    */
+/*   load(saved, ciphertext)                                    */
+/* and set_library_threads(threads), the library's threads per  */
+/* operation (benchmark.h).                                     */
+/****************************************************************/
+#ifndef WORKLOAD_RUNTIME_H
+#define WORKLOAD_RUNTIME_H
+
+#include "phase_profiler.h"
+#include "op_profiler.h"
+#include "benchmark.h"
+#include "workload_registry.h"
+#include "thread_pool.h"
+#include "chunking.h"
+#include "sharding.h"
+#include "pipeline.h"
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+//CKKS results are accepted within this relative error
+const double CKKS_TOLERANCE = 1e-3;
+
+struct WorkloadRun{
+	std::string workload;
+	bool ok = false;
+	std::string error;
+	long records = 0;
+	long chunks = 0;
+	Plan plan;
+	PhaseTimes phases[PHASE_COUNT]; //encryption, evaluation and decryption
+	double max_error = 0;           //relative to the plain result
+	int shards = 0;                 //worker processes, 0 when served in process
+	int64_t shard_encryption_ns = 0; //summed over the workers
+	int64_t shard_evaluation_ns = 0;
+	std::vector<StageStats> stages;  //of a pipelined run
+	int queue_depth = 0;
+	int64_t pipeline_wall_ns = 0;
+	int64_t folded_ns = 0;           //estimated evaluation time of the plan's folded operations
+	std::vector<double> totals;      //of an aggregate workload, per output over all records
+
+	double records_per_second() const{
+		//The stages of a pipelined run overlap
+		int64_t wall_ns = pipeline_wall_ns;
+		if(wall_ns == 0){
+			for(Phase phase : { Phase::Encryption, Phase::Evaluation, Phase::Decryption })
+				wall_ns += phases[(int)phase].wall_ns;
+		}
+		return wall_ns > 0 ? records * 1e9 / wall_ns : 0;
+	}
+};
+
+inline bool needs_relin_keys(const std::vector<WorkloadDefinition>& workloads){
+	for(const WorkloadDefinition& w : workloads){
+		if(w.relin_keys)
+			return true;
+	}
+	return false;
+}
+
+//Times body as part of the phase's sample for run, the first call for a
+//run opens the sample
+template<typename Function>
+void timed_phase(PhaseProfiler& profiler, Phase phase, WorkloadRun& run, bool first, Function&& body){
+	if(first && !profiler.samples(phase).empty())
+		profiler.new_trial(phase);
+	profiler.start(phase);
+	body();
+	profiler.stop();
+	run.phases[(int)phase] = profiler.samples(phase).back();
+}
+
+//One column per input, integers for the exact schemes
+inline std::vector<std::vector<double>> random_records(const WorkloadDefinition& workload, long records, bool exact){
+	std::vector<std::vector<double>> inputs(workload.inputs.size(), std::vector<double>(records));
+	for(size_t i = 0; i < workload.inputs.size(); i++){
+		const WorkloadInput& in = workload.inputs[i];
+		for(long r = 0; r < records; r++){
+			if(exact)
+				inputs[i][r] = (double)(in.min + rand() % (in.max + 1 - in.min));
+			else
+				inputs[i][r] = in.min + (double)rand() / RAND_MAX * (in.max - in.min);
+		}
+	}
+	return inputs;
+}
+
+//Compares every decrypted record with the formula on the plain one and
+//adds up the records of an aggregate workload
+inline void check_results(const WorkloadDefinition& workload, const std::vector<std::vector<double>>& inputs,
+                          const std::vector<std::vector<double>>& decrypted, bool exact, WorkloadRun& run){
+	ExpressionGraph g = workload.graph();
+	std::vector<double> record(inputs.size());
+	for(long r = 0; r < run.records; r++){
+		for(size_t i = 0; i < inputs.size(); i++)
+			record[i] = inputs[i][r];
+		std::vector<double> expected = evaluate(g, record);
+		for(size_t o = 0; o < expected.size(); o++){
+			double error = fabs(decrypted[o][r] - expected[o]) / std::max(1.0, fabs(expected[o]));
+			run.max_error = std::max(run.max_error, error);
+		}
+	}
+	if(workload.aggregate){
+		run.totals.assign(decrypted.size(), 0.0);
+		for(size_t o = 0; o < decrypted.size(); o++)
+			run.totals[o] = std::accumulate(decrypted[o].begin(), decrypted[o].begin() + run.records, 0.0);
+	}
+	run.ok = exact ? run.max_error == 0 : run.max_error < CKKS_TOLERANCE;
+	if(!run.ok)
+		run.error = "results differ from the plain formula";
+}
+
+//records <= 0 fills the slots of one ciphertext
+template<typename Runtime>
+WorkloadRun serve(Runtime& runtime, const WorkloadDefinition& workload, long records, ThreadPool& pool){
+	typedef typename Runtime::Ciphertext Ciphertext;
+	WorkloadRun run;
+	run.workload = workload.name;
+	if(!workload.fits(runtime.plain_modulus(), runtime.depth())){
+		run.error = "does not fit the plaintext modulus or the depth budget";
+		return run;
+	}
+
+	try{
+		run.plan = workload.compile(Runtime::Backend::levelled);
+		long slots = runtime.slot_count();
+		ChunkLayout layout(records > 0 ? records : slots, slots);
+		run.records = layout.records();
+		run.chunks = layout.chunks();
+		bool exact = runtime.plain_modulus() != 0;
+		size_t input_count = workload.inputs.size();
+		size_t output_count = workload.outputs.size();
+
+		std::vector<std::vector<double>> inputs = random_records(workload, run.records, exact);
+		std::vector<std::vector<double>> decrypted(output_count, std::vector<double>(run.records));
+
+		//Only the ciphertexts of one wave of chunks are live at a time
+		long wave = pool.size();
+		for(long first = 0; first < run.chunks; first += wave){
+			long count = std::min(wave, run.chunks - first);
+			std::vector<std::vector<Ciphertext>> encrypted(count, std::vector<Ciphertext>(input_count, runtime.ciphertext()));
+			std::vector<std::vector<Ciphertext>> results(count, std::vector<Ciphertext>(output_count, runtime.ciphertext()));
+
+			timed_phase(runtime.profiler(), Phase::Encryption, run, first == 0, [&](){
+				pool.parallel_for(count * input_count, [&](size_t task){
+					long c = task / input_count;
+					size_t i = task % input_count;
+					runtime.encrypt(layout.slice(inputs[i], first + c), encrypted[c][i]);
+				});
+			});
+			timed_phase(runtime.profiler(), Phase::Evaluation, run, first == 0, [&](){
+				auto evaluate_chunk = [&](long c, ThreadPool* steps){
+					std::vector<const Ciphertext*> in;
+					std::vector<Ciphertext*> out;
+					for(const Ciphertext& ciphertext : encrypted[c])
+						in.push_back(&ciphertext);
+					for(Ciphertext& ciphertext : results[c])
+						out.push_back(&ciphertext);
+					if(steps != nullptr)
+						execute(run.plan, runtime.backend(), in, out, *steps);
+					else
+						execute(run.plan, runtime.backend(), in, out);
+				};
+				if(count == 1)
+					evaluate_chunk(0, &pool);
+				else
+					pool.parallel_for(count, [&](size_t c){ evaluate_chunk(c, nullptr); });
+			});
+			//Straight into the output columns, chunk after chunk
+			timed_phase(runtime.profiler(), Phase::Decryption, run, first == 0, [&](){
+				long values = std::min(run.records, layout.first(first + count)) - layout.first(first);
+				std::vector<const Ciphertext*> column(count);
+				for(size_t o = 0; o < output_count; o++){
+					for(long c = 0; c < count; c++)
+						column[c] = &results[c][o];
+					runtime.decrypt(column, decrypted[o].data() + layout.first(first), values, slots, pool);
+				}
+			});
+		}
+
+		check_results(workload, inputs, decrypted, exact, run);
+	}
+	catch(const std::exception& e){
+		run.error = e.what();
+	}
+	return run;
+}
+
+//Like serve(), with every chunk going through an encryption, an evaluation
+//and a decryption stage of workers[0], workers[1] and workers[2] threads
+//(1 when missing), at most depth chunks waiting between two stages
+template<typename Runtime>
+WorkloadRun serve_pipelined(Runtime& runtime, const WorkloadDefinition& workload, long records,
+                            const std::vector<int>& workers, int depth){
+	typedef typename Runtime::Ciphertext Ciphertext;
+	struct Chunk{
+		std::vector<Ciphertext> encrypted;
+		std::vector<Ciphertext> results;
+	};
+	WorkloadRun run;
+	run.workload = workload.name;
+	if(!workload.fits(runtime.plain_modulus(), runtime.depth())){
+		run.error = "does not fit the plaintext modulus or the depth budget";
+		return run;
+	}
+
+	try{
+		run.plan = workload.compile(Runtime::Backend::levelled);
+		long slots = runtime.slot_count();
+		ChunkLayout layout(records > 0 ? records : slots, slots);
+		run.records = layout.records();
+		run.chunks = layout.chunks();
+		run.queue_depth = depth;
+		bool exact = runtime.plain_modulus() != 0;
+		std::vector<std::vector<double>> inputs = random_records(workload, run.records, exact);
+		std::vector<std::vector<double>> decrypted(workload.outputs.size(), std::vector<double>(run.records));
+
+		auto stage_workers = [&](size_t stage){
+			return stage < workers.size() ? workers[stage] : 1;
+		};
+		std::vector<PipelineStage<Chunk>> stages = {
+			{ "Encryption", stage_workers(0), [&](long c, Chunk& chunk){
+				chunk.encrypted.assign(inputs.size(), runtime.ciphertext());
+				for(size_t i = 0; i < inputs.size(); i++)
+					runtime.encrypt(layout.slice(inputs[i], c), chunk.encrypted[i]);
+			} },
+			{ "Evaluation", stage_workers(1), [&](long, Chunk& chunk){
+				chunk.results.assign(decrypted.size(), runtime.ciphertext());
+				std::vector<const Ciphertext*> in;
+				std::vector<Ciphertext*> out;
+				for(const Ciphertext& ciphertext : chunk.encrypted)
+					in.push_back(&ciphertext);
+				for(Ciphertext& ciphertext : chunk.results)
+					out.push_back(&ciphertext);
+				execute(run.plan, runtime.backend(), in, out);
+				chunk.encrypted.clear();
+			} },
+			{ "Decryption", stage_workers(2), [&](long c, Chunk& chunk){
+				for(size_t o = 0; o < chunk.results.size(); o++)
+					runtime.decrypt(chunk.results[o], decrypted[o].data() + layout.first(c), layout.size(c));
+			} }
+		};
+		run.stages = run_pipeline(run.chunks, depth, stages);
+		run.pipeline_wall_ns = run.stages[0].wall_ns;
+		Phase phases[] = { Phase::Encryption, Phase::Evaluation, Phase::Decryption };
+		for(size_t s = 0; s < run.stages.size(); s++)
+			run.phases[(int)phases[s]].wall_ns = run.stages[s].busy_ns;
+
+		check_results(workload, inputs, decrypted, exact, run);
+	}
+	catch(const std::exception& e){
+		run.error = e.what();
+	}
+	return run;
+}
+
+struct DecryptionThroughput{
+	long ciphertexts = 0;
+	long slots = 0;
+	int threads = 0;
+	int64_t one_at_a_time_ns = 0; //mean per trial
+	int64_t batched_ns = 0;
+	bool ok = false;                //both match the encrypted values
+
+	double per_second(int64_t wall_ns) const{
+		return wall_ns > 0 ? ciphertexts * 1e9 / wall_ns : 0;
+	}
+};
+
+//Decrypts count ciphertexts of full slots, trials times each way: one at a
+//time on the calling thread into a vector per ciphertext, and batched on
+//the pool into one buffer
+template<typename Runtime>
+DecryptionThroughput benchmark_decryption(Runtime& runtime, long count, int trials, ThreadPool& pool){
+	typedef typename Runtime::Ciphertext Ciphertext;
+	typedef std::chrono::steady_clock Clock;
+	auto elapsed_ns = [](Clock::time_point started){
+		return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count();
+	};
+	DecryptionThroughput result;
+	result.ciphertexts = count;
+	result.slots = runtime.slot_count();
+	result.threads = pool.size();
+	size_t slots = (size_t)result.slots;
+
+	//Small integers fit every plaintext modulus
+	std::vector<double> values(slots);
+	for(double& value : values)
+		value = (double)(rand() % 100);
+	std::vector<Ciphertext> ciphertexts(count, runtime.ciphertext());
+	pool.parallel_for(count, [&](size_t i){ runtime.encrypt(values, ciphertexts[i]); });
+	std::vector<const Ciphertext*> batch;
+	for(const Ciphertext& ciphertext : ciphertexts)
+		batch.push_back(&ciphertext);
+
+	std::vector<double> one_at_a_time(count * slots);
+	std::vector<double> batched(count * slots);
+	for(int trial = 0; trial < trials; trial++){
+		Clock::time_point started = Clock::now();
+		for(long i = 0; i < count; i++){
+			std::vector<double> decrypted;
+			runtime.decrypt(ciphertexts[i], decrypted);
+			std::copy(decrypted.begin(), decrypted.begin() + std::min(slots, decrypted.size()),
+			          one_at_a_time.begin() + i * slots);
+		}
+		result.one_at_a_time_ns += elapsed_ns(started);
+		started = Clock::now();
+		runtime.decrypt(batch, batched.data(), batched.size(), slots, pool);
+		result.batched_ns += elapsed_ns(started);
+	}
+	result.one_at_a_time_ns /= std::max(1, trials);
+	result.batched_ns /= std::max(1, trials);
+
+	double tolerance = runtime.plain_modulus() != 0 ? 0 : CKKS_TOLERANCE;
+	result.ok = true;
+	for(size_t i = 0; i < batched.size(); i++){
+		double expected = values[i % slots];
+		result.ok = result.ok && fabs(batched[i] - expected) <= tolerance * std::max(1.0, expected)
+		            && fabs(one_at_a_time[i] - expected) <= tolerance * std::max(1.0, expected);
+	}
+	return result;
+}
+
+inline void report_decryption(std::ostream& out, const DecryptionThroughput& d){
+	double speedup = d.batched_ns > 0 ? (double)d.one_at_a_time_ns / d.batched_ns : 0;
+	out << "Decryption of " << d.ciphertexts << " ciphertexts of " << d.slots << " slots (per second): " << std::fixed
+	    << std::setprecision(1) << d.per_second(d.one_at_a_time_ns) << " one at a time, "
+	    << d.per_second(d.batched_ns) << " batched on " << d.threads << " threads (" << std::setprecision(2)
+	    << speedup << "x)" << (d.ok ? "" : ", values differ from the encrypted ones") << std::defaultfloat
+	    << std::setprecision(6) << std::endl;
+}
+
+//What the workload's evaluation ran of the operations a folded one is
+//priced at: products are multiplications and squares, additions pairwise
+//or n-ary
+struct FoldedOpStats{
+	OpStats products;
+	OpStats additions;
+
+	static FoldedOpStats read(const OpProfiler& ops){
+		FoldedOpStats stats;
+		for(HeOp op : { HeOp::Multiply, HeOp::Square })
+			stats.products += ops.stats(Phase::Evaluation, op);
+		for(HeOp op : { HeOp::Add, HeOp::AddMany })
+			stats.additions += ops.stats(Phase::Evaluation, op);
+		return stats;
+	}
+
+	FoldedOpStats operator-(const FoldedOpStats& earlier) const{
+		return FoldedOpStats{ products - earlier.products, additions - earlier.additions };
+	}
+};
+
+//Evaluation time the plan's folded operations would have taken in the run's
+//chunks, at the mean time of the products and additions the workload itself
+//ran. An n-ary addition is one call for several additions, so additions are
+//priced per addition of the plan. An operation it never ran counts nothing.
+inline int64_t estimate_folded_ns(const WorkloadRun& run, const FoldedOpStats& ran){
+	int64_t ns = 0;
+	if(ran.products.count > 0)
+		ns += run.plan.folded_products * run.chunks * (ran.products.wall_ns / ran.products.count);
+	long additions = (long)run.plan.additions * run.chunks;
+	if(ran.additions.count > 0 && additions > 0)
+		ns += run.plan.folded_additions * run.chunks * (ran.additions.wall_ns / additions);
+	return ns;
+}
+
+inline void report_runs(std::ostream& out, const std::string& runtime, const std::vector<WorkloadRun>& runs){
+	out << "Workloads served by " << runtime << " (seconds):" << std::endl;
+	out << "                        " << std::setw(9) << "Records" << std::setw(8) << "Chunks" << std::setw(14)
+	    << "Encryption" << std::setw(14) << "Evaluation" << std::setw(14) << "Decryption" << std::setw(14)
+	    << "Records/s" << std::setw(12) << "Max error" << std::endl;
+	for(const WorkloadRun& run : runs){
+		out << std::left << std::setw(22) << run.workload << std::right << ": ";
+		if(run.records == 0){
+			out << run.error << std::endl;
+			continue;
+		}
+		out << std::setw(9) << run.records << std::setw(8) << run.chunks << std::fixed << std::setprecision(6);
+		for(Phase phase : { Phase::Encryption, Phase::Evaluation, Phase::Decryption })
+			out << std::setw(14) << run.phases[(int)phase].wall_ns / 1e9;
+		out << std::setprecision(1) << std::setw(14) << run.records_per_second();
+		out << std::defaultfloat << std::setprecision(3) << std::setw(12) << run.max_error;
+		if(!run.ok)
+			out << "  " << run.error;
+		out << std::setprecision(6) << std::endl;
+		out << "                        plan: " << run.plan << std::endl;
+		if(run.plan.folded_products + run.plan.folded_additions > 0){
+			out << "                        folding saved about " << std::fixed << run.folded_ns / 1e9
+			    << " s of evaluation" << std::defaultfloat << std::endl;
+		}
+		if(!run.totals.empty()){
+			out << "                        totals:";
+			for(size_t o = 0; o < run.totals.size(); o++)
+				out << " " << run.totals[o];
+			out << std::endl;
+		}
+		if(run.shards > 0){
+			out << "                        " << run.shards << " worker processes, " << std::fixed
+			    << run.shard_encryption_ns / 1e9 << " s encryption and " << run.shard_evaluation_ns / 1e9
+			    << " s evaluation in the workers" << std::defaultfloat << std::endl;
+		}
+		if(!run.stages.empty()){
+			out << "                        pipeline of " << run.chunks << " chunks, queues of " << run.queue_depth
+			    << ", " << std::fixed << run.pipeline_wall_ns / 1e9 << " s:" << std::defaultfloat << std::endl;
+			report_stages(out, run.stages);
+		}
+	}
+}
+
+//The workloads named on the command line, every registered one without
+//names
+inline std::vector<WorkloadDefinition> selected_workloads(int argc, char** argv){
+	std::vector<WorkloadDefinition> workloads;
+	for(int i = 1; i < argc; i++){
+		const WorkloadDefinition* w = find_workload(argv[i]);
+		if(w == nullptr)
+			throw std::invalid_argument(std::string("no registered workload ") + argv[i]);
+		workloads.push_back(*w);
+	}
+	return workloads.empty() ? workload_registry() : workloads;
+}
+
+//Worker side of a sharded run: loads the public keys, then answers each
+//job, a workload and a number of chunks that follow it one at a time. Every
+//chunk gets a reply with its results, empty for an aggregate workload whose
+//results are added up instead, and the job ends with a reply of the times
+//spent and those sums. Returns when the coordinator closes the socket.
+template<typename Runtime>
+int shard_worker(int fd, const std::vector<WorkloadDefinition>& workloads, long ring_dimension, int threads){
+	typedef typename Runtime::Ciphertext Ciphertext;
+	Runtime::set_library_threads(threads);
+	PhaseProfiler profiler("shard");
+	OpProfiler ops(profiler);
+	Runtime runtime(profiler, ops, unpack(receive_message(fd)), ring_dimension);
+	std::string job;
+	while(receive_message(fd, job)){
+		std::vector<std::string> header = unpack(job);
+		if(header.size() != 2)
+			throw std::runtime_error("malformed job");
+		const WorkloadDefinition& workload = workloads.at(std::stoul(header[0]));
+		long chunks = std::stol(header[1]);
+		Plan plan = workload.compile(Runtime::Backend::levelled);
+		int64_t encryption_ns = profiler.total(Phase::Encryption).wall_ns;
+		int64_t evaluation_ns = profiler.total(Phase::Evaluation).wall_ns;
+
+		std::vector<Ciphertext> sums(workload.outputs.size(), runtime.ciphertext());
+		for(long c = 0; c < chunks; c++){
+			std::vector<std::string> columns = unpack(receive_message(fd));
+			if(columns.size() != workload.inputs.size())
+				throw std::runtime_error("malformed chunk");
+			std::vector<Ciphertext> encrypted(columns.size(), runtime.ciphertext());
+			std::vector<Ciphertext> results(sums.size(), runtime.ciphertext());
+			profiler.start(Phase::Encryption);
+			for(size_t i = 0; i < columns.size(); i++)
+				runtime.encrypt(column_values<double>(columns[i]), encrypted[i]);
+			profiler.start(Phase::Evaluation);
+			std::vector<const Ciphertext*> in;
+			std::vector<Ciphertext*> out;
+			for(const Ciphertext& ciphertext : encrypted)
+				in.push_back(&ciphertext);
+			for(Ciphertext& ciphertext : (workload.aggregate && c == 0 ? sums : results))
+				out.push_back(&ciphertext);
+			execute(plan, runtime.backend(), in, out);
+			for(size_t o = 0; workload.aggregate && c > 0 && o < sums.size(); o++)
+				runtime.backend().add_inplace(sums[o], results[o]);
+			profiler.stop();
+
+			std::vector<std::string> reply;
+			for(size_t o = 0; !workload.aggregate && o < results.size(); o++)
+				reply.push_back(runtime.save(results[o]));
+			send_message(fd, pack(reply));
+		}
+
+		std::vector<std::string> reply = { std::to_string(profiler.total(Phase::Encryption).wall_ns - encryption_ns),
+		                                   std::to_string(profiler.total(Phase::Evaluation).wall_ns - evaluation_ns) };
+		for(size_t o = 0; workload.aggregate && chunks > 0 && o < sums.size(); o++)
+			reply.push_back(runtime.save(sums[o]));
+		send_message(fd, pack(reply));
+	}
+	return 0;
+}
+
+//Coordinator side: splits the records into chunks and gives every worker a
+//contiguous range of them. A worker gets its next chunk as soon as it
+//returns the results of the last one, which are decrypted into place while
+//it works, so only one chunk's results per worker are held at a time. An
+//aggregate workload's partial sums are added up and decrypted at the end,
+//and its slots summed into run.totals. index is the workload's position in
+//the list the workers got. An error while the workers hold part of the job
+//stops them, since what they still send would be read as the next
+//workload's replies.
+template<typename Runtime>
+WorkloadRun serve_sharded(Runtime& runtime, WorkerProcesses& workers, size_t index, const WorkloadDefinition& workload,
+                          long records, ThreadPool& pool){
+	typedef typename Runtime::Ciphertext Ciphertext;
+	WorkloadRun run;
+	run.workload = workload.name;
+	run.shards = workers.size();
+	if(workers.size() == 0){
+		run.error = "the workers were stopped after an earlier error";
+		return run;
+	}
+	if(!workload.fits(runtime.plain_modulus(), runtime.depth())){
+		run.error = "does not fit the plaintext modulus or the depth budget";
+		return run;
+	}
+
+	bool exchanging = false;
+	try{
+		run.plan = workload.compile(Runtime::Backend::levelled);
+		long slots = runtime.slot_count();
+		ChunkLayout layout(records > 0 ? records : slots, slots);
+		run.records = layout.records();
+		run.chunks = layout.chunks();
+		bool exact = runtime.plain_modulus() != 0;
+		if(workload.aggregate && exact
+		   && (double)run.chunks * workload.largest_value >= (double)runtime.plain_modulus())
+			throw std::invalid_argument("the sum over " + std::to_string(run.chunks)
+			                            + " chunks does not fit the plaintext modulus");
+		std::vector<std::vector<double>> inputs = random_records(workload, run.records, exact);
+		size_t output_count = workload.outputs.size();
+		std::vector<std::vector<double>> decrypted(output_count,
+		                                          std::vector<double>(workload.aggregate ? 0 : run.records));
+
+		std::vector<long> first(workers.size() + 1);
+		long most = 0;
+		for(int w = 0; w <= workers.size(); w++)
+			first[w] = run.chunks * w / workers.size();
+		for(int w = 0; w < workers.size(); w++)
+			most = std::max(most, first[w + 1] - first[w]);
+		auto send_chunk = [&](int w, long chunk){
+			std::vector<std::string> columns;
+			for(const std::vector<double>& column : inputs)
+				columns.push_back(column_bytes(layout.slice(column, chunk)));
+			send_message(workers.fd(w), pack(columns));
+		};
+
+		exchanging = true;
+		timed_phase(runtime.profiler(), Phase::Evaluation, run, true, [&](){
+			for(int w = 0; w < workers.size(); w++){
+				send_message(workers.fd(w), pack({ std::to_string(index), std::to_string(first[w + 1] - first[w]) }));
+				if(first[w] < first[w + 1])
+					send_chunk(w, first[w]);
+			}
+		});
+		//One chunk per worker in turn, in the order they were handed out
+		bool first_decryption = true;
+		for(long k = 0; k < most; k++){
+			for(int w = 0; w < workers.size(); w++){
+				long chunk = first[w] + k;
+				if(chunk >= first[w + 1])
+					continue;
+				std::vector<std::string> reply;
+				timed_phase(runtime.profiler(), Phase::Evaluation, run, false, [&](){
+					reply = unpack(receive_message(workers.fd(w)));
+					if(reply.size() != (workload.aggregate ? 0 : output_count))
+						throw std::runtime_error("malformed reply from a worker");
+					if(chunk + 1 < first[w + 1])
+						send_chunk(w, chunk + 1);
+				});
+				if(workload.aggregate)
+					continue;
+				timed_phase(runtime.profiler(), Phase::Decryption, run, first_decryption, [&](){
+					std::vector<Ciphertext> results(output_count, runtime.ciphertext());
+					for(size_t o = 0; o < output_count; o++)
+						runtime.load(reply[o], results[o]);
+					pool.parallel_for(output_count, [&](size_t o){
+						runtime.decrypt(results[o], decrypted[o].data() + layout.first(chunk), layout.size(chunk));
+					});
+				});
+				first_decryption = false;
+			}
+		}
+		std::vector<std::vector<Ciphertext>> partial(workers.size());
+		timed_phase(runtime.profiler(), Phase::Evaluation, run, false, [&](){
+			for(int w = 0; w < workers.size(); w++){
+				bool sums = workload.aggregate && first[w] < first[w + 1];
+				std::vector<std::string> reply = unpack(receive_message(workers.fd(w)));
+				if(reply.size() != 2 + (sums ? output_count : 0))
+					throw std::runtime_error("malformed reply from a worker");
+				run.shard_encryption_ns += std::stoll(reply[0]);
+				run.shard_evaluation_ns += std::stoll(reply[1]);
+				for(size_t o = 2; o < reply.size(); o++){
+					partial[w].push_back(runtime.ciphertext());
+					runtime.load(reply[o], partial[w].back());
+				}
+			}
+		});
+		exchanging = false;
+
+		if(!workload.aggregate){
+			check_results(workload, inputs, decrypted, exact, run);
+			return run;
+		}
+
+		//One n-ary addition per output over the workers that had chunks
+		std::vector<std::vector<double>> sums(output_count);
+		timed_phase(runtime.profiler(), Phase::Decryption, run, true, [&](){
+			for(size_t o = 0; o < output_count; o++){
+				std::vector<const Ciphertext*> terms;
+				for(const std::vector<Ciphertext>& worker_sums : partial)
+					if(o < worker_sums.size())
+						terms.push_back(&worker_sums[o]);
+				Ciphertext total = runtime.ciphertext();
+				runtime.backend().add_many(terms, total);
+				runtime.decrypt(total, sums[o]);
+			}
+		});
+
+		//Slot i holds the records i, i + slots, i + 2 * slots...
+		long used = std::min(run.records, slots);
+		std::vector<double> expected(output_count, 0.0);
+		ExpressionGraph g = workload.graph();
+		std::vector<double> record(inputs.size());
+		for(long r = 0; r < run.records; r++){
+			for(size_t i = 0; i < inputs.size(); i++)
+				record[i] = inputs[i][r];
+			std::vector<double> values = evaluate(g, record);
+			for(size_t o = 0; o < values.size(); o++)
+				expected[o] += values[o];
+		}
+		run.totals.assign(output_count, 0.0);
+		for(size_t o = 0; o < output_count; o++){
+			if((long)sums[o].size() < used)
+				throw std::runtime_error("a decrypted sum has fewer slots than records");
+			for(long r = 0; r < used; r++)
+				run.totals[o] += sums[o][r];
+			double error = fabs(run.totals[o] - expected[o]) / std::max(1.0, fabs(expected[o]));
+			run.max_error = std::max(run.max_error, error);
+		}
+		run.ok = exact ? run.max_error == 0 : run.max_error < CKKS_TOLERANCE;
+		if(!run.ok)
+			run.error = "results differ from the plain formula";
+	}
+	catch(const std::exception& e){
+		run.error = e.what();
+		if(exchanging){
+			workers.abort();
+			run.error += ", the workers were stopped";
+		}
+	}
+	return run;
+}
+
+//Forks the workers before anything else starts a thread, then builds the
+//coordinator's runtime, its keys generated and its results decrypted on a
+//pool, and serves the workloads through them. The workers share the
+//FHE_THREADS budget as library threads.
+template<typename Runtime>
+int serve_sharded_workloads(const std::string& name, const std::vector<WorkloadDefinition>& workloads,
+                            const BenchmarkConfig& config){
+	WorkerProcesses workers(config.shards, [&](int fd){
+		return shard_worker<Runtime>(fd, workloads, config.ring_dimension,
+		                             std::max(1, config.total_threads() / config.shards));
+	});
+	Runtime::set_library_threads(config.library_threads());
+	ThreadPool pool(config.pool_size(), config.pin);
+	PhaseProfiler profiler(name);
+	OpProfiler ops(profiler);
+	Runtime runtime(profiler, ops, workloads, pool, config.ring_dimension);
+	profiler.set_configuration(ProfileConfiguration{ config.ring_dimension, config.records, pool.size(),
+	                                                 config.library_threads() });
+	std::string keys = pack(runtime.public_keys());
+	for(int w = 0; w < workers.size(); w++)
+		send_message(workers.fd(w), keys);
+
+	std::vector<WorkloadRun> runs;
+	bool ok = true;
+	for(size_t i = 0; i < workloads.size(); i++){
+		runs.push_back(serve_sharded(runtime, workers, i, workloads[i], config.records, pool));
+		ok = ok && runs.back().ok;
+	}
+	ok = workers.wait() && ok;
+	report_runs(std::cout, name, runs);
+	profiler.report(std::cout);
+	ops.report(std::cout);
+	std::cout << std::endl;
+	return ok ? 0 : 1;
+}
+
+//Builds one runtime for the workloads, serves each of them with the
+//FHE_RECORDS, FHE_RING_DIM and FHE_THREADS settings and reports. With
+//FHE_SHARDS the workers serve them (serve_sharded_workloads()), with
+//FHE_PIPELINE serve_pipelined() does, its stage threads sharing FHE_THREADS.
+//FHE_DECRYPT_BENCH adds benchmark_decryption() after the reports.
+template<typename Runtime>
+int serve_workloads(const std::string& name, const std::vector<WorkloadDefinition>& workloads){
+	BenchmarkConfig config = BenchmarkConfig::from_env();
+	if(config.shards > 0)
+		return serve_sharded_workloads<Runtime>(name, workloads, config);
+	bool pipelined = !config.pipeline.empty();
+	Runtime::set_library_threads(pipelined ? config.pipeline_library_threads() : config.library_threads());
+	PhaseProfiler profiler(name);
+	OpProfiler ops(profiler);
+	ThreadPool pool(config.pool_size(), config.pin);
+	Runtime runtime(profiler, ops, workloads, pool, config.ring_dimension);
+	profiler.set_configuration(ProfileConfiguration{ config.ring_dimension, config.records, pool.size(),
+	                                                 pipelined ? config.pipeline_library_threads()
+	                                                           : config.library_threads() });
+	std::vector<WorkloadRun> runs;
+	bool ok = true;
+	for(const WorkloadDefinition& w : workloads){
+		FoldedOpStats before = FoldedOpStats::read(ops);
+		if(pipelined)
+			runs.push_back(serve_pipelined(runtime, w, config.records, config.pipeline, config.queue_depth));
+		else
+			runs.push_back(serve(runtime, w, config.records, pool));
+		runs.back().folded_ns = estimate_folded_ns(runs.back(), FoldedOpStats::read(ops) - before);
+		ok = ok && runs.back().ok;
+	}
+	report_runs(std::cout, name, runs);
+	profiler.report(std::cout);
+	ops.report(std::cout);
+	pool.report(std::cout);
+	if(config.decrypt_ciphertexts > 0){
+		DecryptionThroughput throughput = benchmark_decryption(runtime, config.decrypt_ciphertexts, config.trials, pool);
+		report_decryption(std::cout, throughput);
+		ok = ok && throughput.ok;
+	}
+	std::cout << std::endl;
+	return ok ? 0 : 1;
+}
+
+#endif
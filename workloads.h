@@ -0,0 +1,263 @@
+/****************************************************************/
+/* Evaluation of the calculators, written once for every        */
+/* library                                                      */
+/* Author: Majdi Maalej                                         */
+/* Each workload is its formula (expression.h), compiled once   */
+/* into a plan and run on a backend (fhe_backend.h). The        */
+/* calculators keep their own parameters, encoding and decoding */
+/* and call these inside the timed evaluation phase.            */
+/* Intermediate ciphertexts are passed in so the calculators    */
+/* can report their sizes.                                      */
+/* Given a thread pool (thread_pool.h) the independent steps of */
+/* a plan run at the same time, the two products of the gross   */
+/* pay or the squares of the radius and the temperature.        */
+/* tree_sum() adds any number of ciphertexts: one run of the    */
+/* terms per pool thread with the backend's n-ary addition,     */
+/* then the runs' sums pairwise, log2(threads) rounds deep.     */
+/* The workload types give the parameter tables                 */
+/* (scheme_traits.h) the plaintext modulus, the largest result  */
+/* for the calculators' input ranges and the depth of the plan. */
+/****************************************************************/
+#ifndef WORKLOADS_H
+#define WORKLOADS_H
+
+#include "fhe_backend.h"
+#include "expression.h"
+#include "thread_pool.h"
+#include "scheme_traits.h"
+#include <stdint.h>
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+//Gross pay = regular hours * regular rate + overtime hours * overtime rate
+struct GrossPayWorkload{
+	static constexpr int min_regular_hours = 40;
+	static constexpr int max_regular_hours = 192;
+	static constexpr int min_regular_rate = 9;
+	static constexpr int max_regular_rate = 30;
+	static constexpr int min_overtime_hours = 0;
+	static constexpr int max_overtime_hours = 40;
+	static constexpr int min_overtime_rate = 9;
+	static constexpr int max_overtime_rate = 20;
+	static constexpr uint64_t plain_modulus = PLAIN_MODULUS_17_BITS;
+	static constexpr uint64_t largest_value = (uint64_t)max_regular_hours * max_regular_rate
+	                                          + (uint64_t)max_overtime_hours * max_overtime_rate;
+	static constexpr int depth = 1;
+};
+
+inline void gross_pay_formula(ExpressionGraph& g){
+	Expr regular_hours = g.input(0), regular_rate = g.input(1);
+	Expr overtime_hours = g.input(2), overtime_rate = g.input(3);
+	Expr standard_pay = regular_hours * regular_rate;
+	g.keep(0, standard_pay);
+	g.result(1, standard_pay + overtime_hours * overtime_rate);
+}
+
+inline Plan compile_gross_pay(bool levelled){
+	ExpressionGraph g;
+	gross_pay_formula(g);
+	return compile(g, levelled);
+}
+
+inline const Plan& gross_pay_plan(bool levelled){
+	static const Plan plans[] = { compile_gross_pay(false), compile_gross_pay(true) };
+	return plans[levelled];
+}
+
+template<typename Backend>
+void gross_pay(Backend& he, const BackendCiphertext<Backend>& regular_hours,
+               const BackendCiphertext<Backend>& regular_rate, const BackendCiphertext<Backend>& overtime_hours,
+               const BackendCiphertext<Backend>& overtime_rate, BackendCiphertext<Backend>& standard_pay,
+               BackendCiphertext<Backend>& total_pay){
+	execute(gross_pay_plan(Backend::levelled), he, { &regular_hours, &regular_rate, &overtime_hours, &overtime_rate },
+	        { &standard_pay, &total_pay });
+}
+
+template<typename Backend>
+void gross_pay(Backend& he, const BackendCiphertext<Backend>& regular_hours,
+               const BackendCiphertext<Backend>& regular_rate, const BackendCiphertext<Backend>& overtime_hours,
+               const BackendCiphertext<Backend>& overtime_rate, BackendCiphertext<Backend>& standard_pay,
+               BackendCiphertext<Backend>& total_pay, ThreadPool& pool){
+	execute(gross_pay_plan(Backend::levelled), he, { &regular_hours, &regular_rate, &overtime_hours, &overtime_rate },
+	        { &standard_pay, &total_pay }, pool);
+}
+
+//Luminousity/(4*pi*sigma) = (r^2) * (T^4). The compiler derives T^4 as the
+//square of T^2 from the flat product. The calculators draw their inputs from
+//these ranges, the largest result follows from them.
+struct LuminousityWorkload{
+	static constexpr int min_radius = 9;
+	static constexpr int max_radius = 81;
+	static constexpr int min_temperature = 2;
+	static constexpr int max_temperature = 20;
+	static constexpr uint64_t plain_modulus = PLAIN_MODULUS_31_BITS;
+	static constexpr uint64_t largest_value = (uint64_t)max_radius * max_radius * max_temperature * max_temperature
+	                                          * max_temperature * max_temperature;
+	static constexpr int depth = 3;
+};
+
+inline void luminousity_formula(ExpressionGraph& g){
+	Expr r = g.input(0), t = g.input(1);
+	g.keep(0, r * r);
+	g.keep(1, t * t);
+	g.keep(2, t * t * t * t);
+	g.result(3, r * r * t * t * t * t);
+}
+
+inline Plan compile_luminousity(bool levelled){
+	ExpressionGraph g;
+	luminousity_formula(g);
+	return compile(g, levelled);
+}
+
+inline const Plan& luminousity_plan(bool levelled){
+	static const Plan plans[] = { compile_luminousity(false), compile_luminousity(true) };
+	return plans[levelled];
+}
+
+template<typename Backend>
+void luminousity(Backend& he, const BackendCiphertext<Backend>& radius, const BackendCiphertext<Backend>& temperature,
+                 BackendCiphertext<Backend>& radius_squared, BackendCiphertext<Backend>& temperature_squared,
+                 BackendCiphertext<Backend>& temperature_quadruple, BackendCiphertext<Backend>& result){
+	execute(luminousity_plan(Backend::levelled), he, { &radius, &temperature },
+	        { &radius_squared, &temperature_squared, &temperature_quadruple, &result });
+}
+
+template<typename Backend>
+void luminousity(Backend& he, const BackendCiphertext<Backend>& radius, const BackendCiphertext<Backend>& temperature,
+                 BackendCiphertext<Backend>& radius_squared, BackendCiphertext<Backend>& temperature_squared,
+                 BackendCiphertext<Backend>& temperature_quadruple, BackendCiphertext<Backend>& result,
+                 ThreadPool& pool){
+	execute(luminousity_plan(Backend::levelled), he, { &radius, &temperature },
+	        { &radius_squared, &temperature_squared, &temperature_quadruple, &result }, pool);
+}
+
+//Total Covid deaths = the sum of 16 regions of up to 50 deaths
+struct TotalCovidDeathsWorkload{
+	static constexpr int regions = 16;
+	static constexpr uint64_t plain_modulus = PLAIN_MODULUS_17_BITS;
+	static constexpr uint64_t largest_value = regions * 50;
+	static constexpr int depth = 0;
+};
+
+//The German states, in the order of the calculators' columns
+const char* const COVID_REGION_CODES[TotalCovidDeathsWorkload::regions] = {
+	"BW", "BY", "BE", "BB", "HB", "HH", "HE", "NI", "MV", "NW", "RP", "SL", "SN", "ST", "SH", "TH" };
+const char* const COVID_REGION_NAMES[TotalCovidDeathsWorkload::regions] = {
+	"Baden-Wuerttemberg", "Bavaria", "Berlin", "Brandenburg", "Bremen", "Hamburg", "Hesse", "Lower Saxony",
+	"Mecklenburg-Vorpommern", "North Rhine-Westphalia", "Rhineland-Palatinate", "Saarland", "Saxony",
+	"Saxony-Anhalt", "Schleswig-Holstein", "Thuringia" };
+
+//total = the sum of the inputs, compiled to one n-ary addition (add_many).
+//There are no products, so the plan is the same whether the backend is
+//levelled or not.
+inline void add_all_formula(ExpressionGraph& g, int inputs){
+	Expr total = g.input(0);
+	for(int i = 1; i < inputs; i++)
+		total = total + g.input(i);
+	g.result(0, total);
+}
+
+//How tree_sum() splits a number of terms over a pool: runs summed with
+//add_many(), then rounds of pairwise additions of the runs' sums
+struct TreeSumShape{
+	size_t terms = 0;
+	size_t runs = 1;
+	int rounds = 0;
+};
+
+inline TreeSumShape tree_sum_shape(size_t terms, int threads){
+	TreeSumShape shape;
+	shape.terms = terms;
+	shape.runs = std::max<size_t>(1, std::min<size_t>(threads, terms / 2));
+	for(size_t width = 1; width < shape.runs; width *= 2)
+		shape.rounds++;
+	return shape;
+}
+
+inline std::ostream& operator<<(std::ostream& out, const TreeSumShape& shape){
+	out << shape.terms << " terms in " << shape.runs << (shape.runs == 1 ? " run" : " runs")
+	    << " of add_many, then " << shape.rounds << " rounds of pairwise additions";
+	return out;
+}
+
+//total = the sum of the terms, all at one level. The terms are split into
+//one run of neighbours per pool thread, at least two to a run, and each run
+//is summed with add_many(). The sums of the runs are then added pairwise,
+//every round on the pool, so thousands of terms take a run's additions and
+//log2(threads) more. The order of the additions only depends on the pool's
+//size, CKKS results are the same from one run to the next.
+template<typename Backend>
+void tree_sum(Backend& he, BackendCiphertext<Backend>& total,
+              const std::vector<const BackendCiphertext<Backend>*>& terms, ThreadPool& pool){
+	typedef BackendCiphertext<Backend> Ciphertext;
+	static_assert(is_fhe_backend<Backend>::value, "tree_sum needs a backend as described in fhe_backend.h");
+	if(terms.empty())
+		throw std::invalid_argument("tree_sum needs at least one term");
+	size_t runs = tree_sum_shape(terms.size(), pool.size()).runs;
+	if(runs == 1){
+		he.add_many(terms, total);
+		return;
+	}
+
+	//The first run sums into total. HElib ciphertexts have no default
+	//constructor, the other sums start as a copy of their first term.
+	std::vector<std::optional<Ciphertext>> partials(runs);
+	std::vector<Ciphertext*> sums(runs, &total);
+	for(size_t r = 1; r < runs; r++){
+		if constexpr(std::is_default_constructible<Ciphertext>::value)
+			partials[r].emplace();
+		else
+			partials[r].emplace(*terms[r * terms.size() / runs]);
+		sums[r] = &*partials[r];
+	}
+	pool.parallel_for(runs, [&](size_t r){
+		std::vector<const Ciphertext*> run(terms.begin() + r * terms.size() / runs,
+		                                   terms.begin() + (r + 1) * terms.size() / runs);
+		he.add_many(run, *sums[r]);
+	});
+	for(size_t width = 1; width < runs; width *= 2){
+		size_t pairs = (runs + 2 * width - 1) / (2 * width);
+		pool.parallel_for(pairs, [&](size_t p){
+			size_t left = p * 2 * width;
+			if(left + width < runs)
+				he.add_inplace(*sums[left], *sums[left + width]);
+		});
+	}
+}
+
+template<typename Backend>
+void tree_sum(Backend& he, BackendCiphertext<Backend>& total, const std::vector<BackendCiphertext<Backend>>& terms,
+              ThreadPool& pool){
+	std::vector<const BackendCiphertext<Backend>*> pointers;
+	for(const BackendCiphertext<Backend>& term : terms)
+		pointers.push_back(&term);
+	tree_sum(he, total, pointers, pool);
+}
+
+//One n-ary addition of all the inputs, on the calling thread
+template<typename Backend, typename... Inputs>
+void add_all(Backend& he, BackendCiphertext<Backend>& total, const BackendCiphertext<Backend>& first,
+             const BackendCiphertext<Backend>& second, const Inputs&... inputs){
+	he.add_many({ &first, &second, &inputs... }, total);
+}
+
+template<typename Backend>
+void add_all(Backend& he, BackendCiphertext<Backend>& total, const std::vector<BackendCiphertext<Backend>>& inputs){
+	std::vector<const BackendCiphertext<Backend>*> pointers;
+	for(const BackendCiphertext<Backend>& input : inputs)
+		pointers.push_back(&input);
+	he.add_many(pointers, total);
+}
+
+template<typename Backend>
+void add_all(Backend& he, BackendCiphertext<Backend>& total, const std::vector<BackendCiphertext<Backend>>& inputs,
+             ThreadPool& pool){
+	tree_sum(he, total, inputs, pool);
+}
+
+#endif